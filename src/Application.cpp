@@ -1,6 +1,8 @@
 ﻿#include "Application.hpp"
 #include "ShaderModule.hpp"
 #include "RandomScene.hpp"
+#include "ObjLoader.hpp"
+#include "ImageUtils.hpp"
 
 #ifdef _DEBUG
 #include "vkValidation.hpp"
@@ -9,8 +11,11 @@
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <chrono>
+#include <cstring>
+#include <filesystem>
 #include <set>
 #include <unordered_map>
 
@@ -51,6 +56,27 @@ void Application::setFrameBufferResize()
     _framebufferResized = true;
 }
 
+void Application::switchDenoiser()
+{
+    if (!USE_DENOISER) {
+        return;
+    }
+
+    // SVGF is skipped without the temporal moments it needs
+    do {
+        _denoiserType = static_cast<DenoiserType>((static_cast<int>(_denoiserType) + 1) % (static_cast<int>(DenoiserType::Bmfr) + 1));
+    } while (_denoiserType == DenoiserType::Svgf && !USE_TEMPORAL_ACCUMULATION);
+    _denoiserChanged = true;
+
+    const char* names[] = { "A-trous", "SVGF", "BMFR" };
+    std::cout << "Denoiser : " << names[static_cast<int>(_denoiserType)] << std::endl;
+}
+
+void Application::requestFrameExport()
+{
+    _frameExportRequested = true;
+}
+
 Character& Application::getCharacter()
 {
     return _character;
@@ -58,6 +84,11 @@ Character& Application::getCharacter()
 
 void Application::drawFrame()
 {
+    if (_denoiserChanged) {
+        _denoiserChanged = false;
+        recreateDenoiser();
+    }
+
     vkWaitForFences(_device, 1, &_inFlightFences[_currentFrame], VK_TRUE, UINT64_MAX);
     vkResetFences(_device, 1, &_inFlightFences[_currentFrame]);
 
@@ -71,6 +102,10 @@ void Application::drawFrame()
     }
 
     updateUniformBuffer(imageIndex);
+    _rtHandler.updateLevelsOfDetail(_character.getPosition(), imageIndex);
+
+    // Timings of the previous execution of the command buffer
+    _profiler.collect(imageIndex);
 
     VkSubmitInfo submitInfo {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -91,6 +126,13 @@ void Application::drawFrame()
         throw std::runtime_error("Failed to submit draw command buffer!");
     }
 
+    // The images of this swapchain image are only written again by its next submission
+    if (_frameExportRequested) {
+        _frameExportRequested = false;
+        vkQueueWaitIdle(_graphicsQueue);
+        exportFrame(imageIndex);
+    }
+
     VkPresentInfoKHR presentInfo {};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     presentInfo.waitSemaphoreCount = 1;
@@ -130,6 +172,15 @@ void Application::initWindow()
         auto app = reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
         app->getCharacter().onFocus(window, focused);
     });
+
+    glfwSetKeyCallback(_window, [](GLFWwindow* window, int key, int scancode, int action, int mods) {
+        auto app = reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
+        if (key == DENOISER_SWITCH_KEY && action == GLFW_PRESS) {
+            app->switchDenoiser();
+        } else if (key == FRAME_EXPORT_KEY && action == GLFW_PRESS) {
+            app->requestFrameExport();
+        }
+    });
 }
 
 void Application::initVulkan()
@@ -146,15 +197,25 @@ void Application::initVulkan()
     createCommandPool();
     createStorageImage();
     _samplers.emplace_back(*this);
-    _textures.emplace_back(*this, _samplers[0], SKYDOME_PATH);
+    _textureCache.setDiskCacheDirectory(TEXTURE_CACHE_PATH);
+    _environmentMap = std::make_unique<EnvironmentMap>(*this, SKYDOME_PATH, _samplers[0]);
+    _textures.push_back(_environmentMap->getTexture());
     if (USE_RANDOM_SCENE) {
-        _model = std::make_unique<RandomScene>(*this, 20.f, 30);
+        _model = std::make_unique<RandomScene>(*this, 20.f, RANDOM_SCENE_SCALE, RANDOM_SCENE_SEED);
+    } else if (MODEL_PATH.size() > 4 && MODEL_PATH.compare(MODEL_PATH.size() - 4, 4, ".obj") == 0) {
+        _model = std::make_unique<ObjLoader>(*this, MODEL_PATH);
     } else {
         _model = std::make_unique<GltfLoader>(*this);
         _model->loadModel(MODEL_PATH);
     }
-    _model->load(_indices, _vertices);
+    {
+        // CPU copies of the geometry only live until the upload
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        _model->load(indices, vertices);
+    }
     _rtHandler.init();
+    trimHostMemory();
     createUniformBuffers();
     createModelsUniforms();
     createDescriptorSetLayout();
@@ -162,6 +223,7 @@ void Application::initVulkan()
     createShaderBindingTable();
     createDescriptorPool();
     createDescriptorSets();
+    createDenoiser();
     createCommandBuffers();
     createSemaphores();
 }
@@ -250,6 +312,10 @@ void Application::mainLoop()
 
         if (counter >= FPS_COUNTER_TOP) {
             std::cout << "FPS : " << static_cast<float>(counter) / timeSum << std::endl;
+            const std::string timings = _profiler.getReport();
+            if (!timings.empty()) {
+                std::cout << timings << std::endl;
+            }
             counter = 0;
             timeSum = 0.f;
         }
@@ -262,8 +328,10 @@ void Application::cleanup()
 {
     _samplers.clear();
     _textures.clear();
+    _environmentMap.reset();
 
     _model.reset();
+    _textureCache.clear();
 
     cleanupSwapchain();
 
@@ -280,11 +348,7 @@ void Application::cleanup()
 
     vkDestroyCommandPool(_device, _commandPool, nullptr);
 
-    for (auto storageImage : _storageImages) {
-        vkDestroyImageView(_device, storageImage.view, nullptr);
-        vkDestroyImage(_device, storageImage.image, nullptr);
-        vkFreeMemory(_device, storageImage.memory, nullptr);
-    }
+    destroyStorageImages();
 
     _rtHandler.cleanupRaytracingHandler();
 
@@ -446,8 +510,13 @@ void Application::createLogicalDevice()
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(_physDevice, &supportedFeatures);
+
     VkPhysicalDeviceFeatures deviceFeatures {};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    // Optional, compressed textures fall back to RGBA8 without it
+    deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
 
     VkDeviceCreateInfo createInfo {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -737,15 +806,75 @@ void Application::deleteModelsUniforms()
 
 void Application::createStorageImage()
 {
+    // Compact formats, the G-buffer is read back for every tap of the filters
+    const std::array<VkFormat, GBUFFER_IMAGE_COUNT> gBufferFormats = {
+        VK_FORMAT_R16G16_SNORM, // GBUFFER_NORMAL
+        VK_FORMAT_R32_SFLOAT, // GBUFFER_DEPTH
+        VK_FORMAT_R8G8B8A8_UNORM, // GBUFFER_ALBEDO
+        VK_FORMAT_R16_UINT, // GBUFFER_MATERIAL
+        VK_FORMAT_R16G16_SFLOAT, // GBUFFER_MOTION
+        VK_FORMAT_R16G16B16A16_SFLOAT, // GBUFFER_DIRECT
+        VK_FORMAT_R16G16B16A16_SFLOAT, // GBUFFER_INDIRECT
+        VK_FORMAT_R32G32B32A32_SFLOAT, // GBUFFER_POSITION, half floats are too coarse away from the origin
+        VK_FORMAT_R16G16B16A16_SFLOAT, // GBUFFER_VISIBILITY
+    };
+
     _storageImages.resize(_swapchainImages.size());
+    _gBuffers.resize(_swapchainImages.size());
     for (size_t i = 0; i < _storageImages.size(); i++) {
-        createImage(_swapchainExtent.width, _swapchainExtent.height, _swapchainImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _storageImages[i].image, _storageImages[i].memory);
-        _storageImages[i].format = _swapchainImageFormat;
+        // Sampled by the first pass of the denoiser
+        createStorageImage(_storageImages[i], _swapchainImageFormat, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+        for (size_t j = 0; j < GBUFFER_IMAGE_COUNT; j++) {
+            // Depth and normal are copied as the previous first hits of the temporal accumulation, the illumination is sampled by it
+            createStorageImage(_gBuffers[i][j], gBufferFormats[j], VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+        }
+    }
+
+    // Bound even without adaptive sampling, cleared so the first frame gets no extra path
+    createStorageImage(_samplePriorities, VK_FORMAT_R16G16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _prioritySum.buffer, _prioritySum.memory);
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    const VkClearColorValue zero {};
+    const VkImageSubresourceRange range { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    vkCmdClearColorImage(commandBuffer, _samplePriorities.image, VK_IMAGE_LAYOUT_GENERAL, &zero, 1, &range);
+    vkCmdFillBuffer(commandBuffer, _prioritySum.buffer, 0, VK_WHOLE_SIZE, 0);
+    endSingleTimeCommands(commandBuffer);
+}
 
-        _storageImages[i].view = createImageView(_storageImages[i].image, _storageImages[i].format, VK_IMAGE_ASPECT_COLOR_BIT);
+void Application::createStorageImage(StorageImage& storageImage, VkFormat format, VkImageUsageFlags usage)
+{
+    createImage(_swapchainExtent.width, _swapchainExtent.height, format, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, storageImage.image, storageImage.memory);
+    storageImage.format = format;
 
-        transitionImageLayout(nullptr, _storageImages[i].image, _storageImages[i].format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+    storageImage.view = createImageView(storageImage.image, storageImage.format, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    transitionImageLayout(nullptr, storageImage.image, storageImage.format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+}
+
+void Application::destroyStorageImages()
+{
+    auto destroy = [this](const StorageImage& storageImage) {
+        vkDestroyImageView(_device, storageImage.view, nullptr);
+        vkDestroyImage(_device, storageImage.image, nullptr);
+        vkFreeMemory(_device, storageImage.memory, nullptr);
+    };
+
+    for (const auto& storageImage : _storageImages) {
+        destroy(storageImage);
     }
+    for (const auto& gBuffer : _gBuffers) {
+        for (const auto& storageImage : gBuffer) {
+            destroy(storageImage);
+        }
+    }
+    _storageImages.clear();
+    _gBuffers.clear();
+
+    destroy(_samplePriorities);
+    vkDestroyBuffer(_device, _prioritySum.buffer, nullptr);
+    vkFreeMemory(_device, _prioritySum.memory, nullptr);
 }
 
 void Application::createShaderBindingTable()
@@ -817,13 +946,65 @@ void Application::createDescriptorSetLayout()
     lightsLayoutBinding.binding = 6;
     lightsLayoutBinding.descriptorCount = _lights.size();
 
-    std::array<VkDescriptorSetLayoutBinding, 7> bindings({ uniformBufferBinding,
+    VkDescriptorSetLayoutBinding positionsLayoutBinding {};
+    positionsLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    positionsLayoutBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+    positionsLayoutBinding.binding = 7;
+    positionsLayoutBinding.descriptorCount = 1;
+
+    VkDescriptorSetLayoutBinding environmentLayoutBinding {};
+    environmentLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    environmentLayoutBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+    environmentLayoutBinding.binding = 8;
+    environmentLayoutBinding.descriptorCount = 1;
+
+    VkDescriptorSetLayoutBinding spheresLayoutBinding {};
+    spheresLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    spheresLayoutBinding.stageFlags = VK_SHADER_STAGE_INTERSECTION_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+    spheresLayoutBinding.binding = 9;
+    spheresLayoutBinding.descriptorCount = 1;
+
+    VkDescriptorSetLayoutBinding instancesLayoutBinding {};
+    instancesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    instancesLayoutBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+    instancesLayoutBinding.binding = 10;
+    instancesLayoutBinding.descriptorCount = 1;
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings({ uniformBufferBinding,
         accelerationStructureLayoutBinding,
         resultImageLayoutBinding,
         verticesLayoutBinding,
         indicesLayoutBinding,
         materialsLayoutBiding,
-        lightsLayoutBinding });
+        lightsLayoutBinding,
+        positionsLayoutBinding,
+        environmentLayoutBinding,
+        spheresLayoutBinding,
+        instancesLayoutBinding });
+
+    // G-buffer images, only written by the ray generation shader
+    for (uint32_t i = 0; i < GBUFFER_IMAGE_COUNT; i++) {
+        VkDescriptorSetLayoutBinding gBufferLayoutBinding {};
+        gBufferLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        gBufferLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+        gBufferLayoutBinding.binding = GBUFFER_FIRST_BINDING + i;
+        gBufferLayoutBinding.descriptorCount = 1;
+        bindings.push_back(gBufferLayoutBinding);
+    }
+
+    VkDescriptorSetLayoutBinding samplePrioritiesLayoutBinding {};
+    samplePrioritiesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    samplePrioritiesLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+    samplePrioritiesLayoutBinding.binding = GBUFFER_FIRST_BINDING + GBUFFER_IMAGE_COUNT;
+    samplePrioritiesLayoutBinding.descriptorCount = 1;
+    bindings.push_back(samplePrioritiesLayoutBinding);
+
+    VkDescriptorSetLayoutBinding prioritySumLayoutBinding {};
+    prioritySumLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    prioritySumLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+    prioritySumLayoutBinding.binding = GBUFFER_FIRST_BINDING + GBUFFER_IMAGE_COUNT + 1;
+    prioritySumLayoutBinding.descriptorCount = 1;
+    bindings.push_back(prioritySumLayoutBinding);
 
     VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo {};
     descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -838,9 +1019,23 @@ void Application::createDescriptorSetLayout()
     setLayoutBinding.binding = 0;
     setLayoutBinding.descriptorCount = _model->_textures.size() + _textures.size();
 
+    VkDescriptorSetLayoutBinding environmentCubeBinding {};
+    environmentCubeBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    environmentCubeBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR;
+    environmentCubeBinding.binding = 1;
+    environmentCubeBinding.descriptorCount = 1;
+
+    VkDescriptorSetLayoutBinding irradianceCubeBinding {};
+    irradianceCubeBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    irradianceCubeBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR;
+    irradianceCubeBinding.binding = 2;
+    irradianceCubeBinding.descriptorCount = 1;
+
+    std::array<VkDescriptorSetLayoutBinding, 3> textureBindings({ setLayoutBinding, environmentCubeBinding, irradianceCubeBinding });
+
     descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    descriptorSetLayoutCreateInfo.bindingCount = 1;
-    descriptorSetLayoutCreateInfo.pBindings = &setLayoutBinding;
+    descriptorSetLayoutCreateInfo.bindingCount = static_cast<uint32_t>(textureBindings.size());
+    descriptorSetLayoutCreateInfo.pBindings = textureBindings.data();
 
     if (vkCreateDescriptorSetLayout(_device, &descriptorSetLayoutCreateInfo, nullptr, &_descriptorSetLayouts.textures) != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate descriptor set Layout!");
@@ -853,8 +1048,11 @@ void Application::createRaytracingPipeline()
     auto raymiss = ShaderModule(_device, "shaders/miss.rmiss.spv", VK_SHADER_STAGE_MISS_BIT_KHR);
     auto raychit = ShaderModule(_device, "shaders/closehit.rchit.spv", VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
     auto shadowmiss = ShaderModule(_device, "shaders/raytraceShadow.rmiss.spv", VK_SHADER_STAGE_MISS_BIT_KHR);
+    auto sphereint = ShaderModule(_device, "shaders/sphere.rint.spv", VK_SHADER_STAGE_INTERSECTION_BIT_KHR);
+    auto spherechit = ShaderModule(_device, "shaders/sphere.rchit.spv", VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
+    auto shadowchit = ShaderModule(_device, "shaders/shadow.rchit.spv", VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
 
-    std::array<VkPipelineShaderStageCreateInfo, 4> shaderStages({ raygen.getStageInfo(), raymiss.getStageInfo(), raychit.getStageInfo(), shadowmiss.getStageInfo() });
+    std::array<VkPipelineShaderStageCreateInfo, 7> shaderStages({ raygen.getStageInfo(), raymiss.getStageInfo(), raychit.getStageInfo(), shadowmiss.getStageInfo(), sphereint.getStageInfo(), spherechit.getStageInfo(), shadowchit.getStageInfo() });
 
     VkPushConstantRange pushConstantRange {};
     pushConstantRange.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
@@ -865,6 +1063,9 @@ void Application::createRaytracingPipeline()
     constexpr uint32_t shaderIndexMiss = 1;
     constexpr uint32_t shaderIndexClosestHit = 2;
     constexpr uint32_t shaderShadowMiss = 3;
+    constexpr uint32_t shaderIndexSphereIntersection = 4;
+    constexpr uint32_t shaderIndexSphereClosestHit = 5;
+    constexpr uint32_t shaderIndexShadowClosestHit = 6;
 
     std::array<VkDescriptorSetLayout, 2> setLayouts = { _descriptorSetLayouts.raytrace, _descriptorSetLayouts.textures };
 
@@ -905,8 +1106,25 @@ void Application::createRaytracingPipeline()
     closesHitGroupCI.closestHitShader = shaderIndexClosestHit;
     closesHitGroupCI.anyHitShader = VK_SHADER_UNUSED_KHR;
     closesHitGroupCI.intersectionShader = VK_SHADER_UNUSED_KHR;
+    _shaderGroups.push_back(closesHitGroupCI); // HIT_GROUP_TRIANGLES
+
+    // Hard shadow rays skip the closest hit shader, the soft shadow ray gets the distance to the blocker from it
+    closesHitGroupCI.closestHitShader = shaderIndexShadowClosestHit;
     _shaderGroups.push_back(closesHitGroupCI);
 
+    // Spheres still need their intersection shader for shadow rays
+    VkRayTracingShaderGroupCreateInfoKHR sphereHitGroupCI {};
+    sphereHitGroupCI.sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
+    sphereHitGroupCI.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_PROCEDURAL_HIT_GROUP_KHR;
+    sphereHitGroupCI.generalShader = VK_SHADER_UNUSED_KHR;
+    sphereHitGroupCI.closestHitShader = shaderIndexSphereClosestHit;
+    sphereHitGroupCI.anyHitShader = VK_SHADER_UNUSED_KHR;
+    sphereHitGroupCI.intersectionShader = shaderIndexSphereIntersection;
+    _shaderGroups.push_back(sphereHitGroupCI); // HIT_GROUP_SPHERES
+
+    sphereHitGroupCI.closestHitShader = shaderIndexShadowClosestHit;
+    _shaderGroups.push_back(sphereHitGroupCI);
+
     VkRayTracingPipelineCreateInfoKHR pipelineInfo {};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR;
     pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
@@ -1032,7 +1250,7 @@ void Application::createDescriptorPool()
 
     VkDescriptorPoolSize storageImageDescriptorPoolSize {};
     storageImageDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-    storageImageDescriptorPoolSize.descriptorCount = _swapchainImages.size();
+    storageImageDescriptorPoolSize.descriptorCount = _swapchainImages.size() * (2 + GBUFFER_IMAGE_COUNT); // + sampling priorities
 
     VkDescriptorPoolSize VertexBufferDescriptorPoolSize {};
     VertexBufferDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
@@ -1042,9 +1260,29 @@ void Application::createDescriptorPool()
     IndexBufferDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     IndexBufferDescriptorPoolSize.descriptorCount = _swapchainImages.size();
 
+    VkDescriptorPoolSize PositionBufferDescriptorPoolSize {};
+    PositionBufferDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    PositionBufferDescriptorPoolSize.descriptorCount = _swapchainImages.size();
+
+    VkDescriptorPoolSize EnvironmentBufferDescriptorPoolSize {};
+    EnvironmentBufferDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    EnvironmentBufferDescriptorPoolSize.descriptorCount = _swapchainImages.size();
+
+    VkDescriptorPoolSize SphereBufferDescriptorPoolSize {};
+    SphereBufferDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    SphereBufferDescriptorPoolSize.descriptorCount = _swapchainImages.size();
+
+    VkDescriptorPoolSize InstanceBufferDescriptorPoolSize {};
+    InstanceBufferDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    InstanceBufferDescriptorPoolSize.descriptorCount = _swapchainImages.size();
+
+    VkDescriptorPoolSize PrioritySumDescriptorPoolSize {};
+    PrioritySumDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    PrioritySumDescriptorPoolSize.descriptorCount = _swapchainImages.size();
+
     VkDescriptorPoolSize ImagesDescriptorPoolSize {};
     ImagesDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    ImagesDescriptorPoolSize.descriptorCount = _model->_textures.size() + _textures.size();
+    ImagesDescriptorPoolSize.descriptorCount = _model->_textures.size() + _textures.size() + 2; // + environment and irradiance cubemaps
 
     VkDescriptorPoolSize matDescriptorPoolSize {};
     matDescriptorPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -1060,6 +1298,11 @@ void Application::createDescriptorPool()
         storageImageDescriptorPoolSize,
         VertexBufferDescriptorPoolSize,
         IndexBufferDescriptorPoolSize,
+        PositionBufferDescriptorPoolSize,
+        EnvironmentBufferDescriptorPoolSize,
+        SphereBufferDescriptorPoolSize,
+        InstanceBufferDescriptorPoolSize,
+        PrioritySumDescriptorPoolSize,
         ImagesDescriptorPoolSize,
         matDescriptorPoolSize,
         lightsDescriptorPoolSize
@@ -1094,7 +1337,7 @@ void Application::createDescriptorSets()
     for (size_t i = 0; i < _swapchainImages.size(); i++) {
 
         std::vector<VkWriteDescriptorSet> descriptorWrites;
-        descriptorWrites.resize(7);
+        descriptorWrites.resize(GBUFFER_FIRST_BINDING + GBUFFER_IMAGE_COUNT + 2);
 
         // ubo
         VkDescriptorBufferInfo bufferInfo {};
@@ -1206,6 +1449,115 @@ void Application::createDescriptorSets()
         descriptorWrites[6].pImageInfo = nullptr;
         descriptorWrites[6].pTexelBufferView = nullptr;
 
+        // Position buffer, for the world space size of the hit triangles
+        VkDescriptorBufferInfo positionBufferDescriptor {};
+        positionBufferDescriptor.buffer = _model->_positions.buffer;
+        positionBufferDescriptor.range = VK_WHOLE_SIZE;
+
+        descriptorWrites[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[7].dstSet = _descriptorSets[i];
+        descriptorWrites[7].dstBinding = 7;
+        descriptorWrites[7].dstArrayElement = 0;
+        descriptorWrites[7].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[7].descriptorCount = 1;
+        descriptorWrites[7].pBufferInfo = &positionBufferDescriptor;
+        descriptorWrites[7].pImageInfo = nullptr;
+        descriptorWrites[7].pTexelBufferView = nullptr;
+
+        // Environment map distribution, for importance sampling
+        VkDescriptorBufferInfo environmentBufferDescriptor {};
+        environmentBufferDescriptor.buffer = _environmentMap->getDistributionBuffer();
+        environmentBufferDescriptor.range = VK_WHOLE_SIZE;
+
+        descriptorWrites[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[8].dstSet = _descriptorSets[i];
+        descriptorWrites[8].dstBinding = 8;
+        descriptorWrites[8].dstArrayElement = 0;
+        descriptorWrites[8].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[8].descriptorCount = 1;
+        descriptorWrites[8].pBufferInfo = &environmentBufferDescriptor;
+        descriptorWrites[8].pImageInfo = nullptr;
+        descriptorWrites[8].pTexelBufferView = nullptr;
+
+        // Analytic spheres, for the intersection and sphere hit shaders
+        VkDescriptorBufferInfo sphereBufferDescriptor {};
+        sphereBufferDescriptor.buffer = _model->_sphereBuffer.buffer;
+        sphereBufferDescriptor.range = VK_WHOLE_SIZE;
+
+        descriptorWrites[9].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[9].dstSet = _descriptorSets[i];
+        descriptorWrites[9].dstBinding = 9;
+        descriptorWrites[9].dstArrayElement = 0;
+        descriptorWrites[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[9].descriptorCount = 1;
+        descriptorWrites[9].pBufferInfo = &sphereBufferDescriptor;
+        descriptorWrites[9].pImageInfo = nullptr;
+        descriptorWrites[9].pTexelBufferView = nullptr;
+
+        // First triangle of every TLAS instance, rewritten by the raytracing handler when a level changes
+        VkDescriptorBufferInfo instanceBufferDescriptor {};
+        instanceBufferDescriptor.buffer = _rtHandler._instanceTrianglesBuffers[i].buffer;
+        instanceBufferDescriptor.range = VK_WHOLE_SIZE;
+
+        descriptorWrites[10].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[10].dstSet = _descriptorSets[i];
+        descriptorWrites[10].dstBinding = 10;
+        descriptorWrites[10].dstArrayElement = 0;
+        descriptorWrites[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[10].descriptorCount = 1;
+        descriptorWrites[10].pBufferInfo = &instanceBufferDescriptor;
+        descriptorWrites[10].pImageInfo = nullptr;
+        descriptorWrites[10].pTexelBufferView = nullptr;
+
+        // G-buffer images
+        std::array<VkDescriptorImageInfo, GBUFFER_IMAGE_COUNT> gBufferDescriptors {};
+        for (uint32_t j = 0; j < GBUFFER_IMAGE_COUNT; j++) {
+            gBufferDescriptors[j].imageView = _gBuffers[i][j].view;
+            gBufferDescriptors[j].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            VkWriteDescriptorSet& gBufferWrite = descriptorWrites[GBUFFER_FIRST_BINDING + j];
+            gBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            gBufferWrite.dstSet = _descriptorSets[i];
+            gBufferWrite.dstBinding = GBUFFER_FIRST_BINDING + j;
+            gBufferWrite.dstArrayElement = 0;
+            gBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            gBufferWrite.descriptorCount = 1;
+            gBufferWrite.pBufferInfo = nullptr;
+            gBufferWrite.pImageInfo = &gBufferDescriptors[j];
+            gBufferWrite.pTexelBufferView = nullptr;
+        }
+
+        // Sampling priorities, shared by all the sets
+        VkDescriptorImageInfo samplePrioritiesDescriptor {};
+        samplePrioritiesDescriptor.imageView = _samplePriorities.view;
+        samplePrioritiesDescriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet& samplePrioritiesWrite = descriptorWrites[GBUFFER_FIRST_BINDING + GBUFFER_IMAGE_COUNT];
+        samplePrioritiesWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        samplePrioritiesWrite.dstSet = _descriptorSets[i];
+        samplePrioritiesWrite.dstBinding = GBUFFER_FIRST_BINDING + GBUFFER_IMAGE_COUNT;
+        samplePrioritiesWrite.dstArrayElement = 0;
+        samplePrioritiesWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        samplePrioritiesWrite.descriptorCount = 1;
+        samplePrioritiesWrite.pBufferInfo = nullptr;
+        samplePrioritiesWrite.pImageInfo = &samplePrioritiesDescriptor;
+        samplePrioritiesWrite.pTexelBufferView = nullptr;
+
+        VkDescriptorBufferInfo prioritySumDescriptor {};
+        prioritySumDescriptor.buffer = _prioritySum.buffer;
+        prioritySumDescriptor.range = VK_WHOLE_SIZE;
+
+        VkWriteDescriptorSet& prioritySumWrite = descriptorWrites[GBUFFER_FIRST_BINDING + GBUFFER_IMAGE_COUNT + 1];
+        prioritySumWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        prioritySumWrite.dstSet = _descriptorSets[i];
+        prioritySumWrite.dstBinding = GBUFFER_FIRST_BINDING + GBUFFER_IMAGE_COUNT + 1;
+        prioritySumWrite.dstArrayElement = 0;
+        prioritySumWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        prioritySumWrite.descriptorCount = 1;
+        prioritySumWrite.pBufferInfo = &prioritySumDescriptor;
+        prioritySumWrite.pImageInfo = nullptr;
+        prioritySumWrite.pTexelBufferView = nullptr;
+
         vkUpdateDescriptorSets(_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
     }
 
@@ -1220,11 +1572,11 @@ void Application::createDescriptorSets()
     std::vector<VkDescriptorImageInfo> imageInfos;
 
     for (size_t j = 0; j < _textures.size(); j++) {
-        imageInfos.push_back(*_textures[j].getDescriptorSet(_modelTexturesDescriptorSet, 0).pImageInfo);
+        imageInfos.push_back(*_textures[j]->getDescriptorSet(_modelTexturesDescriptorSet, 0).pImageInfo);
     }
 
     for (size_t i = 0; i < _model->_textures.size(); i++) {
-        imageInfos.push_back(*_model->_textures[i].getDescriptorSet(_modelTexturesDescriptorSet, 0).pImageInfo);
+        imageInfos.push_back(*_model->_textures[i]->getDescriptorSet(_modelTexturesDescriptorSet, 0).pImageInfo);
     }
 
     VkWriteDescriptorSet descriptorSet {};
@@ -1238,7 +1590,13 @@ void Application::createDescriptorSets()
     descriptorSet.pBufferInfo = nullptr;
     descriptorSet.pTexelBufferView = nullptr;
 
-    vkUpdateDescriptorSets(_device, 1, &descriptorSet, 0, nullptr);
+    std::array<VkWriteDescriptorSet, 3> textureWrites = {
+        descriptorSet,
+        _environmentMap->getCubemap()->getDescriptorSet(_modelTexturesDescriptorSet, 1),
+        _environmentMap->getIrradiance()->getDescriptorSet(_modelTexturesDescriptorSet, 2)
+    };
+
+    vkUpdateDescriptorSets(_device, static_cast<uint32_t>(textureWrites.size()), textureWrites.data(), 0, nullptr);
 }
 
 void Application::createCommandBuffers()
@@ -1265,6 +1623,19 @@ void Application::createCommandBuffers()
             throw std::runtime_error("Failed to begin recording command buffer!");
         }
 
+        _profiler.begin(_commandBuffers[i], i);
+
+        _rtHandler.recordTopLevelBuild(_commandBuffers[i], i);
+
+        // The sampling priorities were written by the denoiser of the previous frame
+        if (USE_ADAPTIVE_SAMPLING) {
+            VkMemoryBarrier barrier {};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            vkCmdPipelineBarrier(_commandBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+
         vkCmdBindPipeline(_commandBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, _raycastPipeline);
         vkCmdBindDescriptorSets(_commandBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, _pipelineLayout, 1, 1, &_modelTexturesDescriptorSet, 0, nullptr);
         vkCmdBindDescriptorSets(_commandBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, _pipelineLayout, 0, 1, &_descriptorSets[i], 0, nullptr);
@@ -1301,27 +1672,42 @@ void Application::createCommandBuffers()
             _swapchainExtent.width,
             _swapchainExtent.height,
             1);
+        _profiler.endPass(_commandBuffers[i], i, 0);
+
+        if (USE_DENOISER) {
+            _denoiser.record(_commandBuffers[i], i, _profiler, 1);
+        }
 
         // Prepare current swap chain image as transfer destination
         transitionImageLayout(_commandBuffers[i], _swapchainImages[i], _swapchainImageFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
-        // Prepare ray tracing output image as transfer source
-        transitionImageLayout(_commandBuffers[i], _storageImages[i].image, _storageImages[i].format, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-
-        VkImageCopy copyRegion {};
-        copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
-        copyRegion.srcOffset = { 0, 0, 0 };
-        copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
-        copyRegion.dstOffset = { 0, 0, 0 };
-        copyRegion.extent = { _swapchainExtent.width, _swapchainExtent.height, 1 };
-        vkCmdCopyImage(_commandBuffers[i], _storageImages[i].image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _swapchainImages[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+        if (USE_DENOISER) {
+            // Half float result, the blit converts it to the swapchain format
+            VkImageBlit blitRegion {};
+            blitRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+            blitRegion.srcOffsets[1] = { static_cast<int32_t>(_swapchainExtent.width), static_cast<int32_t>(_swapchainExtent.height), 1 };
+            blitRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+            blitRegion.dstOffsets[1] = blitRegion.srcOffsets[1];
+            vkCmdBlitImage(_commandBuffers[i], _denoiser.getOutput(i), VK_IMAGE_LAYOUT_GENERAL, _swapchainImages[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blitRegion, VK_FILTER_NEAREST);
+        } else {
+            // Prepare ray tracing output image as transfer source
+            transitionImageLayout(_commandBuffers[i], _storageImages[i].image, _storageImages[i].format, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+            VkImageCopy copyRegion {};
+            copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+            copyRegion.srcOffset = { 0, 0, 0 };
+            copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+            copyRegion.dstOffset = { 0, 0, 0 };
+            copyRegion.extent = { _swapchainExtent.width, _swapchainExtent.height, 1 };
+            vkCmdCopyImage(_commandBuffers[i], _storageImages[i].image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _swapchainImages[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+
+            // Transition ray tracing output image back to general layout
+            transitionImageLayout(_commandBuffers[i], _storageImages[i].image, _storageImages[i].format, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+        }
 
         // Transition swap chain image back for presentation
         transitionImageLayout(_commandBuffers[i], _swapchainImages[i], _swapchainImageFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 
-        // Transition ray tracing output image back to general layout
-        transitionImageLayout(_commandBuffers[i], _storageImages[i].image, _storageImages[i].format, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
-
         //vkCmdEndRenderPass(_commandBuffers[i]);
 
         if (vkEndCommandBuffer(_commandBuffers[i]) != VK_SUCCESS) {
@@ -1330,6 +1716,30 @@ void Application::createCommandBuffers()
     }
 }
 
+void Application::createDenoiser()
+{
+    std::vector<std::string> passNames = { "Trace" };
+    if (USE_DENOISER) {
+        _denoiser.create();
+        const auto denoiserPasses = _denoiser.getPassNames();
+        passNames.insert(passNames.end(), denoiserPasses.begin(), denoiserPasses.end());
+    }
+
+    _profiler.create(_swapchainImages.size(), passNames);
+}
+
+void Application::recreateDenoiser()
+{
+    vkDeviceWaitIdle(_device);
+
+    vkFreeCommandBuffers(_device, _commandPool, static_cast<uint32_t>(_commandBuffers.size()), _commandBuffers.data());
+    _denoiser.destroy();
+    _profiler.destroy();
+
+    createDenoiser();
+    createCommandBuffers();
+}
+
 void Application::createSemaphores()
 {
     _imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
@@ -1351,6 +1761,142 @@ void Application::createSemaphores()
     }
 }
 
+void Application::trimHostMemory()
+{
+    // Geometry and images are on the GPU and the BLAS is built, drop everything that is not needed for CPU queries or rebuilds
+    _model->trim();
+    _textureCache.purge();
+    releaseFreedHostMemory();
+
+    if (_verbose > 0) {
+        std::cout << "Host memory after upload : " << getResidentMemory() / (1024 * 1024) << " MB resident, "
+                  << _model->getHostMemoryUsage() / 1024 << " KB of CPU-side scene data" << std::endl;
+        std::cout << "Texture cache : " << _textureCache.getMissCount() << " textures uploaded, " << _textureCache.getHitCount() << " shared" << std::endl;
+    }
+}
+
+void Application::exportFrame(uint32_t imageIndex)
+{
+    std::error_code error;
+    std::filesystem::create_directories(FRAME_EXPORT_PATH, error);
+    if (error) {
+        std::cerr << "Frame not exported, could not create " << FRAME_EXPORT_PATH << std::endl;
+        return;
+    }
+
+    // The frames of the previous sessions are kept, the numbering goes on after them
+    auto getPath = [](const std::string& name, uint32_t frame) {
+        std::string number = std::to_string(frame);
+        number.insert(0, number.size() < 4 ? 4 - number.size() : 0, '0');
+        return FRAME_EXPORT_PATH + "/" + name + "_" + number + ".pfm";
+    };
+    while (std::filesystem::exists(getPath("color", _nextExportedFrame))) {
+        _nextExportedFrame++;
+    }
+
+    const size_t pixelCount = static_cast<size_t>(_swapchainExtent.width) * _swapchainExtent.height;
+    std::vector<float> color(3 * pixelCount);
+    std::vector<float> albedo(3 * pixelCount);
+    std::vector<float> normal(3 * pixelCount);
+    std::vector<float> position(3 * pixelCount);
+
+    // Half floats once the soft shadows are composited, else the 8 bit swapchain format the ray generation writes
+    const StorageImage& traced = _denoiser.getTracedImage(imageIndex);
+    if (traced.format == VK_FORMAT_R16G16B16A16_SFLOAT) {
+        const std::vector<unsigned char> pixels = readStorageImage(traced, 4 * sizeof(uint16_t));
+        const uint16_t* halves = reinterpret_cast<const uint16_t*>(pixels.data());
+        for (size_t p = 0; p < pixelCount; p++) {
+            for (size_t c = 0; c < 3; c++) {
+                color[3 * p + c] = halfToFloat(halves[4 * p + c]);
+            }
+        }
+    } else {
+        const bool bgra = traced.format == VK_FORMAT_B8G8R8A8_UNORM;
+        const std::vector<unsigned char> pixels = readStorageImage(traced, 4);
+        for (size_t p = 0; p < pixelCount; p++) {
+            for (size_t c = 0; c < 3; c++) {
+                color[3 * p + c] = pixels[4 * p + (bgra ? 2 - c : c)] / 255.f;
+            }
+        }
+    }
+
+    const std::vector<unsigned char> albedos = readStorageImage(_gBuffers[imageIndex][GBUFFER_ALBEDO], 4);
+    const std::vector<unsigned char> normals = readStorageImage(_gBuffers[imageIndex][GBUFFER_NORMAL], sizeof(uint32_t));
+    const std::vector<unsigned char> positions = readStorageImage(_gBuffers[imageIndex][GBUFFER_POSITION], sizeof(glm::vec4));
+    for (size_t p = 0; p < pixelCount; p++) {
+        uint32_t packedNormal;
+        glm::vec4 hit;
+        std::memcpy(&packedNormal, &normals[sizeof(uint32_t) * p], sizeof(packedNormal));
+        std::memcpy(&hit, &positions[sizeof(glm::vec4) * p], sizeof(hit));
+
+        // The sky is encoded as 0, which would decode to +z
+        const glm::vec3 n = hit.w != 0.f ? octahedralDecode(glm::unpackSnorm2x16(packedNormal)) : glm::vec3(0.f);
+        for (size_t c = 0; c < 3; c++) {
+            albedo[3 * p + c] = albedos[4 * p + c] / 255.f;
+            normal[3 * p + c] = n[c];
+            position[3 * p + c] = hit[c];
+        }
+    }
+
+    const std::array<std::pair<std::string, const std::vector<float>*>, 4> images = { {
+        { "color", &color },
+        { "albedo", &albedo },
+        { "normal", &normal },
+        { "position", &position },
+    } };
+    for (const auto& image : images) {
+        const std::string path = getPath(image.first, _nextExportedFrame);
+        if (!writePfm(path, image.second->data(), _swapchainExtent.width, _swapchainExtent.height, 3)) {
+            std::cerr << "Failed to write " << path << std::endl;
+            return;
+        }
+    }
+
+    std::cout << "Frame exported to " << getPath("*", _nextExportedFrame) << std::endl;
+    _nextExportedFrame++;
+}
+
+std::vector<unsigned char> Application::readStorageImage(const StorageImage& storageImage, size_t pixelSize)
+{
+    const VkDeviceSize size = static_cast<VkDeviceSize>(_swapchainExtent.width) * _swapchainExtent.height * pixelSize;
+    Buffer stagingBuffer;
+    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer.buffer, stagingBuffer.memory);
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+    // Written by the shaders of the frame
+    VkMemoryBarrier barrier {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    VkBufferImageCopy region {};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = { _swapchainExtent.width, _swapchainExtent.height, 1 };
+    vkCmdCopyImageToBuffer(commandBuffer, storageImage.image, VK_IMAGE_LAYOUT_GENERAL, stagingBuffer.buffer, 1, &region);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    endSingleTimeCommands(commandBuffer);
+
+    std::vector<unsigned char> pixels(size);
+    void* data;
+    vkMapMemory(_device, stagingBuffer.memory, 0, size, 0, &data);
+    memcpy(pixels.data(), data, pixels.size());
+    vkUnmapMemory(_device, stagingBuffer.memory);
+
+    vkDestroyBuffer(_device, stagingBuffer.buffer, nullptr);
+    vkFreeMemory(_device, stagingBuffer.memory, nullptr);
+
+    return pixels;
+}
+
 void Application::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
 {
     VkBufferCreateInfo bufferInfo {};
@@ -1385,7 +1931,7 @@ void Application::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMe
     vkBindBufferMemory(_device, buffer, bufferMemory, 0);
 }
 
-VkImageView Application::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkImageViewType viewType)
+VkImageView Application::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkImageViewType viewType, uint32_t mipLevels, uint32_t layerCount)
 {
     VkImageViewCreateInfo viewInfo {};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -1394,9 +1940,9 @@ VkImageView Application::createImageView(VkImage image, VkFormat format, VkImage
     viewInfo.format = format;
     viewInfo.subresourceRange.aspectMask = aspectFlags;
     viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.levelCount = mipLevels;
     viewInfo.subresourceRange.baseArrayLayer = 0;
-    viewInfo.subresourceRange.layerCount = 1;
+    viewInfo.subresourceRange.layerCount = layerCount;
 
     VkImageView imageView;
     if (vkCreateImageView(_device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
@@ -1406,6 +1952,30 @@ VkImageView Application::createImageView(VkImage image, VkFormat format, VkImage
     return imageView;
 }
 
+void Application::createDeviceLocalBuffer(const void* src, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+{
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+    void* data;
+    vkMapMemory(_device, stagingBufferMemory, 0, size, NULL, &data);
+    memcpy(data, src, static_cast<size_t>(size));
+    vkUnmapMemory(_device, stagingBufferMemory);
+
+    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, bufferMemory);
+
+    copyBuffer(stagingBuffer, buffer, size);
+
+    vkDestroyBuffer(_device, stagingBuffer, nullptr);
+    vkFreeMemory(_device, stagingBufferMemory, nullptr);
+}
+
+void Application::createDeviceLocalBuffer(const void* src, VkDeviceSize size, VkBufferUsageFlags usage, Buffer& buffer)
+{
+    createDeviceLocalBuffer(src, size, usage, buffer.buffer, buffer.memory);
+}
+
 void Application::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
 {
     VkCommandBuffer commandBuffer = beginSingleTimeCommands();
@@ -1419,7 +1989,7 @@ void Application::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSiz
     endSingleTimeCommands(commandBuffer);
 }
 
-void Application::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory)
+void Application::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, uint32_t mipLevels, uint32_t arrayLayers, VkImageCreateFlags flags)
 {
     VkImageCreateInfo imageInfo {};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1427,8 +1997,9 @@ void Application::createImage(uint32_t width, uint32_t height, VkFormat format,
     imageInfo.extent.width = width;
     imageInfo.extent.height = height;
     imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
-    imageInfo.arrayLayers = 1;
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = arrayLayers;
+    imageInfo.flags = flags;
     imageInfo.format = format;
     imageInfo.tiling = tiling;
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -1457,7 +2028,7 @@ void Application::createImage(uint32_t width, uint32_t height, VkFormat format,
     }
 }
 
-void Application::transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
+void Application::transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels, uint32_t layerCount)
 {
     bool isSingleCommandBuffer = false;
     if (!commandBuffer) {
@@ -1474,9 +2045,9 @@ void Application::transitionImageLayout(VkCommandBuffer commandBuffer, VkImage i
     barrier.image = image;
     barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.levelCount = mipLevels;
     barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
+    barrier.subresourceRange.layerCount = layerCount;
 
     // Source layouts (old)
     // Source access mask controls actions that have to be finished on the old layout
@@ -1603,6 +2174,15 @@ void Application::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t wid
     endSingleTimeCommands(commandBuffer);
 }
 
+void Application::copyBufferToImage(VkBuffer buffer, VkImage image, const std::vector<VkBufferImageCopy>& regions)
+{
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+    vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+    endSingleTimeCommands(commandBuffer);
+}
+
 void Application::recreateSwapchain()
 {
     int width = 0, height = 0;
@@ -1616,12 +2196,7 @@ void Application::recreateSwapchain()
     vkDeviceWaitIdle(_device);
     cleanupSwapchain();
 
-    // destroy storage images
-    for (auto storageImage : _storageImages) {
-        vkDestroyImageView(_device, storageImage.view, nullptr);
-        vkDestroyImage(_device, storageImage.image, nullptr);
-        vkFreeMemory(_device, storageImage.memory, nullptr);
-    }
+    destroyStorageImages();
 
     createSwapchain();
 
@@ -1632,6 +2207,7 @@ void Application::recreateSwapchain()
     createUniformBuffers();
     createDescriptorPool();
     createDescriptorSets();
+    createDenoiser();
     createCommandBuffers();
 }
 
@@ -1647,7 +2223,25 @@ void Application::updateUniformBuffer(uint32_t currentImage)
     ubo.invProj = glm::perspective(glm::radians(80.f), _swapchainExtent.width / (float)_swapchainExtent.height, 0.1f, 200.f);
     ubo.invProj[1][1] *= -1;
     ubo.invProj = glm::inverse(ubo.invProj);
-    ubo.vertexSize = sizeof(Vertex);
+
+    // The first frame has no history, it reprojects onto itself
+    if (_frameIndex == 0) {
+        _previousInvView = ubo.invView;
+        _previousInvProj = ubo.invProj;
+    }
+    ubo.prevInvView = _previousInvView;
+    ubo.prevInvProj = _previousInvProj;
+    ubo.prevViewProj = glm::inverse(_previousInvProj) * glm::inverse(_previousInvView);
+    _previousInvView = ubo.invView;
+    _previousInvProj = ubo.invProj;
+    ubo.vertexSize = sizeof(PackedVertex);
+    ubo.frameIndex = _frameIndex++;
+    ubo.useIrradianceSH = USE_IRRADIANCE_SH;
+    ubo.useSoftShadows = USE_SOFT_SHADOWS;
+    ubo.lightRadius = AREA_LIGHT_RADIUS;
+    ubo.maxExtraPaths = USE_ADAPTIVE_SAMPLING ? ADAPTIVE_MAX_EXTRA_PATHS : 0;
+    ubo.extraPathBudget = ADAPTIVE_PATH_BUDGET;
+    std::copy(_environmentMap->getIrradianceSH().begin(), _environmentMap->getIrradianceSH().end(), ubo.irradianceSH);
 
     void* data;
     vkMapMemory(_device, _uniforms[currentImage].memory, 0, sizeof(ubo), NULL, &data);
@@ -1690,6 +2284,11 @@ void Application::cleanupSwapchain()
     vkDestroyPipeline(_device, _raycastPipeline, nullptr);
     vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
 
+    if (USE_DENOISER) {
+        _denoiser.destroy();
+    }
+    _profiler.destroy();
+
     vkDestroySwapchainKHR(_device, _swapchain, nullptr);
 }
 
@@ -3,8 +3,12 @@
 #include "Utils.hpp"
 #include "Character.hpp"
 #include "TextureModule.hpp"
+#include "TextureCache.hpp"
+#include "EnvironmentMap.hpp"
 #include "gltfLoader.hpp"
 #include "RaytracingHandler.hpp"
+#include "Denoiser.hpp"
+#include "GpuProfiler.hpp"
 
 #include <cstdlib>
 #include <iostream>
@@ -22,8 +26,62 @@ constexpr uint32_t WINDOW_HEIGHT = 600;
 constexpr size_t MAX_FRAMES_IN_FLIGHT = 6; // How many frame are always generated (determines the swapchain size)
 
 constexpr bool USE_RANDOM_SCENE = true;
+constexpr uint32_t RANDOM_SCENE_SCALE = 30; // Roughly the number of spheres and of boxes, raise it for stress scenes
+constexpr uint32_t RANDOM_SCENE_SEED = -1; // Same scene for a given seed, -1 to seed from the time
+constexpr bool USE_MESH_INSTANCING = true; // Random scene boxes (and tessellated spheres) as TLAS instances of a single base mesh
+constexpr bool USE_PROCEDURAL_SPHERES = true; // Random scene spheres as analytic ellipsoids instead of tessellated icosahedrons
+constexpr bool USE_SPATIAL_ORDER = true; // Triangles of each primitive sorted along a Morton curve, vertices renumbered by first use
+constexpr bool USE_MESH_LODS = true; // Simplified levels of each mesh, one BLAS per level picked from the distance to the character
+constexpr size_t MAX_LOD_LEVELS = 4; // Including the original mesh
+constexpr size_t MIN_LOD_TRIANGLES = 256; // Meshes are not simplified below this
+constexpr float LOD_PROJECTED_SIZE = 0.1f; // Bounding radius over distance under which a mesh uses its next level
 const std::string MODEL_PATH = "../../assets/models/ironman/scene.gltf";
 const std::string SKYDOME_PATH = "../../assets/textures/colorful_studio_2k.hdr";
+constexpr bool USE_IRRADIANCE_SH = true; // Ambient lighting from spherical harmonics instead of the irradiance cubemap
+// First hit group of each geometry type in the shader binding table, shadow rays use the next one
+constexpr uint32_t HIT_GROUP_TRIANGLES = 0;
+constexpr uint32_t HIT_GROUP_SPHERES = 2;
+constexpr uint32_t GBUFFER_FIRST_BINDING = 11; // Normal, depth, albedo, material, motion, illumination, position and visibility images of the raytracing set
+// The sampling priorities and their sum follow the G-buffer images
+constexpr uint32_t NO_MATERIAL_OVERRIDE = 0xFFFFFF; // Instance custom index of the instances using the material of their vertices
+enum class DenoiserType {
+    Atrous, // A-trous filter of the traced color, after the temporal accumulation if enabled
+    Svgf, // Spatiotemporal variance-guided filtering of the direct and indirect illumination, divided by the albedo
+    Bmfr, // Blockwise multi-order feature regression of the illumination, between two temporal accumulations if enabled
+};
+
+constexpr bool USE_DENOISER = true; // Filtering of the traced image before presentation
+constexpr DenoiserType DENOISER_TYPE = DenoiserType::Svgf; // At startup, DENOISER_SWITCH_KEY cycles through the types
+constexpr int DENOISER_SWITCH_KEY = GLFW_KEY_N;
+constexpr size_t ATROUS_ITERATIONS = 5; // Step sizes from 1 to 2^(iterations - 1) pixels
+constexpr float ATROUS_COLOR_PHI = 4.f; // Luminance difference tolerated by the first iteration, halved by every following one
+constexpr float ATROUS_NORMAL_PHI = 64.f; // Exponent of the cosine between normals
+constexpr float ATROUS_DEPTH_PHI = 0.05f; // Relative depth difference tolerated per pixel of distance
+static_assert(ATROUS_ITERATIONS > 0, "The denoiser needs at least one iteration");
+constexpr bool USE_TEMPORAL_ACCUMULATION = true; // Reprojected history of the previous frames blended in before the spatial filter
+constexpr float TEMPORAL_COLOR_ALPHA = 0.2f; // Weight of the current frame in the moving average
+constexpr float TEMPORAL_MOMENTS_ALPHA = 0.2f;
+constexpr float TEMPORAL_DEPTH_TOLERANCE = 0.1f; // Relative depth difference over which the history is rejected
+constexpr float TEMPORAL_NORMAL_TOLERANCE = 0.9f; // Cosine between normals under which the history is rejected
+constexpr float TEMPORAL_MAX_HISTORY = 32.f; // Frames counted in the history length
+constexpr float SVGF_LUMINANCE_PHI = 4.f; // Luminance difference tolerated by the SVGF iterations, in standard deviations
+constexpr float SVGF_MIN_HISTORY = 4.f; // History length under which the variance is estimated from the neighbors
+constexpr uint32_t BMFR_BLOCK_SIZE = 32; // Pixels of a side of the fitted blocks, BLOCK_SIZE in bmfr.comp
+constexpr float BMFR_REGULARIZATION = 1e-3f; // Added to the diagonal of the normal equations, relative to it
+static_assert(DENOISER_TYPE != DenoiserType::Svgf || USE_TEMPORAL_ACCUMULATION, "SVGF needs the temporal accumulation");
+constexpr bool USE_SOFT_SHADOWS = true; // Disk lights sampled by one shadow ray per pixel, filtered by the denoiser, instead of a hard shadow ray per light
+constexpr float AREA_LIGHT_RADIUS = 1.f; // Radius of the disk lights
+constexpr float SHADOW_MAX_RADIUS = 16.f; // Largest penumbra filtered, in pixels
+static_assert(!USE_SOFT_SHADOWS || USE_DENOISER, "The soft shadows are filtered by the denoiser");
+constexpr bool USE_ADAPTIVE_SAMPLING = true; // Extra paths for the pixels the previous frames found noisy, within a budget
+constexpr uint32_t ADAPTIVE_MAX_EXTRA_PATHS = 4; // Per pixel and frame
+constexpr float ADAPTIVE_PATH_BUDGET = 0.5f; // Extra paths per frame, per pixel of the image on average
+constexpr float ADAPTIVE_MIN_HISTORY = 4.f; // History length under which a pixel gets the largest priority
+constexpr float ADAPTIVE_LUMINANCE_EPSILON = 0.05f; // Added to the luminance the standard error is relative to
+static_assert(!USE_ADAPTIVE_SAMPLING || (USE_DENOISER && USE_TEMPORAL_ACCUMULATION), "The sampling priorities come from the temporal moments of the denoiser");
+const std::string TEXTURE_CACHE_PATH = "../../assets/cache/textures"; // Decoded textures shared between sessions, empty to disable
+constexpr int FRAME_EXPORT_KEY = GLFW_KEY_F12; // Writes the traced color and the features of the next frame, the training data of the U-Net
+const std::string FRAME_EXPORT_PATH = "../../assets/frames"; // color_####.pfm, albedo_####.pfm, normal_####.pfm and position_####.pfm
 
 const std::vector<const char*> deviceExtensions = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME,
@@ -62,6 +120,12 @@ public:
 
     void setFrameBufferResize();
 
+    // Next denoiser type, applied before the next frame
+    void switchDenoiser();
+
+    // The next frame is read back and written to FRAME_EXPORT_PATH once rendered
+    void requestFrameExport();
+
     Character& getCharacter();
 
 private:
@@ -93,6 +157,10 @@ private:
 
     void createStorageImage();
 
+    void createStorageImage(StorageImage& storageImage, VkFormat format, VkImageUsageFlags usage);
+
+    void destroyStorageImages();
+
     void createShaderBindingTable();
 
     void createDescriptorSetLayout();
@@ -115,18 +183,38 @@ private:
 
     void createSemaphores();
 
+    void createDenoiser();
+
+    // After a switch, the command buffers record the passes of the new type
+    void recreateDenoiser();
+
+    void trimHostMemory();
+
+    // Color the denoisers take, albedo, decoded world normal and world position of a rendered swapchain image, as PFM files
+    // numbered after the ones already in FRAME_EXPORT_PATH
+    void exportFrame(uint32_t imageIndex);
+
+    // Copy of a storage image in the general layout, pixelSize bytes per pixel, top row first
+    std::vector<unsigned char> readStorageImage(const StorageImage& storageImage, size_t pixelSize);
+
     void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
 
-    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D);
+    // Uploads src through a staging buffer
+    void createDeviceLocalBuffer(const void* src, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+    void createDeviceLocalBuffer(const void* src, VkDeviceSize size, VkBufferUsageFlags usage, Buffer& buffer);
+
+    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D, uint32_t mipLevels = 1, uint32_t layerCount = 1);
 
     void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 
-    void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
+    void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, uint32_t mipLevels = 1, uint32_t arrayLayers = 1, VkImageCreateFlags flags = 0);
 
-    void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
+    void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels = 1, uint32_t layerCount = 1);
 
     void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
 
+    void copyBufferToImage(VkBuffer buffer, VkImage image, const std::vector<VkBufferImageCopy>& regions);
+
     void recreateSwapchain();
 
     void updateUniformBuffer(uint32_t currentImage);
@@ -168,10 +256,14 @@ private:
     VkDevice _device;
 
     Character _character;
-    std::vector<TextureModule> _textures;
+    TextureCache _textureCache { *this };
+    std::vector<std::shared_ptr<TextureModule>> _textures;
     std::vector<SamplerModule> _samplers;
+    std::unique_ptr<EnvironmentMap> _environmentMap;
     std::unique_ptr<GltfLoader> _model;
     RaytracingHandler _rtHandler { *this };
+    Denoiser _denoiser { *this };
+    GpuProfiler _profiler { *this };
 
     VkQueue _graphicsQueue;
     VkQueue _presentQueue;
@@ -185,14 +277,28 @@ private:
     VkPipelineLayout _pipelineLayout;
     VkPipeline _raycastPipeline;
 
-    struct StorageImage {
-        VkDeviceMemory memory;
-        VkImage image;
-        VkImageView view;
-        VkFormat format;
+    std::vector<StorageImage> _storageImages;
+
+    // First hit features of every pixel, written by the ray generation shader for the denoisers
+    enum GBufferImage {
+        GBUFFER_NORMAL, // Octahedral world normal
+        GBUFFER_DEPTH, // Linear view depth, 0 for the sky
+        GBUFFER_ALBEDO,
+        GBUFFER_MATERIAL, // Material index, 0xFFFF for the sky
+        GBUFFER_MOTION, // Offset in pixels to the same surface in the previous frame
+        GBUFFER_DIRECT, // Direct illumination divided by the albedo, filtered apart from the indirect one by SVGF
+        GBUFFER_INDIRECT,
+        GBUFFER_POSITION, // World position, w is 0 for the sky
+        GBUFFER_VISIBILITY, // Soft shadow ray of the first hit : visibility, (1 - visibility) times the blocker distance, distance to the light
+        GBUFFER_IMAGE_COUNT
     };
+    std::vector<std::array<StorageImage, GBUFFER_IMAGE_COUNT>> _gBuffers;
+
+    // Sampling priority of every pixel with its number of paths, and the sum of the priorities
+    // Written by the denoiser, then read by the ray generation shader of the next frame, shared by all the command buffers
+    StorageImage _samplePriorities;
+    Buffer _prioritySum;
 
-    std::vector<StorageImage> _storageImages;
     std::vector<Buffer> _materialBuffers;
 
     std::vector<Buffer> _lightsBuffer;
@@ -216,9 +322,9 @@ private:
     std::vector<VkSemaphore> _renderFinishedSemaphores;
     std::vector<VkFence> _inFlightFences;
     size_t _currentFrame = 0;
-
-    std::vector<Vertex> _vertices;
-    std::vector<uint32_t> _indices;
+    uint32_t _frameIndex = 0; // Frames rendered since the start, unlike _currentFrame it never wraps
+    glm::mat4 _previousInvView { 1.f };
+    glm::mat4 _previousInvProj { 1.f };
 
     //VkBuffer _vertexBuffer;
     //VkDeviceMemory _vertexBufferMemory;
@@ -234,6 +340,12 @@ private:
 
     bool _framebufferResized = false;
 
+    DenoiserType _denoiserType = DENOISER_TYPE;
+    bool _denoiserChanged = false;
+
+    bool _frameExportRequested = false;
+    uint32_t _nextExportedFrame = 0;
+
     VkCommandPool _commandPool;
     std::vector<VkCommandBuffer> _commandBuffers;
 
@@ -248,6 +360,11 @@ private:
 
     friend class TextureModule;
     friend class SamplerModule;
+    friend class EnvironmentMap;
     friend class GltfLoader;
+    friend class ObjLoader;
+    friend class TextureCache;
     friend class RaytracingHandler;
+    friend class Denoiser;
+    friend class GpuProfiler;
 };
\ No newline at end of file
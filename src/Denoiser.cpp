@@ -0,0 +1,829 @@
+#include "Application.hpp"
+#include "Denoiser.hpp"
+#include "GpuProfiler.hpp"
+#include "ShaderModule.hpp"
+
+#include <cstring>
+
+namespace {
+
+struct TemporalParameters {
+    float colorAlpha;
+    float momentsAlpha;
+    float depthTolerance;
+    float normalTolerance;
+    float maxHistoryLength;
+};
+
+// Also the parameters of the SVGF iterations, with colorPhi in standard deviations of the luminance
+struct AtrousParameters {
+    int stepSize;
+    float colorPhi;
+    float normalPhi;
+    float depthPhi;
+};
+
+struct VarianceParameters {
+    float normalPhi;
+    float depthPhi;
+    float luminancePhi;
+    float minHistoryLength;
+};
+
+struct BmfrParameters {
+    float regularization;
+};
+
+struct ShadowFilterParameters {
+    float maxRadius;
+    float normalPhi;
+    float depthPhi;
+};
+
+struct SampleMapParameters {
+    int nbSignals;
+    float minHistoryLength;
+    float luminanceEpsilon;
+};
+
+constexpr uint32_t MAX_PASS_BINDINGS = 10;
+
+}
+
+Denoiser::Denoiser(Application& app)
+    : _app(app)
+{
+}
+
+Denoiser::~Denoiser()
+{
+}
+
+void Denoiser::create()
+{
+    const DenoiserType type = _app._denoiserType;
+    _nbSignals = type == DenoiserType::Atrous ? 1 : 2;
+    if (USE_SOFT_SHADOWS) {
+        _shadowSignal = _nbSignals++;
+    }
+
+    // Only read with texelFetch, the filtering does not matter
+    VkSamplerCreateInfo samplerInfo {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+
+    if (vkCreateSampler(_app._device, &samplerInfo, nullptr, &_sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create the denoiser sampler!");
+    }
+
+    const VkImageUsageFlags usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+    _filterImages.resize(_app._swapchainImages.size());
+    for (auto& signals : _filterImages) {
+        signals.resize(_nbSignals);
+        for (auto& images : signals) {
+            for (auto& image : images) {
+                image = createImage(VK_FORMAT_R16G16B16A16_SFLOAT, usage);
+            }
+        }
+    }
+
+    if (USE_TEMPORAL_ACCUMULATION) {
+        _accumulated.resize(_app._swapchainImages.size());
+        for (auto& signals : _accumulated) {
+            signals.resize(_nbSignals);
+            for (auto& accumulated : signals) {
+                accumulated.color = createImage(VK_FORMAT_R16G16B16A16_SFLOAT, usage);
+                accumulated.moments = createImage(VK_FORMAT_R16G16B16A16_SFLOAT, usage);
+            }
+        }
+        createHistory();
+    }
+
+    // The inputs that may come from the traced image are sampled, so images of different formats can share the binding
+    if (USE_TEMPORAL_ACCUMULATION) {
+        createComputePass(_temporalPass, "shaders/temporal.comp.spv",
+            {
+                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // Traced color
+                VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Motion
+                VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Depth
+                VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Normal
+                VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Previous depth
+                VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Previous normal
+                VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // History color
+                VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // History moments
+                VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Accumulated color
+                VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Accumulated moments
+            },
+            sizeof(TemporalParameters));
+    }
+
+    if (USE_SOFT_SHADOWS) {
+        createShadowSteps();
+    }
+
+    if (type == DenoiserType::Svgf) {
+        createSvgfSteps();
+    } else if (type == DenoiserType::Bmfr) {
+        createBmfrSteps();
+    } else {
+        createAtrousSteps();
+    }
+
+    if (USE_ADAPTIVE_SAMPLING) {
+        createSampleMapSteps();
+    }
+
+    createDescriptorSets();
+}
+
+void Denoiser::destroy()
+{
+    vkDestroyDescriptorPool(_app._device, _descriptorPool, nullptr);
+    destroyComputePass(_temporalPass);
+    destroyComputePass(_atrousPass);
+    destroyComputePass(_variancePass);
+    destroyComputePass(_svgfAtrousPass);
+    destroyComputePass(_modulatePass);
+    destroyComputePass(_bmfrPass);
+    destroyComputePass(_shadowFilterPass);
+    destroyComputePass(_shadowCompositePass);
+    destroyComputePass(_sampleMapPass);
+    vkDestroySampler(_app._device, _sampler, nullptr);
+
+    for (const auto& image : _images) {
+        vkDestroyImageView(_app._device, image.view, nullptr);
+        vkDestroyImage(_app._device, image.image, nullptr);
+        vkFreeMemory(_app._device, image.memory, nullptr);
+    }
+
+    _images.clear();
+    _steps.clear();
+    _filterImages.clear();
+    _accumulated.clear();
+    _history.clear();
+    _shadowedColor.clear();
+    _outputs.clear();
+}
+
+StorageImage Denoiser::createImage(VkFormat format, VkImageUsageFlags usage)
+{
+    StorageImage image;
+    _app.createStorageImage(image, format, usage);
+    _images.push_back(image);
+    return image;
+}
+
+void Denoiser::createHistory()
+{
+    const VkImageUsageFlags usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+    _history.resize(_nbSignals);
+    for (auto& history : _history) {
+        history.color = createImage(VK_FORMAT_R16G16B16A16_SFLOAT, usage);
+        history.moments = createImage(VK_FORMAT_R16G16B16A16_SFLOAT, usage);
+    }
+    _previousDepth = createImage(_app._gBuffers[0][Application::GBUFFER_DEPTH].format, usage);
+    _previousNormal = createImage(_app._gBuffers[0][Application::GBUFFER_NORMAL].format, usage);
+
+    // A zero depth is the sky, so the first frame finds no history to reproject
+    VkCommandBuffer commandBuffer = _app.beginSingleTimeCommands();
+
+    const VkClearColorValue zero {};
+    VkImageSubresourceRange range { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    std::vector<VkImage> images = { _previousDepth.image, _previousNormal.image };
+    for (const auto& history : _history) {
+        images.push_back(history.color.image);
+        images.push_back(history.moments.image);
+    }
+    for (VkImage image : images) {
+        vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_GENERAL, &zero, 1, &range);
+    }
+
+    _app.endSingleTimeCommands(commandBuffer);
+}
+
+void Denoiser::createComputePass(ComputePass& pass, const std::string& shader, const std::vector<VkDescriptorType>& bindings, uint32_t pushConstantsSize)
+{
+    pass.bindings = bindings;
+
+    std::vector<VkDescriptorSetLayoutBinding> layoutBindings(bindings.size());
+    for (uint32_t i = 0; i < layoutBindings.size(); i++) {
+        layoutBindings[i].binding = i;
+        layoutBindings[i].descriptorCount = 1;
+        layoutBindings[i].descriptorType = bindings[i];
+        layoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+    layoutInfo.pBindings = layoutBindings.data();
+
+    if (vkCreateDescriptorSetLayout(_app._device, &layoutInfo, nullptr, &pass.descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create the descriptor set layout of " + shader);
+    }
+
+    VkPushConstantRange pushConstantRange {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = pushConstantsSize;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &pass.descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = pushConstantsSize > 0 ? 1 : 0;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(_app._device, &pipelineLayoutInfo, nullptr, &pass.pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create the pipeline layout of " + shader);
+    }
+
+    auto module = ShaderModule(_app._device, shader, VK_SHADER_STAGE_COMPUTE_BIT);
+
+    VkComputePipelineCreateInfo pipelineInfo {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = module.getStageInfo();
+    pipelineInfo.layout = pass.pipelineLayout;
+
+    if (vkCreateComputePipelines(_app._device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pass.pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create the pipeline of " + shader);
+    }
+}
+
+void Denoiser::destroyComputePass(ComputePass& pass)
+{
+    vkDestroyPipeline(_app._device, pass.pipeline, nullptr);
+    vkDestroyPipelineLayout(_app._device, pass.pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(_app._device, pass.descriptorSetLayout, nullptr);
+    pass = {};
+}
+
+void Denoiser::addDispatch(Step& step, const ComputePass& pass, const std::function<std::vector<VkImageView>(size_t)>& getViews)
+{
+    Dispatch dispatch {};
+    dispatch.pass = &pass;
+    for (size_t i = 0; i < _app._swapchainImages.size(); i++) {
+        dispatch.views.push_back(getViews(i));
+    }
+    step.dispatches.push_back(std::move(dispatch));
+}
+
+template <typename Parameters>
+void Denoiser::addDispatch(Step& step, const ComputePass& pass, const Parameters& parameters, const std::function<std::vector<VkImageView>(size_t)>& getViews)
+{
+    addDispatch(step, pass, getViews);
+
+    auto& pushConstants = step.dispatches.back().pushConstants;
+    pushConstants.resize(sizeof(Parameters));
+    memcpy(pushConstants.data(), &parameters, sizeof(Parameters));
+}
+
+void Denoiser::createShadowSteps()
+{
+    createComputePass(_shadowFilterPass, "shaders/shadowFilter.comp.spv",
+        {
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // Visibility
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Filtered visibility
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Normal
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Depth
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, // Camera, for the light radius and the field of view
+        },
+        sizeof(ShadowFilterParameters));
+    createComputePass(_shadowCompositePass, "shaders/shadowComposite.comp.spv",
+        {
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // Traced color
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Filtered visibility
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Albedo
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Direct illumination, shadowed in place
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Shadowed color
+        },
+        0);
+
+    const auto& gBuffers = _app._gBuffers;
+
+    // One shadow ray per pixel is binary, the accumulation turns it into a fraction of the light before the penumbra is estimated
+    if (USE_TEMPORAL_ACCUMULATION) {
+        const TemporalParameters parameters { TEMPORAL_COLOR_ALPHA, TEMPORAL_MOMENTS_ALPHA, TEMPORAL_DEPTH_TOLERANCE, TEMPORAL_NORMAL_TOLERANCE, TEMPORAL_MAX_HISTORY };
+
+        Step step { "Shadow temporal" };
+        addDispatch(step, _temporalPass, parameters, [&](size_t i) {
+            return std::vector<VkImageView> {
+                gBuffers[i][Application::GBUFFER_VISIBILITY].view,
+                gBuffers[i][Application::GBUFFER_MOTION].view,
+                gBuffers[i][Application::GBUFFER_DEPTH].view,
+                gBuffers[i][Application::GBUFFER_NORMAL].view,
+                _previousDepth.view,
+                _previousNormal.view,
+                _history[_shadowSignal].color.view,
+                _history[_shadowSignal].moments.view,
+                _accumulated[i][_shadowSignal].color.view,
+                _accumulated[i][_shadowSignal].moments.view,
+            };
+        });
+        _steps.push_back(std::move(step));
+    }
+
+    Step filter { "Shadow filter" };
+    addDispatch(filter, _shadowFilterPass, ShadowFilterParameters { SHADOW_MAX_RADIUS, ATROUS_NORMAL_PHI, ATROUS_DEPTH_PHI }, [&](size_t i) {
+        return std::vector<VkImageView> {
+            USE_TEMPORAL_ACCUMULATION ? _accumulated[i][_shadowSignal].color.view : gBuffers[i][Application::GBUFFER_VISIBILITY].view,
+            _filterImages[i][_shadowSignal][0].view,
+            gBuffers[i][Application::GBUFFER_NORMAL].view,
+            gBuffers[i][Application::GBUFFER_DEPTH].view,
+            VK_NULL_HANDLE,
+        };
+    });
+    _steps.push_back(std::move(filter));
+
+    // The traced image is in the format of the swapchain, which may not be readable as a storage image, so it is copied
+    for (size_t i = 0; i < _app._swapchainImages.size(); i++) {
+        _shadowedColor.push_back(createImage(VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT));
+    }
+
+    Step composite { "Shadow composite" };
+    addDispatch(composite, _shadowCompositePass, [&](size_t i) {
+        return std::vector<VkImageView> {
+            _app._storageImages[i].view,
+            _filterImages[i][_shadowSignal][0].view,
+            gBuffers[i][Application::GBUFFER_ALBEDO].view,
+            gBuffers[i][Application::GBUFFER_DIRECT].view,
+            _shadowedColor[i].view,
+        };
+    });
+    _steps.push_back(std::move(composite));
+}
+
+void Denoiser::createAtrousSteps()
+{
+    createComputePass(_atrousPass, "shaders/atrous.comp.spv",
+        {
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // Input color
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Output color
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Normal
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Depth
+        },
+        sizeof(AtrousParameters));
+
+    const auto& gBuffers = _app._gBuffers;
+
+    if (USE_TEMPORAL_ACCUMULATION) {
+        // The history gets at least 1 / colorAlpha frames, fewer only right after a disocclusion
+        const TemporalParameters parameters { TEMPORAL_COLOR_ALPHA, TEMPORAL_MOMENTS_ALPHA, TEMPORAL_DEPTH_TOLERANCE, TEMPORAL_NORMAL_TOLERANCE, TEMPORAL_MAX_HISTORY };
+
+        Step step { "Temporal" };
+        addDispatch(step, _temporalPass, parameters, [&](size_t i) {
+            return std::vector<VkImageView> {
+                getTracedColor(i),
+                gBuffers[i][Application::GBUFFER_MOTION].view,
+                gBuffers[i][Application::GBUFFER_DEPTH].view,
+                gBuffers[i][Application::GBUFFER_NORMAL].view,
+                _previousDepth.view,
+                _previousNormal.view,
+                _history[0].color.view,
+                _history[0].moments.view,
+                _accumulated[i][0].color.view,
+                _accumulated[i][0].moments.view,
+            };
+        });
+        _steps.push_back(std::move(step));
+    }
+
+    for (size_t iteration = 0; iteration < ATROUS_ITERATIONS; iteration++) {
+        // Holes of the kernel double every iteration, while the color edges get sharper so the large steps do not blur the details
+        AtrousParameters parameters {};
+        parameters.stepSize = 1 << iteration;
+        parameters.colorPhi = ATROUS_COLOR_PHI / static_cast<float>(1 << iteration);
+        parameters.normalPhi = ATROUS_NORMAL_PHI;
+        parameters.depthPhi = ATROUS_DEPTH_PHI;
+
+        Step step { "A-trous " + std::to_string(iteration + 1) };
+        addDispatch(step, _atrousPass, parameters, [&](size_t i) {
+            // The first iteration reads the accumulated (or traced) image, the next ones the output of the previous iteration
+            VkImageView input = _filterImages[i][0][(iteration + 1) % 2].view;
+            if (iteration == 0) {
+                input = USE_TEMPORAL_ACCUMULATION ? _accumulated[i][0].color.view : getTracedColor(i);
+            }
+            return std::vector<VkImageView> {
+                input,
+                _filterImages[i][0][iteration % 2].view,
+                gBuffers[i][Application::GBUFFER_NORMAL].view,
+                gBuffers[i][Application::GBUFFER_DEPTH].view,
+            };
+        });
+        _steps.push_back(std::move(step));
+    }
+
+    for (const auto& signals : _filterImages) {
+        _outputs.push_back(signals[0][(ATROUS_ITERATIONS - 1) % 2].image);
+    }
+}
+
+void Denoiser::createSvgfSteps()
+{
+    createComputePass(_variancePass, "shaders/svgfVariance.comp.spv",
+        {
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Accumulated color
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Accumulated moments
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Depth
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Normal
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Color and variance
+        },
+        sizeof(VarianceParameters));
+    createComputePass(_svgfAtrousPass, "shaders/svgfAtrous.comp.spv",
+        {
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // Input color and variance
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Output color and variance
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Normal
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Depth
+        },
+        sizeof(AtrousParameters));
+    createComputePass(_modulatePass, "shaders/svgfModulate.comp.spv",
+        {
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // Direct illumination
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // Indirect illumination
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Albedo
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // Traced color
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Depth
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Output color
+        },
+        0);
+
+    const auto& gBuffers = _app._gBuffers;
+    const std::array<Application::GBufferImage, 2> illumination = { Application::GBUFFER_DIRECT, Application::GBUFFER_INDIRECT };
+
+    // Luminance moments of the demodulated illumination
+    Step temporal { "Temporal" };
+    const TemporalParameters temporalParameters { TEMPORAL_COLOR_ALPHA, TEMPORAL_MOMENTS_ALPHA, TEMPORAL_DEPTH_TOLERANCE, TEMPORAL_NORMAL_TOLERANCE, TEMPORAL_MAX_HISTORY };
+    for (size_t signal = 0; signal < illumination.size(); signal++) {
+        addDispatch(temporal, _temporalPass, temporalParameters, [&](size_t i) {
+            return std::vector<VkImageView> {
+                gBuffers[i][illumination[signal]].view,
+                gBuffers[i][Application::GBUFFER_MOTION].view,
+                gBuffers[i][Application::GBUFFER_DEPTH].view,
+                gBuffers[i][Application::GBUFFER_NORMAL].view,
+                _previousDepth.view,
+                _previousNormal.view,
+                _history[signal].color.view,
+                _history[signal].moments.view,
+                _accumulated[i][signal].color.view,
+                _accumulated[i][signal].moments.view,
+            };
+        });
+    }
+    _steps.push_back(std::move(temporal));
+
+    // Variance from the temporal moments, or from the neighbors while the history is too short
+    Step variance { "Variance" };
+    const VarianceParameters varianceParameters { ATROUS_NORMAL_PHI, ATROUS_DEPTH_PHI, SVGF_LUMINANCE_PHI, SVGF_MIN_HISTORY };
+    for (size_t signal = 0; signal < illumination.size(); signal++) {
+        addDispatch(variance, _variancePass, varianceParameters, [&](size_t i) {
+            return std::vector<VkImageView> {
+                _accumulated[i][signal].color.view,
+                _accumulated[i][signal].moments.view,
+                gBuffers[i][Application::GBUFFER_DEPTH].view,
+                gBuffers[i][Application::GBUFFER_NORMAL].view,
+                _filterImages[i][signal][0].view,
+            };
+        });
+    }
+    _steps.push_back(std::move(variance));
+
+    // The first iteration is written over the accumulated color, which is consumed by then,
+    // so it is what the history keeps, as in the paper
+    auto getIterationOutput = [this](size_t i, size_t signal, size_t iteration) {
+        return iteration == 0 ? _accumulated[i][signal].color : _filterImages[i][signal][iteration % 2];
+    };
+
+    for (size_t iteration = 0; iteration < ATROUS_ITERATIONS; iteration++) {
+        AtrousParameters parameters {};
+        parameters.stepSize = 1 << iteration;
+        parameters.colorPhi = SVGF_LUMINANCE_PHI;
+        parameters.normalPhi = ATROUS_NORMAL_PHI;
+        parameters.depthPhi = ATROUS_DEPTH_PHI;
+
+        Step step { "A-trous " + std::to_string(iteration + 1) };
+        for (size_t signal = 0; signal < illumination.size(); signal++) {
+            addDispatch(step, _svgfAtrousPass, parameters, [&](size_t i) {
+                const VkImageView input = iteration == 0 ? _filterImages[i][signal][0].view : getIterationOutput(i, signal, iteration - 1).view;
+                return std::vector<VkImageView> {
+                    input,
+                    getIterationOutput(i, signal, iteration).view,
+                    gBuffers[i][Application::GBUFFER_NORMAL].view,
+                    gBuffers[i][Application::GBUFFER_DEPTH].view,
+                };
+            });
+        }
+        _steps.push_back(std::move(step));
+    }
+
+    Step modulate { "Modulate" };
+    std::vector<StorageImage> outputs;
+    for (size_t i = 0; i < _app._swapchainImages.size(); i++) {
+        outputs.push_back(createImage(VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT));
+        _outputs.push_back(outputs.back().image);
+    }
+    addDispatch(modulate, _modulatePass, [&](size_t i) {
+        return std::vector<VkImageView> {
+            getIterationOutput(i, 0, ATROUS_ITERATIONS - 1).view,
+            getIterationOutput(i, 1, ATROUS_ITERATIONS - 1).view,
+            gBuffers[i][Application::GBUFFER_ALBEDO].view,
+            getTracedColor(i),
+            gBuffers[i][Application::GBUFFER_DEPTH].view,
+            outputs[i].view,
+        };
+    });
+    _steps.push_back(std::move(modulate));
+}
+
+void Denoiser::createBmfrSteps()
+{
+    createComputePass(_bmfrPass, "shaders/bmfr.comp.spv",
+        {
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // Input color
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Output color
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Normal
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Position
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Albedo
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, // Camera, for the frame index
+        },
+        sizeof(BmfrParameters));
+    // A workgroup per block, the blocks are shifted by up to a block every frame
+    _bmfrPass.tileSize = BMFR_BLOCK_SIZE;
+    _bmfrPass.tilePadding = BMFR_BLOCK_SIZE - 1;
+
+    const auto& gBuffers = _app._gBuffers;
+    const TemporalParameters temporalParameters { TEMPORAL_COLOR_ALPHA, TEMPORAL_MOMENTS_ALPHA, TEMPORAL_DEPTH_TOLERANCE, TEMPORAL_NORMAL_TOLERANCE, TEMPORAL_MAX_HISTORY };
+
+    // The fit of a single noisy frame is too blotchy, it is given the accumulated color
+    if (USE_TEMPORAL_ACCUMULATION) {
+        Step step { "Temporal" };
+        addDispatch(step, _temporalPass, temporalParameters, [&](size_t i) {
+            return std::vector<VkImageView> {
+                getTracedColor(i),
+                gBuffers[i][Application::GBUFFER_MOTION].view,
+                gBuffers[i][Application::GBUFFER_DEPTH].view,
+                gBuffers[i][Application::GBUFFER_NORMAL].view,
+                _previousDepth.view,
+                _previousNormal.view,
+                _history[0].color.view,
+                _history[0].moments.view,
+                _accumulated[i][0].color.view,
+                _accumulated[i][0].moments.view,
+            };
+        });
+        _steps.push_back(std::move(step));
+    }
+
+    Step fit { "BMFR fit" };
+    addDispatch(fit, _bmfrPass, BmfrParameters { BMFR_REGULARIZATION }, [&](size_t i) {
+        return std::vector<VkImageView> {
+            USE_TEMPORAL_ACCUMULATION ? _accumulated[i][0].color.view : getTracedColor(i),
+            _filterImages[i][0][0].view,
+            gBuffers[i][Application::GBUFFER_NORMAL].view,
+            gBuffers[i][Application::GBUFFER_POSITION].view,
+            gBuffers[i][Application::GBUFFER_ALBEDO].view,
+            VK_NULL_HANDLE,
+        };
+    });
+    _steps.push_back(std::move(fit));
+
+    if (!USE_TEMPORAL_ACCUMULATION) {
+        for (const auto& signals : _filterImages) {
+            _outputs.push_back(signals[0][0].image);
+        }
+        return;
+    }
+
+    // The fits of successive frames are accumulated too, which hides the seams of the shifted blocks
+    Step accumulation { "BMFR temporal" };
+    addDispatch(accumulation, _temporalPass, temporalParameters, [&](size_t i) {
+        return std::vector<VkImageView> {
+            _filterImages[i][0][0].view,
+            gBuffers[i][Application::GBUFFER_MOTION].view,
+            gBuffers[i][Application::GBUFFER_DEPTH].view,
+            gBuffers[i][Application::GBUFFER_NORMAL].view,
+            _previousDepth.view,
+            _previousNormal.view,
+            _history[1].color.view,
+            _history[1].moments.view,
+            _accumulated[i][1].color.view,
+            _accumulated[i][1].moments.view,
+        };
+    });
+    _steps.push_back(std::move(accumulation));
+
+    for (const auto& signals : _accumulated) {
+        _outputs.push_back(signals[1].color.image);
+    }
+}
+
+void Denoiser::createSampleMapSteps()
+{
+    createComputePass(_sampleMapPass, "shaders/sampleMap.comp.spv",
+        {
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Accumulated moments
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Accumulated moments of the second signal
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Depth
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, // Sampling priorities
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // Sum of the priorities
+        },
+        sizeof(SampleMapParameters));
+
+    // The moments of the traced color, or of the direct and indirect illumination for SVGF
+    // BMFR accumulates its fit as a second signal, which is not as noisy as what is traced
+    const int nbSignals = _app._denoiserType == DenoiserType::Svgf ? 2 : 1;
+
+    Step step { "Sample map" };
+    addDispatch(step, _sampleMapPass, SampleMapParameters { nbSignals, ADAPTIVE_MIN_HISTORY, ADAPTIVE_LUMINANCE_EPSILON }, [&](size_t i) {
+        return std::vector<VkImageView> {
+            _accumulated[i][0].moments.view,
+            _accumulated[i][nbSignals - 1].moments.view,
+            _app._gBuffers[i][Application::GBUFFER_DEPTH].view,
+            _app._samplePriorities.view,
+            VK_NULL_HANDLE,
+        };
+    });
+    _steps.push_back(std::move(step));
+}
+
+void Denoiser::createDescriptorSets()
+{
+    uint32_t nbSets = 0;
+    for (const auto& step : _steps) {
+        nbSets += static_cast<uint32_t>(step.dispatches.size() * _app._swapchainImages.size());
+    }
+
+    // Sized for the largest pass, the few unused descriptors do not matter
+    std::array<VkDescriptorPoolSize, 4> poolSizes {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = nbSets * MAX_PASS_BINDINGS;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount = nbSets * MAX_PASS_BINDINGS;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[2].descriptorCount = nbSets;
+    poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[3].descriptorCount = nbSets;
+
+    VkDescriptorPoolCreateInfo poolInfo {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = nbSets;
+
+    if (vkCreateDescriptorPool(_app._device, &poolInfo, nullptr, &_descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create the denoiser descriptor pool!");
+    }
+
+    for (auto& step : _steps) {
+        for (auto& dispatch : step.dispatches) {
+            if (dispatch.pass->bindings.size() > MAX_PASS_BINDINGS) {
+                throw std::runtime_error("Too many bindings in a denoiser pass!");
+            }
+
+            std::vector<VkDescriptorSetLayout> layouts(dispatch.views.size(), dispatch.pass->descriptorSetLayout);
+            VkDescriptorSetAllocateInfo allocInfo {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            allocInfo.descriptorPool = _descriptorPool;
+            allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+            allocInfo.pSetLayouts = layouts.data();
+
+            dispatch.descriptorSets.resize(layouts.size());
+            if (vkAllocateDescriptorSets(_app._device, &allocInfo, dispatch.descriptorSets.data()) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to allocate the denoiser descriptor sets!");
+            }
+
+            for (size_t i = 0; i < dispatch.views.size(); i++) {
+                writeDescriptorSet(*dispatch.pass, dispatch.descriptorSets[i], dispatch.views[i], i);
+            }
+        }
+    }
+}
+
+void Denoiser::writeDescriptorSet(const ComputePass& pass, VkDescriptorSet descriptorSet, const std::vector<VkImageView>& views, size_t imageIndex)
+{
+    std::vector<VkDescriptorImageInfo> imageInfos(views.size());
+    std::vector<VkWriteDescriptorSet> descriptorWrites(views.size());
+    const VkDescriptorBufferInfo cameraInfo { _app._uniforms[imageIndex].buffer, 0, sizeof(UniformBufferObject) };
+    const VkDescriptorBufferInfo prioritySumInfo { _app._prioritySum.buffer, 0, VK_WHOLE_SIZE };
+
+    for (uint32_t binding = 0; binding < views.size(); binding++) {
+        const bool sampled = pass.bindings[binding] == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        imageInfos[binding] = { sampled ? _sampler : VK_NULL_HANDLE, views[binding], VK_IMAGE_LAYOUT_GENERAL };
+
+        descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[binding].dstSet = descriptorSet;
+        descriptorWrites[binding].dstBinding = binding;
+        descriptorWrites[binding].dstArrayElement = 0;
+        descriptorWrites[binding].descriptorType = pass.bindings[binding];
+        descriptorWrites[binding].descriptorCount = 1;
+        if (pass.bindings[binding] == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+            descriptorWrites[binding].pBufferInfo = &cameraInfo;
+        } else if (pass.bindings[binding] == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) {
+            descriptorWrites[binding].pBufferInfo = &prioritySumInfo;
+        } else {
+            descriptorWrites[binding].pImageInfo = &imageInfos[binding];
+        }
+    }
+
+    vkUpdateDescriptorSets(_app._device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void Denoiser::record(VkCommandBuffer commandBuffer, size_t imageIndex, GpuProfiler& profiler, size_t firstPass)
+{
+    size_t pass = firstPass;
+
+    VkMemoryBarrier barrier {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+
+    // The trace has read the sum of the sampling priorities, the sample map step accumulates it again from zero
+    if (USE_ADAPTIVE_SAMPLING) {
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        vkCmdFillBuffer(commandBuffer, _app._prioritySum.buffer, 0, VK_WHOLE_SIZE, 0);
+    }
+
+    // The images stay in the general layout, only the writes of the previous passes have to be made visible
+    // This covers the trace, the clear of the sum, and the copy to the history at the end of the previous frame, which was submitted before
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    for (size_t s = 0; s < _steps.size(); s++) {
+        if (s > 0) {
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+
+        for (const auto& dispatch : _steps[s].dispatches) {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, dispatch.pass->pipeline);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, dispatch.pass->pipelineLayout, 0, 1, &dispatch.descriptorSets[imageIndex], 0, nullptr);
+            if (!dispatch.pushConstants.empty()) {
+                vkCmdPushConstants(commandBuffer, dispatch.pass->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, static_cast<uint32_t>(dispatch.pushConstants.size()), dispatch.pushConstants.data());
+            }
+            const ComputePass& computePass = *dispatch.pass;
+            const uint32_t groupsX = (_app._swapchainExtent.width + computePass.tilePadding + computePass.tileSize - 1) / computePass.tileSize;
+            const uint32_t groupsY = (_app._swapchainExtent.height + computePass.tilePadding + computePass.tileSize - 1) / computePass.tileSize;
+            vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+        }
+        profiler.endPass(commandBuffer, imageIndex, pass++);
+    }
+
+    // The result is then copied to the swapchain image, and the accumulation to the history
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    if (USE_TEMPORAL_ACCUMULATION) {
+        VkImageCopy copyRegion {};
+        copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        copyRegion.extent = { _app._swapchainExtent.width, _app._swapchainExtent.height, 1 };
+
+        std::vector<std::pair<VkImage, VkImage>> copies = {
+            { _app._gBuffers[imageIndex][Application::GBUFFER_DEPTH].image, _previousDepth.image },
+            { _app._gBuffers[imageIndex][Application::GBUFFER_NORMAL].image, _previousNormal.image },
+        };
+        for (size_t signal = 0; signal < _nbSignals; signal++) {
+            copies.push_back({ _accumulated[imageIndex][signal].color.image, _history[signal].color.image });
+            copies.push_back({ _accumulated[imageIndex][signal].moments.image, _history[signal].moments.image });
+        }
+        for (const auto& copy : copies) {
+            vkCmdCopyImage(commandBuffer, copy.first, VK_IMAGE_LAYOUT_GENERAL, copy.second, VK_IMAGE_LAYOUT_GENERAL, 1, &copyRegion);
+        }
+        profiler.endPass(commandBuffer, imageIndex, pass++);
+    }
+}
+
+VkImageView Denoiser::getTracedColor(size_t imageIndex) const
+{
+    return getTracedImage(imageIndex).view;
+}
+
+VkImage Denoiser::getOutput(size_t imageIndex) const
+{
+    return _outputs[imageIndex];
+}
+
+const StorageImage& Denoiser::getTracedImage(size_t imageIndex) const
+{
+    return USE_SOFT_SHADOWS ? _shadowedColor[imageIndex] : _app._storageImages[imageIndex];
+}
+
+std::vector<std::string> Denoiser::getPassNames() const
+{
+    std::vector<std::string> names;
+    for (const auto& step : _steps) {
+        names.push_back(step.name);
+    }
+    if (USE_TEMPORAL_ACCUMULATION) {
+        names.push_back("History copy");
+    }
+    return names;
+}
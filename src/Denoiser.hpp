@@ -0,0 +1,133 @@
+#pragma once
+
+#include "Utils.hpp"
+
+#include <array>
+#include <functional>
+#include <string>
+#include <vector>
+
+class Application;
+class GpuProfiler;
+
+// Denoising of the traced image, as compute passes recorded after the ray tracing (see DenoiserType)
+// The temporal pass reprojects and accumulates the previous frames, then edge-avoiding a-trous wavelet iterations
+// smooth the result, guided by the normals and depths of the G-buffer, or BMFR fits it to the features of the G-buffer
+// With the soft shadows, the visibility of the first hits is accumulated and filtered first, then it shadows their direct lighting
+// With adaptive sampling, the accumulated moments finally give the sampling priorities of the next frame
+class Denoiser {
+public:
+    Denoiser(Application& app);
+    ~Denoiser();
+
+    // Resources depend on the swapchain images, they are recreated with them
+    void create();
+    void destroy();
+
+    // Filters the traced image of a swapchain image, the result is left in getOutput in the general layout
+    // Every step ends a pass of the profiler, starting at firstPass, in the order of getPassNames
+    void record(VkCommandBuffer commandBuffer, size_t imageIndex, GpuProfiler& profiler, size_t firstPass);
+
+    VkImage getOutput(size_t imageIndex) const;
+
+    // Traced image the first pass filters, in the general layout : the one of the application, or its copy in half floats
+    // once the direct lighting is shadowed back
+    const StorageImage& getTracedImage(size_t imageIndex) const;
+
+    std::vector<std::string> getPassNames() const;
+
+private:
+    // Compute pipeline reading and writing the images of a single descriptor set
+    // Uniform buffer bindings get the camera uniforms of the swapchain image, storage buffer bindings the sum of the sampling priorities
+    struct ComputePass {
+        std::vector<VkDescriptorType> bindings;
+        VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+        VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        uint32_t tileSize = 16; // Pixels covered by a workgroup in x and y, the local_size of most denoising shaders
+        uint32_t tilePadding = 0; // Pixels the tiles may be shifted by, covered by extra workgroups
+    };
+
+    // A dispatch of a pass, with its images for every swapchain image
+    struct Dispatch {
+        const ComputePass* pass;
+        std::vector<char> pushConstants;
+        std::vector<std::vector<VkImageView>> views;
+        std::vector<VkDescriptorSet> descriptorSets;
+    };
+
+    // Independent dispatches, the next step waits for all of them
+    struct Step {
+        std::string name;
+        std::vector<Dispatch> dispatches;
+    };
+
+    // Accumulated color, and luminance moments with the history length in z
+    struct History {
+        StorageImage color;
+        StorageImage moments;
+    };
+
+    void createComputePass(ComputePass& pass, const std::string& shader, const std::vector<VkDescriptorType>& bindings, uint32_t pushConstantsSize);
+    void destroyComputePass(ComputePass& pass);
+
+    StorageImage createImage(VkFormat format, VkImageUsageFlags usage);
+    void createHistory();
+
+    void createShadowSteps();
+    void createAtrousSteps();
+    void createSvgfSteps();
+    void createBmfrSteps();
+    void createSampleMapSteps();
+    void addDispatch(Step& step, const ComputePass& pass, const std::function<std::vector<VkImageView>(size_t)>& getViews);
+    template <typename Parameters>
+    void addDispatch(Step& step, const ComputePass& pass, const Parameters& parameters, const std::function<std::vector<VkImageView>(size_t)>& getViews);
+
+    void createDescriptorSets();
+    // Views in the order of the bindings of the pass, the combined image samplers use _sampler
+    // The buffers have a null view, the uniform ones are bound to the camera uniforms of imageIndex
+    void writeDescriptorSet(const ComputePass& pass, VkDescriptorSet descriptorSet, const std::vector<VkImageView>& views, size_t imageIndex);
+
+    // Traced image the denoisers start from, shadowed by the soft shadow steps if enabled
+    VkImageView getTracedColor(size_t imageIndex) const;
+
+private:
+    Application& _app;
+
+    VkSampler _sampler = VK_NULL_HANDLE;
+    VkDescriptorPool _descriptorPool = VK_NULL_HANDLE;
+
+    ComputePass _temporalPass;
+    ComputePass _atrousPass;
+    ComputePass _variancePass;
+    ComputePass _svgfAtrousPass;
+    ComputePass _modulatePass;
+    ComputePass _bmfrPass;
+    ComputePass _shadowFilterPass;
+    ComputePass _shadowCompositePass;
+    ComputePass _sampleMapPass;
+
+    std::vector<Step> _steps;
+
+    // Every image created by the denoiser
+    std::vector<StorageImage> _images;
+
+    // Signals accumulated separately : the traced color, the direct and indirect illumination for SVGF,
+    // or the traced color before and after the fit for BMFR, followed by the visibility of the soft shadows
+    size_t _nbSignals = 1;
+    size_t _shadowSignal = 0;
+    std::vector<std::vector<History>> _accumulated; // Written by the temporal pass, for every swapchain image and signal
+    // Copies of the last accumulated frame and of its first hits, shared by all the command buffers
+    // so the history does not depend on the order the swapchain images are acquired in
+    std::vector<History> _history;
+    StorageImage _previousDepth;
+    StorageImage _previousNormal;
+
+    // Ping-pong images of every swapchain image and signal
+    std::vector<std::vector<std::array<StorageImage, 2>>> _filterImages;
+
+    // Traced color with the shadowed direct lighting, for every swapchain image
+    std::vector<StorageImage> _shadowedColor;
+
+    std::vector<VkImage> _outputs;
+};
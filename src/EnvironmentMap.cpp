@@ -0,0 +1,124 @@
+#include "EnvironmentMap.hpp"
+#include "Application.hpp"
+#include "ImageUtils.hpp"
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <stb_image.h>
+
+constexpr uint32_t IRRADIANCE_SIZE = 32;
+
+EnvironmentMap::EnvironmentMap(Application& app, const std::string& filename, SamplerModule& sampler)
+    : _app(app)
+{
+    // LDR files are also accepted, stbi_loadf linearizes them
+    int width, height, nbChannels;
+    float* pixels = stbi_loadf(filename.c_str(), &width, &height, &nbChannels, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error("Failed to load environment map " + filename);
+    }
+
+    const size_t nbValues = static_cast<size_t>(width) * height * 4;
+    std::vector<uint16_t> halfPixels(nbValues);
+    convertFloatToHalf(pixels, halfPixels.data(), nbValues);
+
+    _texture = std::make_shared<TextureModule>(_app, sampler);
+    _texture->loadFromHalfFloatBuffer(halfPixels.data(), static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+
+    buildDistribution(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+
+    float coefficients[9][3];
+    projectSH9(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), coefficients);
+    convolveSH9Irradiance(coefficients);
+    for (size_t k = 0; k < _irradianceSH.size(); k++) {
+        _irradianceSH[k] = glm::vec4(coefficients[k][0], coefficients[k][1], coefficients[k][2], 0.f);
+    }
+
+    // A face covers a quarter of the equirectangular width, which keeps the resolution at the equator
+    Cubemap cubemap = equirectangularToCubemap(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), std::max(static_cast<uint32_t>(width) / 4, 1u));
+    generateCubemapMips(cubemap);
+    _cubemap = std::make_shared<TextureModule>(_app, sampler);
+    _cubemap->loadFromCubemap(cubemap);
+
+    const Cubemap irradiance = convolveIrradiance(cubemap, IRRADIANCE_SIZE);
+    _irradiance = std::make_shared<TextureModule>(_app, sampler);
+    _irradiance->loadFromCubemap(irradiance);
+
+    stbi_image_free(pixels);
+}
+
+EnvironmentMap::~EnvironmentMap()
+{
+    vkDestroyBuffer(_app._device, _distribution.buffer, nullptr);
+    vkFreeMemory(_app._device, _distribution.memory, nullptr);
+}
+
+std::shared_ptr<TextureModule> EnvironmentMap::getTexture() const
+{
+    return _texture;
+}
+
+std::shared_ptr<TextureModule> EnvironmentMap::getCubemap() const
+{
+    return _cubemap;
+}
+
+std::shared_ptr<TextureModule> EnvironmentMap::getIrradiance() const
+{
+    return _irradiance;
+}
+
+const std::array<glm::vec4, 9>& EnvironmentMap::getIrradianceSH() const
+{
+    return _irradianceSH;
+}
+
+VkBuffer EnvironmentMap::getDistributionBuffer() const
+{
+    return _distribution.buffer;
+}
+
+void EnvironmentMap::buildDistribution(const float* pixels, uint32_t width, uint32_t height)
+{
+    std::vector<float> distribution((height + 1) + static_cast<size_t>(height) * (width + 1));
+    float* marginal = distribution.data();
+
+    // Rows go from the up direction (v = 0) to the down direction, the sin(theta) factor
+    // compensates the stretching of the equirectangular projection near the poles
+    std::vector<double> rowSums(height);
+    for (uint32_t y = 0; y < height; y++) {
+        const double sinTheta = std::sin(glm::pi<double>() * (y + 0.5) / height);
+        float* conditional = marginal + (height + 1) + static_cast<size_t>(y) * (width + 1);
+        const float* row = pixels + static_cast<size_t>(y) * width * 4;
+
+        double sum = 0.;
+        conditional[0] = 0.f;
+        for (uint32_t x = 0; x < width; x++) {
+            const double luminance = 0.2126 * row[4 * x] + 0.7152 * row[4 * x + 1] + 0.0722 * row[4 * x + 2];
+            sum += std::max(luminance, 0.) * sinTheta;
+            conditional[x + 1] = static_cast<float>(sum);
+        }
+
+        // Black rows are never picked by the marginal, but keep them valid anyway
+        for (uint32_t x = 1; x <= width; x++) {
+            conditional[x] = sum > 0. ? static_cast<float>(conditional[x] / sum) : static_cast<float>(x) / width;
+        }
+        rowSums[y] = sum;
+    }
+
+    double total = 0.;
+    marginal[0] = 0.f;
+    for (uint32_t y = 0; y < height; y++) {
+        total += rowSums[y];
+        marginal[y + 1] = static_cast<float>(total);
+    }
+    for (uint32_t y = 1; y <= height; y++) {
+        marginal[y] = total > 0. ? static_cast<float>(marginal[y] / total) : static_cast<float>(y) / height;
+    }
+
+    _app.createDeviceLocalBuffer(distribution.data(), distribution.size() * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, _distribution);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "TextureModule.hpp"
+#include "Utils.hpp"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Application;
+
+// Equirectangular HDR sky, kept as half floats on the GPU, along with the distribution
+// used by the hit shader to importance sample it.
+// It is also converted to a mipmapped cubemap for the direct lookups of the miss shaders,
+// and to a small irradiance cubemap for the diffuse ambient term.
+// The same irradiance is also projected on 9 spherical harmonics, cheaper to evaluate in the hit shader
+// The distribution buffer holds the marginal CDF over the rows (height + 1 floats)
+// followed by the conditional CDF of every row (width + 1 floats each)
+class EnvironmentMap {
+public:
+    EnvironmentMap(Application& app, const std::string& filename, SamplerModule& sampler);
+    ~EnvironmentMap();
+
+    std::shared_ptr<TextureModule> getTexture() const;
+    std::shared_ptr<TextureModule> getCubemap() const;
+    std::shared_ptr<TextureModule> getIrradiance() const;
+    VkBuffer getDistributionBuffer() const;
+    // RGB irradiance coefficients, divided by pi, in the xyz components
+    const std::array<glm::vec4, 9>& getIrradianceSH() const;
+
+private:
+    void buildDistribution(const float* pixels, uint32_t width, uint32_t height);
+
+private:
+    Application& _app;
+
+    std::shared_ptr<TextureModule> _texture;
+    std::shared_ptr<TextureModule> _cubemap;
+    std::shared_ptr<TextureModule> _irradiance;
+    Buffer _distribution {};
+    std::array<glm::vec4, 9> _irradianceSH {};
+};
@@ -0,0 +1,120 @@
+#include "Application.hpp"
+#include "GpuProfiler.hpp"
+
+#include <iomanip>
+#include <sstream>
+
+GpuProfiler::GpuProfiler(Application& app)
+    : _app(app)
+{
+}
+
+GpuProfiler::~GpuProfiler()
+{
+}
+
+void GpuProfiler::create(size_t nbCommandBuffers, const std::vector<std::string>& passNames)
+{
+    _passNames = passNames;
+    _totals.assign(_passNames.size(), 0.);
+    _nbSamples = 0;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(_app._physDevice, &properties);
+    _timestampPeriod = properties.limits.timestampPeriod;
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(_app._physDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(_app._physDevice, &queueFamilyCount, queueFamilies.data());
+
+    const uint32_t validBits = queueFamilies[_app.findQueueFamilies(_app._physDevice).graphicsFamily.value()].timestampValidBits;
+    if (validBits == 0) {
+        std::cout << "Timestamps are not supported by the graphics queue, no GPU timings" << std::endl;
+        return;
+    }
+    _timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+    VkQueryPoolCreateInfo poolInfo {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = static_cast<uint32_t>(nbCommandBuffers * (_passNames.size() + 1));
+
+    if (vkCreateQueryPool(_app._device, &poolInfo, nullptr, &_queryPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create the timestamp query pool!");
+    }
+}
+
+void GpuProfiler::destroy()
+{
+    if (_queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(_app._device, _queryPool, nullptr);
+        _queryPool = VK_NULL_HANDLE;
+    }
+}
+
+void GpuProfiler::begin(VkCommandBuffer commandBuffer, size_t index)
+{
+    if (_queryPool == VK_NULL_HANDLE) {
+        return;
+    }
+
+    const uint32_t rangeSize = static_cast<uint32_t>(_passNames.size() + 1);
+    vkCmdResetQueryPool(commandBuffer, _queryPool, static_cast<uint32_t>(index) * rangeSize, rangeSize);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _queryPool, static_cast<uint32_t>(index) * rangeSize);
+}
+
+void GpuProfiler::endPass(VkCommandBuffer commandBuffer, size_t index, size_t pass)
+{
+    if (_queryPool == VK_NULL_HANDLE) {
+        return;
+    }
+
+    const uint32_t rangeSize = static_cast<uint32_t>(_passNames.size() + 1);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _queryPool, static_cast<uint32_t>(index * rangeSize + pass + 1));
+}
+
+void GpuProfiler::collect(size_t index)
+{
+    if (_queryPool == VK_NULL_HANDLE) {
+        return;
+    }
+
+    const uint32_t rangeSize = static_cast<uint32_t>(_passNames.size() + 1);
+    std::vector<uint64_t> timestamps(rangeSize);
+
+    // Not ready before the first submission of the command buffer, the timings are just skipped
+    const VkResult result = vkGetQueryPoolResults(_app._device, _queryPool, static_cast<uint32_t>(index) * rangeSize, rangeSize,
+        timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+        return;
+    }
+
+    for (size_t pass = 0; pass < _passNames.size(); pass++) {
+        const uint64_t ticks = (timestamps[pass + 1] - timestamps[pass]) & _timestampMask;
+        _totals[pass] += static_cast<double>(ticks) * _timestampPeriod * 1e-6;
+    }
+    _nbSamples++;
+}
+
+std::string GpuProfiler::getReport()
+{
+    if (_nbSamples == 0) {
+        return "";
+    }
+
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(3);
+
+    double total = 0.;
+    for (size_t pass = 0; pass < _passNames.size(); pass++) {
+        const double duration = _totals[pass] / _nbSamples;
+        report << _passNames[pass] << " : " << duration << " ms, ";
+        total += duration;
+        _totals[pass] = 0.;
+    }
+    report << "GPU total : " << total << " ms";
+    _nbSamples = 0;
+
+    return report.str();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+
+class Application;
+
+// GPU durations of the passes recorded in the prerecorded command buffers, from timestamp queries.
+// Each command buffer owns a range of queries : one written when it begins, then one at the end of every pass.
+// The range of a command buffer is read back just before it is submitted again, and only if it is complete,
+// so the CPU never waits on the GPU for the timings.
+class GpuProfiler {
+public:
+    GpuProfiler(Application& app);
+    ~GpuProfiler();
+
+    void create(size_t nbCommandBuffers, const std::vector<std::string>& passNames);
+    void destroy();
+
+    void begin(VkCommandBuffer commandBuffer, size_t index);
+    void endPass(VkCommandBuffer commandBuffer, size_t index, size_t pass);
+
+    // Accumulates the timings of the last execution of a command buffer, if they are available
+    void collect(size_t index);
+
+    // Average duration of every pass since the last report, in milliseconds
+    std::string getReport();
+
+private:
+    Application& _app;
+
+    VkQueryPool _queryPool = VK_NULL_HANDLE;
+    std::vector<std::string> _passNames;
+    float _timestampPeriod = 0.f; // Nanoseconds per tick
+    uint64_t _timestampMask = 0;
+
+    std::vector<double> _totals;
+    size_t _nbSamples = 0;
+};
@@ -0,0 +1,25 @@
+# Image helpers shared by the application and the tools, included from every project that needs them so each tool
+# can also be configured on its own. The first include defines the target, the next ones reuse it
+if(NOT TARGET image-utils)
+    add_library(image-utils STATIC
+        "${CMAKE_CURRENT_LIST_DIR}/ImageUtils.cpp"
+        "${CMAKE_CURRENT_LIST_DIR}/ImageUtils.hpp")
+
+    target_include_directories(image-utils PUBLIC "${CMAKE_CURRENT_LIST_DIR}")
+    target_compile_features(image-utils PUBLIC cxx_std_20)
+
+    # SIMD paths are compiled apart with their instruction set, and only selected when the CPU has it
+    if(CMAKE_SYSTEM_PROCESSOR MATCHES "x86_64|AMD64|amd64|i.86")
+        target_sources(image-utils PRIVATE "${CMAKE_CURRENT_LIST_DIR}/ImageUtilsAvx.cpp" "${CMAKE_CURRENT_LIST_DIR}/ImageUtilsF16c.cpp")
+        target_compile_definitions(image-utils PRIVATE IMAGE_UTILS_AVX IMAGE_UTILS_F16C)
+        if(MSVC)
+            set_source_files_properties("${CMAKE_CURRENT_LIST_DIR}/ImageUtilsAvx.cpp" "${CMAKE_CURRENT_LIST_DIR}/ImageUtilsF16c.cpp" PROPERTIES COMPILE_OPTIONS "/arch:AVX")
+        else()
+            set_source_files_properties("${CMAKE_CURRENT_LIST_DIR}/ImageUtilsAvx.cpp" PROPERTIES COMPILE_OPTIONS "-mavx")
+            set_source_files_properties("${CMAKE_CURRENT_LIST_DIR}/ImageUtilsF16c.cpp" PROPERTIES COMPILE_OPTIONS "-mavx;-mf16c")
+        endif()
+    endif()
+
+    find_package(Threads REQUIRED)
+    target_link_libraries(image-utils PUBLIC Threads::Threads)
+endif()
@@ -0,0 +1,595 @@
+#include "ImageUtils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+constexpr uint64_t HASH_PRIME_0 = 0x9E3779B97F4A7C15ull;
+constexpr uint64_t HASH_PRIME_1 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t HASH_PRIME_2 = 0x165667B19E3779F9ull;
+
+static inline uint64_t rotateLeft(uint64_t value, int shift)
+{
+    return (value << shift) | (value >> (64 - shift));
+}
+
+static inline uint64_t hashRound(uint64_t acc, uint64_t word)
+{
+    acc += word * HASH_PRIME_1;
+    acc = rotateLeft(acc, 31);
+    return acc * HASH_PRIME_0;
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    const unsigned char* end = bytes + size;
+
+    // Four independent lanes so the multiplications can overlap
+    uint64_t lanes[4] = { seed + HASH_PRIME_0 + HASH_PRIME_1, seed + HASH_PRIME_1, seed, seed - HASH_PRIME_0 };
+    while (end - bytes >= 32) {
+        for (size_t i = 0; i < 4; i++) {
+            uint64_t word;
+            std::memcpy(&word, bytes + 8 * i, sizeof(word));
+            lanes[i] = hashRound(lanes[i], word);
+        }
+        bytes += 32;
+    }
+
+    uint64_t hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+    hash += static_cast<uint64_t>(size) * HASH_PRIME_2;
+
+    while (end - bytes >= 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        hash ^= hashRound(0, word);
+        hash = rotateLeft(hash, 27) * HASH_PRIME_0 + HASH_PRIME_2;
+        bytes += 8;
+    }
+
+    while (bytes < end) {
+        hash ^= static_cast<uint64_t>(*bytes) * HASH_PRIME_2;
+        hash = rotateLeft(hash, 11) * HASH_PRIME_0;
+        bytes++;
+    }
+
+    // Final avalanche
+    hash ^= hash >> 33;
+    hash *= HASH_PRIME_1;
+    hash ^= hash >> 29;
+    hash *= HASH_PRIME_2;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+std::string hashToString(uint64_t hash)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string result(16, '0');
+    for (size_t i = 0; i < 16; i++) {
+        result[15 - i] = digits[(hash >> (4 * i)) & 0xF];
+    }
+    return result;
+}
+
+bool readFile(const std::string& filename, std::vector<unsigned char>& content)
+{
+    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    const size_t fileSize = static_cast<size_t>(file.tellg());
+    content.resize(fileSize);
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(content.data()), fileSize);
+
+    return static_cast<bool>(file);
+}
+
+bool writePfm(const std::string& filename, const float* pixels, uint32_t width, uint32_t height, uint32_t nbChannels)
+{
+    const std::string header = std::string(nbChannels == 3 ? "PF" : "Pf") + "\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+    std::vector<unsigned char> content(header.begin(), header.end());
+
+    // Rows are stored bottom first, the bytes are assembled explicitly so the host order does not matter
+    const size_t rowSize = static_cast<size_t>(width) * nbChannels;
+    content.reserve(content.size() + rowSize * height * 4);
+    for (uint32_t y = height; y-- > 0;) {
+        for (size_t i = 0; i < rowSize; i++) {
+            uint32_t bits;
+            std::memcpy(&bits, &pixels[y * rowSize + i], sizeof(bits));
+            for (int b = 0; b < 4; b++) {
+                content.push_back(static_cast<unsigned char>(bits >> (8 * b)));
+            }
+        }
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(content.data()), static_cast<std::streamsize>(content.size()));
+    return static_cast<bool>(file);
+}
+
+uint32_t getMipLevelCount(uint32_t width, uint32_t height)
+{
+    uint32_t levels = 1;
+    uint32_t size = std::max(width, height);
+    while (size > 1) {
+        size >>= 1;
+        levels++;
+    }
+    return levels;
+}
+
+// Number of entries of the linear to sRGB table, enough to round trip every byte
+constexpr size_t LINEAR_TO_SRGB_ENTRIES = 4096;
+
+struct SrgbTables {
+    std::array<float, 256> toLinear;
+    std::array<unsigned char, LINEAR_TO_SRGB_ENTRIES + 1> toSrgb;
+
+    SrgbTables()
+    {
+        for (size_t i = 0; i < toLinear.size(); i++) {
+            const float c = static_cast<float>(i) / 255.f;
+            toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (size_t i = 0; i < toSrgb.size(); i++) {
+            const float l = static_cast<float>(i) / LINEAR_TO_SRGB_ENTRIES;
+            const float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.f / 2.4f) - 0.055f;
+            toSrgb[i] = static_cast<unsigned char>(std::clamp(c * 255.f + 0.5f, 0.f, 255.f));
+        }
+    }
+};
+
+static const SrgbTables& getSrgbTables()
+{
+    static const SrgbTables tables;
+    return tables;
+}
+
+static void downsampleRows(const unsigned char* src, const MipLevel& srcLevel, unsigned char* dst, const MipLevel& dstLevel, uint32_t firstRow, uint32_t lastRow, bool srgb)
+{
+    const SrgbTables& tables = getSrgbTables();
+
+    for (uint32_t y = firstRow; y < lastRow; y++) {
+        // Clamp for odd sizes, the last row/column is then weighted twice
+        const uint32_t y0 = std::min(2 * y, srcLevel.height - 1);
+        const uint32_t y1 = std::min(2 * y + 1, srcLevel.height - 1);
+        const unsigned char* row0 = src + static_cast<size_t>(y0) * srcLevel.width * 4;
+        const unsigned char* row1 = src + static_cast<size_t>(y1) * srcLevel.width * 4;
+        unsigned char* out = dst + static_cast<size_t>(y) * dstLevel.width * 4;
+
+        for (uint32_t x = 0; x < dstLevel.width; x++) {
+            const size_t x0 = static_cast<size_t>(std::min(2 * x, srcLevel.width - 1)) * 4;
+            const size_t x1 = static_cast<size_t>(std::min(2 * x + 1, srcLevel.width - 1)) * 4;
+
+            for (size_t c = 0; c < 4; c++) {
+                if (srgb && c < 3) {
+                    const float sum = tables.toLinear[row0[x0 + c]] + tables.toLinear[row0[x1 + c]] + tables.toLinear[row1[x0 + c]] + tables.toLinear[row1[x1 + c]];
+                    out[4 * x + c] = tables.toSrgb[static_cast<size_t>(sum * (LINEAR_TO_SRGB_ENTRIES / 4.f) + 0.5f)];
+                } else {
+                    const uint32_t sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+                    out[4 * x + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+    }
+}
+
+MipChain generateMipChain(const unsigned char* pixels, uint32_t width, uint32_t height, bool srgb)
+{
+    MipChain chain;
+    const uint32_t levelCount = getMipLevelCount(width, height);
+
+    size_t totalSize = 0;
+    for (uint32_t i = 0; i < levelCount; i++) {
+        MipLevel level {};
+        level.width = std::max(width >> i, 1u);
+        level.height = std::max(height >> i, 1u);
+        level.offset = totalSize;
+        totalSize += static_cast<size_t>(level.width) * level.height * 4;
+        chain.levels.push_back(level);
+    }
+
+    chain.data.resize(totalSize);
+    std::memcpy(chain.data.data(), pixels, static_cast<size_t>(width) * height * 4);
+
+    const uint32_t nbThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (uint32_t i = 1; i < levelCount; i++) {
+        const MipLevel& srcLevel = chain.levels[i - 1];
+        const MipLevel& dstLevel = chain.levels[i];
+        const unsigned char* src = chain.data.data() + srcLevel.offset;
+        unsigned char* dst = chain.data.data() + dstLevel.offset;
+
+        // Small levels are not worth a thread
+        const uint32_t nbWorkers = dstLevel.width * dstLevel.height < 256 * 256 ? 1 : std::min(nbThreads, dstLevel.height);
+        const uint32_t rowsPerWorker = (dstLevel.height + nbWorkers - 1) / nbWorkers;
+
+        std::vector<std::thread> workers;
+        for (uint32_t w = 1; w < nbWorkers; w++) {
+            const uint32_t firstRow = w * rowsPerWorker;
+            const uint32_t lastRow = std::min(firstRow + rowsPerWorker, dstLevel.height);
+            workers.emplace_back(downsampleRows, src, std::cref(srcLevel), dst, std::cref(dstLevel), firstRow, lastRow, srgb);
+        }
+        downsampleRows(src, srcLevel, dst, dstLevel, 0, std::min(rowsPerWorker, dstLevel.height), srgb);
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    return chain;
+}
+
+uint16_t floatToHalf(float value)
+{
+    // Bit manipulation version of the conversion, from Fabian Giesen's float_to_half_fast3_rtne
+    constexpr uint32_t F32_INFINITY = 255u << 23;
+    constexpr uint32_t F16_MAX = (127u + 16u) << 23;
+    constexpr uint32_t DENORM_MAGIC = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    uint16_t half;
+    if (bits >= F16_MAX) {
+        // Overflows become infinity, NaNs stay quiet NaNs
+        half = bits > F32_INFINITY ? 0x7E00 : 0x7C00;
+    } else if (bits < (113u << 23)) {
+        // Too small for a normal half, let the float addition round the denormal
+        float f;
+        float magic;
+        std::memcpy(&f, &bits, sizeof(f));
+        std::memcpy(&magic, &DENORM_MAGIC, sizeof(magic));
+        f += magic;
+        std::memcpy(&bits, &f, sizeof(bits));
+        half = static_cast<uint16_t>(bits - DENORM_MAGIC);
+    } else {
+        const uint32_t mantissaOdd = (bits >> 13) & 1;
+        bits += ((15u - 127u) << 23) + 0xFFFu;
+        bits += mantissaOdd;
+        half = static_cast<uint16_t>(bits >> 13);
+    }
+
+    return half | static_cast<uint16_t>(sign >> 16);
+}
+
+float halfToFloat(uint16_t value)
+{
+    const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+    const uint32_t exponent = (value >> 10) & 0x1F;
+    const uint32_t mantissa = value & 0x3FF;
+
+    uint32_t bits;
+    if (exponent == 0x1F) {
+        bits = sign | 0x7F800000u | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else {
+        // Zero and denormals, exact as floats
+        const float f = static_cast<float>(mantissa) * (1.f / 16777216.f);
+        std::memcpy(&bits, &f, sizeof(bits));
+        bits |= sign;
+    }
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+void convertFloatToHalf(const float* src, uint16_t* dst, size_t count)
+{
+    size_t i = 0;
+#if defined(IMAGE_UTILS_F16C)
+    static const bool f16c = isF16cConversionSupported();
+    if (f16c) {
+        i = convertFloatToHalfF16c(src, dst, count);
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = floatToHalf(src[i]);
+    }
+}
+
+constexpr float PI = 3.14159265358979f;
+
+// Runs task(i) for every i in [0, count[ on all the cores
+static void parallelFor(uint32_t count, const std::function<void(uint32_t)>& task)
+{
+    const uint32_t nbWorkers = std::min(std::max(std::thread::hardware_concurrency(), 1u), count);
+
+    std::vector<std::thread> workers;
+    for (uint32_t w = 0; w < nbWorkers; w++) {
+        workers.emplace_back([&, w]() {
+            for (uint32_t i = w; i < count; i += nbWorkers) {
+                task(i);
+            }
+        });
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+static size_t getCubemapLevelSize(uint32_t faceSize)
+{
+    return 6 * static_cast<size_t>(faceSize) * faceSize * 4;
+}
+
+// Direction through the center of texel (x, y) of a face, not normalized
+static void getCubemapDirection(uint32_t face, uint32_t x, uint32_t y, uint32_t faceSize, float direction[3])
+{
+    const float s = 2.f * (x + 0.5f) / faceSize - 1.f;
+    const float t = 2.f * (y + 0.5f) / faceSize - 1.f;
+
+    switch (face) {
+    case 0: // +X
+        direction[0] = 1.f, direction[1] = -t, direction[2] = -s;
+        break;
+    case 1: // -X
+        direction[0] = -1.f, direction[1] = -t, direction[2] = s;
+        break;
+    case 2: // +Y
+        direction[0] = s, direction[1] = 1.f, direction[2] = t;
+        break;
+    case 3: // -Y
+        direction[0] = s, direction[1] = -1.f, direction[2] = -t;
+        break;
+    case 4: // +Z
+        direction[0] = s, direction[1] = -t, direction[2] = 1.f;
+        break;
+    default: // -Z
+        direction[0] = -s, direction[1] = -t, direction[2] = -1.f;
+        break;
+    }
+}
+
+// Bilinear lookup, repeating horizontally and clamping at the poles
+static void sampleEquirectangular(const float* pixels, uint32_t width, uint32_t height, float u, float v, float* color)
+{
+    const float x = u * width - 0.5f;
+    const float y = std::clamp(v * height - 0.5f, 0.f, static_cast<float>(height - 1));
+    const float x0 = std::floor(x);
+    const float y0 = std::floor(y);
+    const float fx = x - x0;
+    const float fy = y - y0;
+
+    const auto wrap = [width](int64_t i) { return static_cast<size_t>(((i % width) + width) % width); };
+    const size_t columns[2] = { wrap(static_cast<int64_t>(x0)), wrap(static_cast<int64_t>(x0) + 1) };
+    const size_t rows[2] = { static_cast<size_t>(y0), std::min(static_cast<size_t>(y0) + 1, static_cast<size_t>(height - 1)) };
+
+    for (size_t c = 0; c < 4; c++) {
+        const float top = pixels[(rows[0] * width + columns[0]) * 4 + c] * (1.f - fx) + pixels[(rows[0] * width + columns[1]) * 4 + c] * fx;
+        const float bottom = pixels[(rows[1] * width + columns[0]) * 4 + c] * (1.f - fx) + pixels[(rows[1] * width + columns[1]) * 4 + c] * fx;
+        color[c] = top * (1.f - fy) + bottom * fy;
+    }
+}
+
+Cubemap equirectangularToCubemap(const float* pixels, uint32_t width, uint32_t height, uint32_t faceSize)
+{
+    Cubemap cubemap;
+    cubemap.faceSize = faceSize;
+    cubemap.levels.emplace_back(getCubemapLevelSize(faceSize));
+    float* faces = cubemap.levels[0].data();
+
+    parallelFor(6 * faceSize, [&](uint32_t row) {
+        const uint32_t face = row / faceSize;
+        const uint32_t y = row % faceSize;
+        for (uint32_t x = 0; x < faceSize; x++) {
+            float direction[3];
+            getCubemapDirection(face, x, y, faceSize, direction);
+            const float length = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+
+            const float u = std::atan2(direction[1], direction[0]) / (2.f * PI) + 0.5f;
+            const float v = std::acos(std::clamp(direction[2] / length, -1.f, 1.f)) / PI;
+            sampleEquirectangular(pixels, width, height, u, v, faces + ((static_cast<size_t>(face) * faceSize + y) * faceSize + x) * 4);
+        }
+    });
+
+    return cubemap;
+}
+
+void generateCubemapMips(Cubemap& cubemap)
+{
+    uint32_t size = cubemap.faceSize;
+    cubemap.levels.resize(1);
+
+    while (size > 1) {
+        const uint32_t nextSize = size / 2;
+        const std::vector<float>& source = cubemap.levels.back();
+        std::vector<float> level(getCubemapLevelSize(nextSize));
+
+        for (size_t face = 0; face < 6; face++) {
+            const float* src = source.data() + face * size * size * 4;
+            float* dst = level.data() + face * nextSize * nextSize * 4;
+            for (uint32_t y = 0; y < nextSize; y++) {
+                for (uint32_t x = 0; x < nextSize; x++) {
+                    // Odd sizes drop their last row and column
+                    for (size_t c = 0; c < 4; c++) {
+                        dst[(y * nextSize + x) * 4 + c] = 0.25f * (src[((2 * y) * size + 2 * x) * 4 + c] + src[((2 * y) * size + 2 * x + 1) * 4 + c] + src[((2 * y + 1) * size + 2 * x) * 4 + c] + src[((2 * y + 1) * size + 2 * x + 1) * 4 + c]);
+                    }
+                }
+            }
+        }
+
+        cubemap.levels.push_back(std::move(level));
+        size = nextSize;
+    }
+}
+
+Cubemap convolveIrradiance(const Cubemap& radiance, uint32_t faceSize)
+{
+    // Irradiance is smooth, so a small level of the radiance is enough
+    constexpr uint32_t MAX_SOURCE_SIZE = 32;
+    uint32_t sourceLevel = 0;
+    uint32_t sourceSize = radiance.faceSize;
+    while (sourceSize > MAX_SOURCE_SIZE && sourceLevel + 1 < radiance.levels.size()) {
+        sourceSize /= 2;
+        sourceLevel++;
+    }
+    const float* source = radiance.levels[sourceLevel].data();
+
+    // Normalized direction and solid angle of every source texel
+    std::vector<float> directions(6 * static_cast<size_t>(sourceSize) * sourceSize * 4);
+    for (uint32_t face = 0; face < 6; face++) {
+        for (uint32_t y = 0; y < sourceSize; y++) {
+            for (uint32_t x = 0; x < sourceSize; x++) {
+                float* entry = directions.data() + ((static_cast<size_t>(face) * sourceSize + y) * sourceSize + x) * 4;
+                getCubemapDirection(face, x, y, sourceSize, entry);
+                const float squaredLength = entry[0] * entry[0] + entry[1] * entry[1] + entry[2] * entry[2];
+                const float length = std::sqrt(squaredLength);
+                for (size_t c = 0; c < 3; c++) {
+                    entry[c] /= length;
+                }
+                entry[3] = (2.f / sourceSize) * (2.f / sourceSize) / (squaredLength * length);
+            }
+        }
+    }
+
+    Cubemap irradiance;
+    irradiance.faceSize = faceSize;
+    irradiance.levels.emplace_back(getCubemapLevelSize(faceSize));
+    float* faces = irradiance.levels[0].data();
+    const size_t nbSourceTexels = directions.size() / 4;
+
+    parallelFor(6 * faceSize, [&](uint32_t row) {
+        const uint32_t face = row / faceSize;
+        const uint32_t y = row % faceSize;
+        for (uint32_t x = 0; x < faceSize; x++) {
+            float normal[3];
+            getCubemapDirection(face, x, y, faceSize, normal);
+            const float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+            float sum[3] = {};
+            for (size_t i = 0; i < nbSourceTexels; i++) {
+                const float* entry = directions.data() + i * 4;
+                const float cosine = (normal[0] * entry[0] + normal[1] * entry[1] + normal[2] * entry[2]) / length;
+                if (cosine > 0.f) {
+                    const float weight = cosine * entry[3];
+                    for (size_t c = 0; c < 3; c++) {
+                        sum[c] += source[i * 4 + c] * weight;
+                    }
+                }
+            }
+
+            float* texel = faces + ((static_cast<size_t>(face) * faceSize + y) * faceSize + x) * 4;
+            for (size_t c = 0; c < 3; c++) {
+                texel[c] = sum[c] / PI;
+            }
+            texel[3] = 1.f;
+        }
+    });
+
+    return irradiance;
+}
+
+static void evaluateSH9(float x, float y, float z, float basis[9])
+{
+    basis[0] = SH_Y00;
+    basis[1] = SH_Y1 * y;
+    basis[2] = SH_Y1 * z;
+    basis[3] = SH_Y1 * x;
+    basis[4] = SH_Y2 * x * y;
+    basis[5] = SH_Y2 * y * z;
+    basis[6] = SH_Y20 * (3.f * z * z - 1.f);
+    basis[7] = SH_Y2 * x * z;
+    basis[8] = SH_Y22 * (x * x - y * y);
+}
+
+// Accumulates columns [first, last[ of one row, every texel already weighted by its solid angle
+static void accumulateSH9Scalar(const float* row, const float* cosPhi, const float* sinPhi, float sinTheta, float cosTheta, float weight, uint32_t first, uint32_t last, double sums[9][3])
+{
+    for (uint32_t x = first; x < last; x++) {
+        float basis[9];
+        evaluateSH9(sinTheta * cosPhi[x], sinTheta * sinPhi[x], cosTheta, basis);
+        for (size_t k = 0; k < 9; k++) {
+            for (size_t c = 0; c < 3; c++) {
+                sums[k][c] += static_cast<double>(basis[k] * row[4 * x + c] * weight);
+            }
+        }
+    }
+}
+
+void projectSH9(const float* pixels, uint32_t width, uint32_t height, float coefficients[9][3])
+{
+    std::vector<float> cosPhi(width);
+    std::vector<float> sinPhi(width);
+    for (uint32_t x = 0; x < width; x++) {
+        const float phi = 2.f * PI * (x + 0.5f) / width - PI;
+        cosPhi[x] = std::cos(phi);
+        sinPhi[x] = std::sin(phi);
+    }
+
+#if defined(IMAGE_UTILS_AVX)
+    const bool avx = isAvxSupported();
+#endif
+
+    // Each worker sums a set of rows, the partial sums are added in a fixed order to stay deterministic
+    const uint32_t nbWorkers = std::min(std::max(std::thread::hardware_concurrency(), 1u), height);
+    std::vector<std::array<std::array<double, 3>, 9>> partialSums(nbWorkers);
+
+    std::vector<std::thread> workers;
+    for (uint32_t w = 0; w < nbWorkers; w++) {
+        workers.emplace_back([&, w]() {
+            double sums[9][3] = {};
+            for (uint32_t y = w; y < height; y += nbWorkers) {
+                const float theta = PI * (y + 0.5f) / height;
+                const float sinTheta = std::sin(theta);
+                const float cosTheta = std::cos(theta);
+                // Solid angle of the texels of this row
+                const float weight = (2.f * PI / width) * (PI / height) * sinTheta;
+                const float* row = pixels + static_cast<size_t>(y) * width * 4;
+
+                uint32_t first = 0;
+#if defined(IMAGE_UTILS_AVX)
+                if (avx) {
+                    first = accumulateSH9Avx(row, cosPhi.data(), sinPhi.data(), sinTheta, cosTheta, weight, width, sums);
+                }
+#endif
+                accumulateSH9Scalar(row, cosPhi.data(), sinPhi.data(), sinTheta, cosTheta, weight, first, width, sums);
+            }
+
+            for (size_t k = 0; k < 9; k++) {
+                for (size_t c = 0; c < 3; c++) {
+                    partialSums[w][k][c] = sums[k][c];
+                }
+            }
+        });
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (size_t k = 0; k < 9; k++) {
+        for (size_t c = 0; c < 3; c++) {
+            double sum = 0.;
+            for (const auto& partial : partialSums) {
+                sum += partial[k][c];
+            }
+            coefficients[k][c] = static_cast<float>(sum);
+        }
+    }
+}
+
+void convolveSH9Irradiance(float coefficients[9][3])
+{
+    // Ramamoorthi and Hanrahan's clamped cosine lobe (pi, 2pi/3, pi/4), divided by pi
+    constexpr float BAND_FACTORS[3] = { 1.f, 2.f / 3.f, 1.f / 4.f };
+    constexpr size_t BANDS[9] = { 0, 1, 1, 1, 2, 2, 2, 2, 2 };
+
+    for (size_t k = 0; k < 9; k++) {
+        for (size_t c = 0; c < 3; c++) {
+            coefficients[k][c] *= BAND_FACTORS[BANDS[k]];
+        }
+    }
+}
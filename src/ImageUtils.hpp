@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Fast non cryptographic 64 bits hash, used to recognize identical image content
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+std::string hashToString(uint64_t hash);
+
+bool readFile(const std::string& filename, std::vector<unsigned char>& content);
+
+// Little endian portable float map of 1 or 3 channels, pixels given top row first
+bool writePfm(const std::string& filename, const float* pixels, uint32_t width, uint32_t height, uint32_t nbChannels);
+
+struct MipLevel {
+    uint32_t width;
+    uint32_t height;
+    size_t offset; // in bytes, inside MipChain::data
+};
+
+// Every level of an RGBA8 image, packed one after the other starting with the base level
+struct MipChain {
+    std::vector<unsigned char> data;
+    std::vector<MipLevel> levels;
+};
+
+uint32_t getMipLevelCount(uint32_t width, uint32_t height);
+
+// 2x2 box filter, done in linear space for sRGB images (alpha is always linear)
+MipChain generateMipChain(const unsigned char* pixels, uint32_t width, uint32_t height, bool srgb = true);
+
+// Six square faces in the Vulkan layer order (+X, -X, +Y, -Y, +Z, -Z), base level first.
+// Every level holds the faces one after the other, as RGBA floats
+struct Cubemap {
+    uint32_t faceSize { 0 };
+    std::vector<std::vector<float>> levels;
+};
+
+// The equirectangular mapping is the one of the miss shader: +z is up, at v = 0
+Cubemap equirectangularToCubemap(const float* pixels, uint32_t width, uint32_t height, uint32_t faceSize);
+void generateCubemapMips(Cubemap& cubemap);
+// Cosine convolution of the radiance, divided by pi so a diffuse surface only has to multiply it by its albedo
+Cubemap convolveIrradiance(const Cubemap& radiance, uint32_t faceSize);
+
+// Normalization constants of the real spherical harmonics of bands 0 to 2
+constexpr float SH_Y00 = 0.282095f;
+constexpr float SH_Y1 = 0.488603f;
+constexpr float SH_Y2 = 1.092548f;
+constexpr float SH_Y20 = 0.315392f;
+constexpr float SH_Y22 = 0.546274f;
+
+// Projects an equirectangular RGBA float image (same mapping as above) on the 9 real spherical harmonics of
+// bands 0 to 2, coefficients[k][c] for the basis k and the channel c (RGB)
+void projectSH9(const float* pixels, uint32_t width, uint32_t height, float coefficients[9][3]);
+// Applies the clamped cosine convolution (divided by pi), after which evaluating the harmonics in the
+// direction of a normal gives its irradiance in the same units as the irradiance cubemap
+void convolveSH9Irradiance(float coefficients[9][3]);
+
+#if defined(IMAGE_UTILS_AVX)
+// Compiled apart with AVX, only called after isAvxSupported.
+// Accumulates one row of projectSH9 8 columns at a time and returns the first column left to the scalar path
+bool isAvxSupported();
+uint32_t accumulateSH9Avx(const float* row, const float* cosPhi, const float* sinPhi, float sinTheta, float cosTheta, float weight, uint32_t width, double sums[9][3]);
+#endif
+
+// IEEE half floats, rounded to nearest even, 8 values at a time with F16C when the CPU has it
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t value);
+void convertFloatToHalf(const float* src, uint16_t* dst, size_t count);
+
+#if defined(IMAGE_UTILS_F16C)
+// Compiled apart with AVX and F16C, only called after isF16cConversionSupported.
+// Converts the multiples of 8 values and returns the first index left to the scalar path
+bool isF16cConversionSupported();
+size_t convertFloatToHalfF16c(const float* src, uint16_t* dst, size_t count);
+#endif
@@ -0,0 +1,84 @@
+#include "ImageUtils.hpp"
+
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Compiled with AVX enabled, only called after isAvxSupported
+
+bool isAvxSupported()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    return avx && osxsave && (_xgetbv(0) & 0x6) == 0x6;
+#else
+    return __builtin_cpu_supports("avx");
+#endif
+}
+
+static float horizontalSum(__m256 v)
+{
+    const __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    const __m128 sum2 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+    return _mm_cvtss_f32(_mm_add_ss(sum2, _mm_shuffle_ps(sum2, sum2, 1)));
+}
+
+uint32_t accumulateSH9Avx(const float* row, const float* cosPhi, const float* sinPhi, float sinTheta, float cosTheta, float weight, uint32_t width, double sums[9][3])
+{
+    __m256 accumulators[9][3];
+    for (size_t k = 0; k < 9; k++) {
+        for (size_t c = 0; c < 3; c++) {
+            accumulators[k][c] = _mm256_setzero_ps();
+        }
+    }
+
+    const __m256 sinThetaV = _mm256_set1_ps(sinTheta);
+    const __m256 z = _mm256_set1_ps(cosTheta);
+    const __m256 weightV = _mm256_set1_ps(weight);
+    const __m256 y20 = _mm256_set1_ps(SH_Y20 * (3.f * cosTheta * cosTheta - 1.f));
+
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const __m256 dx = _mm256_mul_ps(sinThetaV, _mm256_loadu_ps(cosPhi + x));
+        const __m256 dy = _mm256_mul_ps(sinThetaV, _mm256_loadu_ps(sinPhi + x));
+
+        __m256 basis[9];
+        basis[0] = _mm256_set1_ps(SH_Y00);
+        basis[1] = _mm256_mul_ps(_mm256_set1_ps(SH_Y1), dy);
+        basis[2] = _mm256_mul_ps(_mm256_set1_ps(SH_Y1), z);
+        basis[3] = _mm256_mul_ps(_mm256_set1_ps(SH_Y1), dx);
+        basis[4] = _mm256_mul_ps(_mm256_set1_ps(SH_Y2), _mm256_mul_ps(dx, dy));
+        basis[5] = _mm256_mul_ps(_mm256_set1_ps(SH_Y2), _mm256_mul_ps(dy, z));
+        basis[6] = y20;
+        basis[7] = _mm256_mul_ps(_mm256_set1_ps(SH_Y2), _mm256_mul_ps(dx, z));
+        basis[8] = _mm256_mul_ps(_mm256_set1_ps(SH_Y22), _mm256_sub_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+
+        // Deinterleave the RGBA texels, already weighted
+        alignas(32) float channels[3][8];
+        for (size_t i = 0; i < 8; i++) {
+            for (size_t c = 0; c < 3; c++) {
+                channels[c][i] = row[4 * (x + i) + c];
+            }
+        }
+
+        for (size_t c = 0; c < 3; c++) {
+            const __m256 radiance = _mm256_mul_ps(_mm256_load_ps(channels[c]), weightV);
+            for (size_t k = 0; k < 9; k++) {
+                accumulators[k][c] = _mm256_add_ps(accumulators[k][c], _mm256_mul_ps(basis[k], radiance));
+            }
+        }
+    }
+
+    for (size_t k = 0; k < 9; k++) {
+        for (size_t c = 0; c < 3; c++) {
+            sums[k][c] += static_cast<double>(horizontalSum(accumulators[k][c]));
+        }
+    }
+
+    return x;
+}
@@ -0,0 +1,144 @@
+#include "MeshOrdering.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
+#include <unordered_map>
+
+// Spreads the 10 low bits of v, two zero bits between each
+static uint32_t expandBits(uint32_t v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+uint32_t getMortonCode(const glm::vec3& normalized)
+{
+    const glm::vec3 p = glm::clamp(normalized * 1024.f, glm::vec3(0.f), glm::vec3(1023.f));
+    return (expandBits(static_cast<uint32_t>(p.x)) << 2) | (expandBits(static_cast<uint32_t>(p.y)) << 1) | expandBits(static_cast<uint32_t>(p.z));
+}
+
+std::vector<uint32_t> getMortonOrder(const std::vector<glm::vec3>& positions, const uint32_t* indices, size_t indexCount)
+{
+    const size_t triangleCount = indexCount / 3;
+
+    std::vector<glm::vec3> centroids(triangleCount);
+    glm::vec3 min(FLT_MAX);
+    glm::vec3 max(-FLT_MAX);
+    for (size_t t = 0; t < triangleCount; t++) {
+        centroids[t] = (positions[indices[3 * t]] + positions[indices[3 * t + 1]] + positions[indices[3 * t + 2]]) / 3.f;
+        min = glm::min(min, centroids[t]);
+        max = glm::max(max, centroids[t]);
+    }
+
+    // Same scale on every axis, so the curve does not favor the flat axes of the mesh
+    const float extent = std::max(std::max(max.x - min.x, max.y - min.y), std::max(max.z - min.z, FLT_MIN));
+
+    std::vector<uint32_t> codes(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        codes[t] = getMortonCode((centroids[t] - min) / extent);
+    }
+
+    std::vector<uint32_t> order(triangleCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&codes](uint32_t a, uint32_t b) {
+        return codes[a] < codes[b];
+    });
+
+    return order;
+}
+
+std::vector<uint32_t> getFirstUseOrder(const std::vector<uint32_t>& indices, size_t vertexCount)
+{
+    std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+    uint32_t next = 0;
+
+    for (uint32_t index : indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = next++;
+        }
+    }
+    for (size_t v = 0; v < vertexCount; v++) {
+        if (remap[v] == UINT32_MAX) {
+            remap[v] = next++;
+        }
+    }
+
+    return remap;
+}
+
+float FetchStatistics::getUtilization(size_t lineSize) const
+{
+    return fetchedLines > 0 ? static_cast<float>(usedBytes) / static_cast<float>(fetchedLines * lineSize) : 1.f;
+}
+
+FetchStatistics simulateFetches(const std::vector<uint32_t>& elements, size_t elementSize)
+{
+    // Bytes are tracked by 4, up to 32 words per line
+    static_assert(FETCH_CACHE_LINE_SIZE / 4 <= 32, "A cache line must fit in the word mask");
+
+    struct Line {
+        uint64_t address;
+        uint32_t usedWords;
+        uint64_t lastUse;
+    };
+
+    FetchStatistics statistics {};
+    std::vector<Line> lines;
+    std::unordered_map<uint64_t, size_t> slots;
+    uint64_t time = 0;
+
+    auto evict = [&statistics](const Line& line) {
+        size_t words = 0;
+        for (uint32_t mask = line.usedWords; mask != 0; mask &= mask - 1) {
+            words++;
+        }
+        statistics.usedBytes += 4 * words;
+    };
+
+    for (uint32_t element : elements) {
+        const uint64_t begin = static_cast<uint64_t>(element) * elementSize;
+        const uint64_t end = begin + elementSize;
+
+        for (uint64_t address = begin / FETCH_CACHE_LINE_SIZE; address * FETCH_CACHE_LINE_SIZE < end; address++) {
+            auto it = slots.find(address);
+            if (it == slots.end()) {
+                statistics.fetchedLines++;
+
+                size_t slot = lines.size();
+                if (lines.size() < FETCH_CACHE_LINES) {
+                    lines.push_back({});
+                } else {
+                    slot = std::min_element(lines.begin(), lines.end(), [](const Line& a, const Line& b) {
+                        return a.lastUse < b.lastUse;
+                    }) - lines.begin();
+                    evict(lines[slot]);
+                    slots.erase(lines[slot].address);
+                }
+
+                lines[slot] = { address, 0u, 0u };
+                it = slots.emplace(address, slot).first;
+            }
+
+            Line& line = lines[it->second];
+            line.lastUse = time;
+
+            const uint64_t lineBegin = address * FETCH_CACHE_LINE_SIZE;
+            const uint64_t first = (std::max(begin, lineBegin) - lineBegin) / 4;
+            const uint64_t last = (std::min(end, lineBegin + FETCH_CACHE_LINE_SIZE) - lineBegin + 3) / 4;
+            for (uint64_t word = first; word < last; word++) {
+                line.usedWords |= 1u << word;
+            }
+        }
+        time++;
+    }
+
+    for (const Line& line : lines) {
+        evict(line);
+    }
+
+    return statistics;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Interleaves the bits of a point of the unit cube (10 bits per axis)
+uint32_t getMortonCode(const glm::vec3& normalized);
+
+// Order of the triangles of indices along the Morton curve of their centroids, within the bounds of the triangles
+std::vector<uint32_t> getMortonOrder(const std::vector<glm::vec3>& positions, const uint32_t* indices, size_t indexCount);
+
+// New index of every vertex, numbered in order of first use by the index buffer
+// Vertices that are never referenced come after all the used ones, in their original order
+std::vector<uint32_t> getFirstUseOrder(const std::vector<uint32_t>& indices, size_t vertexCount);
+
+// Cache lines brought by a sequence of element fetches, through a small LRU cache
+struct FetchStatistics {
+    size_t fetchedLines = 0;
+    size_t usedBytes = 0; // Distinct bytes read from each line while it was cached
+
+    float getUtilization(size_t lineSize) const;
+};
+
+constexpr size_t FETCH_CACHE_LINE_SIZE = 128;
+constexpr size_t FETCH_CACHE_LINES = 256;
+
+FetchStatistics simulateFetches(const std::vector<uint32_t>& elements, size_t elementSize);
@@ -0,0 +1,284 @@
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+// Sum of squared distances to a set of planes, as p.A.p + 2 b.p + c
+struct Quadric {
+    double xx = 0., xy = 0., xz = 0., yy = 0., yz = 0., zz = 0.;
+    double bx = 0., by = 0., bz = 0.;
+    double c = 0.;
+
+    void addPlane(const glm::dvec3& n, double d, double weight)
+    {
+        xx += weight * n.x * n.x;
+        xy += weight * n.x * n.y;
+        xz += weight * n.x * n.z;
+        yy += weight * n.y * n.y;
+        yz += weight * n.y * n.z;
+        zz += weight * n.z * n.z;
+        bx += weight * d * n.x;
+        by += weight * d * n.y;
+        bz += weight * d * n.z;
+        c += weight * d * d;
+    }
+
+    void add(const Quadric& q)
+    {
+        xx += q.xx;
+        xy += q.xy;
+        xz += q.xz;
+        yy += q.yy;
+        yz += q.yz;
+        zz += q.zz;
+        bx += q.bx;
+        by += q.by;
+        bz += q.bz;
+        c += q.c;
+    }
+
+    double evaluate(const glm::dvec3& p) const
+    {
+        const double ax = xx * p.x + xy * p.y + xz * p.z;
+        const double ay = xy * p.x + yy * p.y + yz * p.z;
+        const double az = xz * p.x + yz * p.y + zz * p.z;
+        return std::max(0., p.x * ax + p.y * ay + p.z * az + 2. * (bx * p.x + by * p.y + bz * p.z) + c);
+    }
+};
+
+struct PositionHash {
+    size_t operator()(const glm::vec3& p) const
+    {
+        uint32_t bits[3];
+        memcpy(bits, &p, sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+};
+
+struct Collapse {
+    double cost;
+    uint32_t from;
+    uint32_t to;
+};
+
+glm::vec3 getNormal(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2)
+{
+    return glm::cross(p1 - p0, p2 - p0);
+}
+
+}
+
+std::vector<uint32_t> simplifyMesh(const std::vector<glm::vec3>& positions, const uint32_t* indices, size_t indexCount, size_t targetIndexCount)
+{
+    // Weld the vertices by position, the simplification works on these welded vertices.
+    // A position shared by several vertices is on a UV or normal seam
+    std::unordered_map<glm::vec3, uint32_t, PositionHash> welded;
+    std::vector<glm::vec3> vertices;
+    std::vector<uint32_t> representatives;
+    std::vector<bool> seams;
+
+    const size_t triangleCount = indexCount / 3;
+    std::vector<std::array<uint32_t, 3>> triangles(triangleCount);
+    std::vector<std::array<uint32_t, 3>> corners(triangleCount);
+
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (size_t c = 0; c < 3; c++) {
+            const uint32_t index = indices[3 * t + c];
+            const auto it = welded.emplace(positions[index], static_cast<uint32_t>(vertices.size())).first;
+            if (it->second == vertices.size()) {
+                vertices.push_back(positions[index]);
+                representatives.push_back(index);
+                seams.push_back(false);
+            } else if (representatives[it->second] != index) {
+                seams[it->second] = true;
+            }
+            triangles[t][c] = it->second;
+            corners[t][c] = index;
+        }
+    }
+
+    // Triangles around each vertex, the lists keep removed triangles (filtered with alive)
+    std::vector<bool> alive(triangleCount, true);
+    std::vector<std::vector<uint32_t>> vertexTriangles(vertices.size());
+    std::vector<Quadric> quadrics(vertices.size());
+    size_t aliveCount = 0;
+
+    for (size_t t = 0; t < triangleCount; t++) {
+        const auto& tri = triangles[t];
+        if (tri[0] == tri[1] || tri[1] == tri[2] || tri[2] == tri[0]) {
+            alive[t] = false;
+            continue;
+        }
+        aliveCount++;
+
+        const glm::dvec3 normal = getNormal(vertices[tri[0]], vertices[tri[1]], vertices[tri[2]]);
+        const double length = glm::length(normal);
+        if (length > 0.) {
+            // Planes are weighted by the triangle area
+            const glm::dvec3 n = normal / length;
+            const double d = -glm::dot(n, glm::dvec3(vertices[tri[0]]));
+            for (size_t c = 0; c < 3; c++) {
+                quadrics[tri[c]].addPlane(n, d, 0.5 * length);
+            }
+        }
+
+        for (size_t c = 0; c < 3; c++) {
+            vertexTriangles[tri[c]].push_back(static_cast<uint32_t>(t));
+        }
+    }
+
+    // Vertices on open or non manifold edges are never moved, so borders and seams do not crack.
+    // Seam vertices are locked too, moving one would stretch the attributes of one side over the other
+    std::vector<bool> locked(seams);
+    {
+        std::unordered_map<uint64_t, uint32_t> edgeCounts;
+        for (size_t t = 0; t < triangleCount; t++) {
+            if (!alive[t]) {
+                continue;
+            }
+            for (size_t c = 0; c < 3; c++) {
+                const uint32_t a = std::min(triangles[t][c], triangles[t][(c + 1) % 3]);
+                const uint32_t b = std::max(triangles[t][c], triangles[t][(c + 1) % 3]);
+                edgeCounts[(static_cast<uint64_t>(a) << 32) | b]++;
+            }
+        }
+        for (const auto& edge : edgeCounts) {
+            if (edge.second != 2) {
+                locked[edge.first >> 32] = true;
+                locked[edge.first & 0xFFFFFFFFu] = true;
+            }
+        }
+    }
+
+    const size_t targetTriangleCount = targetIndexCount / 3;
+    std::vector<bool> touched(vertices.size());
+    std::vector<Collapse> collapses;
+
+    // Passes of independent collapses, cheapest first, until the target is reached or nothing can collapse
+    while (aliveCount > targetTriangleCount) {
+        collapses.clear();
+        for (size_t t = 0; t < triangleCount; t++) {
+            if (!alive[t]) {
+                continue;
+            }
+            for (size_t c = 0; c < 3; c++) {
+                const uint32_t a = triangles[t][c];
+                const uint32_t b = triangles[t][(c + 1) % 3];
+                // Every inner edge is seen from both of its triangles, keep one
+                if (a > b) {
+                    continue;
+                }
+
+                Quadric q = quadrics[a];
+                q.add(quadrics[b]);
+                if (!locked[a]) {
+                    collapses.push_back({ q.evaluate(vertices[b]), a, b });
+                }
+                if (!locked[b]) {
+                    collapses.push_back({ q.evaluate(vertices[a]), b, a });
+                }
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.cost < b.cost || (a.cost == b.cost && (a.from < b.from || (a.from == b.from && a.to < b.to)));
+        });
+
+        std::fill(touched.begin(), touched.end(), false);
+        size_t collapsed = 0;
+
+        for (const Collapse& collapse : collapses) {
+            if (aliveCount <= targetTriangleCount) {
+                break;
+            }
+            if (touched[collapse.from] || touched[collapse.to]) {
+                continue;
+            }
+
+            // Reject the collapse if a remaining triangle around the moved vertex would flip (or turn by more than ~75 degrees)
+            bool flips = false;
+            for (uint32_t t : vertexTriangles[collapse.from]) {
+                const auto& tri = triangles[t];
+                if (!alive[t] || tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) {
+                    continue;
+                }
+                std::array<glm::vec3, 3> moved = { vertices[tri[0]], vertices[tri[1]], vertices[tri[2]] };
+                const glm::vec3 before = getNormal(moved[0], moved[1], moved[2]);
+                for (size_t c = 0; c < 3; c++) {
+                    if (tri[c] == collapse.from) {
+                        moved[c] = vertices[collapse.to];
+                    }
+                }
+                const glm::vec3 after = getNormal(moved[0], moved[1], moved[2]);
+                if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after)) {
+                    flips = true;
+                    break;
+                }
+            }
+            if (flips) {
+                continue;
+            }
+
+            // The moved vertex is not on a seam, so its triangles take the vertex of the collapsed edge that is on their side
+            // of a seam going through the other end
+            uint32_t toCorner = representatives[collapse.to];
+            for (uint32_t t : vertexTriangles[collapse.from]) {
+                for (size_t c = 0; c < 3; c++) {
+                    if (alive[t] && triangles[t][c] == collapse.to) {
+                        toCorner = corners[t][c];
+                    }
+                }
+            }
+
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            for (uint32_t t : vertexTriangles[collapse.from]) {
+                if (!alive[t]) {
+                    continue;
+                }
+                auto& tri = triangles[t];
+                bool degenerate = false;
+                for (size_t c = 0; c < 3; c++) {
+                    if (tri[c] == collapse.to) {
+                        degenerate = true;
+                    }
+                }
+                if (degenerate) {
+                    alive[t] = false;
+                    aliveCount--;
+                    continue;
+                }
+                for (size_t c = 0; c < 3; c++) {
+                    if (tri[c] == collapse.from) {
+                        tri[c] = collapse.to;
+                        corners[t][c] = toCorner;
+                    }
+                }
+                vertexTriangles[collapse.to].push_back(t);
+            }
+            vertexTriangles[collapse.from].clear();
+
+            // Both ends changed, their other edges are re-evaluated in the next pass
+            touched[collapse.from] = true;
+            touched[collapse.to] = true;
+            collapsed++;
+        }
+
+        if (collapsed == 0) {
+            break;
+        }
+    }
+
+    std::vector<uint32_t> result;
+    result.reserve(aliveCount * 3);
+    for (size_t t = 0; t < triangleCount; t++) {
+        if (alive[t]) {
+            result.insert(result.end(), corners[t].begin(), corners[t].end());
+        }
+    }
+
+    return result;
+}
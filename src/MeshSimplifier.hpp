@@ -0,0 +1,13 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Quadric error metric simplification, from "Surface Simplification Using Quadric Error Metrics" (Garland and Heckbert)
+// Edges collapse onto one of their vertices, so the result still indexes the original vertex buffer.
+// Vertices sharing a position are welded for the topology, and open borders and UV or normal seams are kept in place.
+// Returns the indices of the simplified triangles, possibly more than targetIndexCount if no more edge could collapse.
+std::vector<uint32_t> simplifyMesh(const std::vector<glm::vec3>& positions, const uint32_t* indices, size_t indexCount, size_t targetIndexCount);
@@ -0,0 +1,227 @@
+#include "ObjLoader.hpp"
+#include "Application.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+// Number of faces converted at once by a worker, large enough to amortize the deduplication map
+constexpr size_t FACES_PER_CHUNK = 1 << 16;
+
+static float luminance(const tinyobj::real_t* color)
+{
+    return 0.2126f * color[0] + 0.7152f * color[1] + 0.0722f * color[2];
+}
+
+ObjLoader::ObjLoader(Application& app, const std::string& fileName)
+    : GltfLoader(app)
+    , _fileName(fileName)
+{
+}
+
+ObjLoader::~ObjLoader()
+{
+}
+
+void ObjLoader::load(std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer)
+{
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> objMaterials;
+    const std::string baseDir = _fileName.substr(0, _fileName.find_last_of("/\\") + 1);
+
+    bool ret = tinyobj::LoadObj(&attrib, &shapes, &objMaterials, &_warn, &_err, _fileName.c_str(), baseDir.c_str(), /* triangulate */ true);
+
+    if (!_warn.empty()) {
+        printf("Warn: %s\n", _warn.c_str());
+    }
+
+    if (!_err.empty()) {
+        printf("Err: %s\n", _err.c_str());
+    }
+
+    if (!ret) {
+        throw std::runtime_error("Failed to parse OBJ\n");
+    }
+
+    loadObjMaterials(objMaterials, baseDir);
+
+    // Split every shape in chunks of faces so big meshes are spread over all the workers
+    std::vector<FaceChunk> chunks;
+    for (size_t s = 0; s < shapes.size(); s++) {
+        const size_t nbFaces = shapes[s].mesh.indices.size() / 3;
+        for (size_t firstFace = 0; firstFace < nbFaces; firstFace += FACES_PER_CHUNK) {
+            FaceChunk chunk {};
+            chunk.shape = s;
+            chunk.firstFace = firstFace;
+            chunk.faceCount = std::min(FACES_PER_CHUNK, nbFaces - firstFace);
+            chunks.push_back(std::move(chunk));
+        }
+    }
+
+    const size_t nbWorkers = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, std::max<size_t>(chunks.size(), 1));
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < nbWorkers; w++) {
+        workers.emplace_back([&, w]() {
+            for (size_t c = w; c < chunks.size(); c += nbWorkers) {
+                convertChunk(chunks[c], attrib, shapes);
+            }
+        });
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // Merge the chunks in order, so the output does not depend on the number of workers
+    // and each shape keeps a contiguous range of vertices
+    GltfLoader::Node* node = nullptr;
+    for (size_t c = 0; c < chunks.size(); c++) {
+        const FaceChunk& chunk = chunks[c];
+        const uint32_t vertexStart = static_cast<uint32_t>(vertexBuffer.size());
+        const uint32_t firstIndex = static_cast<uint32_t>(indexBuffer.size());
+
+        vertexBuffer.insert(vertexBuffer.end(), chunk.vertices.begin(), chunk.vertices.end());
+        for (uint32_t index : chunk.indices) {
+            indexBuffer.push_back(index + vertexStart);
+        }
+
+        if (c == 0 || chunks[c - 1].shape != chunk.shape) {
+            _nodes.emplace_back(new GltfLoader::Node());
+            node = _nodes.back().get();
+            node->parent = nullptr;
+            node->matrix = glm::mat4(1.f);
+            _nbGeometries++;
+        }
+
+        const std::vector<int>& materialIds = shapes[chunk.shape].mesh.material_ids;
+        Primitive primitive {};
+        primitive.firstIndex = firstIndex;
+        primitive.indexCount = static_cast<uint32_t>(chunk.indices.size());
+        primitive.materialIndex = materialIds.empty() || materialIds[chunk.firstFace] < 0 ? _defaultMaterial : materialIds[chunk.firstFace];
+        node->mesh.primitives.push_back(primitive);
+
+        _nbPrimitives = std::max(_nbPrimitives, node->mesh.primitives.size());
+    }
+
+    createBuffers(indexBuffer, vertexBuffer);
+
+    // Add light that follows the player (starts at 0)
+    Light light {};
+    light.color = glm::vec4(1.f);
+    light.intensity = 10000.f;
+    light.pos = glm::vec3(0.f, 0.f, 0.f);
+
+    _lights.push_back(light);
+}
+
+void ObjLoader::loadObjMaterials(const std::vector<tinyobj::material_t>& objMaterials, const std::string& baseDir)
+{
+    // Gather the distinct texture paths, the texture cache also shares identical images between materials and models
+    std::vector<std::string> texturePaths;
+    auto getTextureIndex = [&texturePaths](const std::string& name) -> int32_t {
+        if (name.empty()) {
+            return -1;
+        }
+        auto it = std::find(texturePaths.begin(), texturePaths.end(), name);
+        if (it != texturePaths.end()) {
+            return static_cast<int32_t>(std::distance(texturePaths.begin(), it));
+        }
+        texturePaths.push_back(name);
+        return static_cast<int32_t>(texturePaths.size() - 1);
+    };
+
+    _materials.resize(objMaterials.size());
+    for (size_t i = 0; i < objMaterials.size(); i++) {
+        const tinyobj::material_t& objMaterial = objMaterials[i];
+        Material& material = _materials[i];
+
+        material.baseColorFactor = glm::vec4(glm::make_vec3(objMaterial.diffuse), objMaterial.dissolve);
+        material.baseColorTextureIndex = getTextureIndex(objMaterial.diffuse_texname);
+        // Only tangent space normal maps (norm) are supported, bump maps are height fields
+        material.normalTextureIndex = getTextureIndex(objMaterial.normal_texname);
+        material.ambientCoeff = luminance(objMaterial.ambient);
+        material.diffuseCoeff = 1.f;
+        material.specularCoeff = luminance(objMaterial.specular);
+        material.shininessCoeff = objMaterial.shininess;
+        material.refractionIndice = objMaterial.ior;
+
+        // Illumination models 3 and 5 enable ray traced reflections, weighted by the specular color
+        if (objMaterial.illum == 3 || objMaterial.illum == 5) {
+            material.reflexionCoeff = material.specularCoeff;
+        }
+
+        // Illumination models 4, 6, 7 and 9 are the transparent ones
+        if (objMaterial.illum == 4 || objMaterial.illum == 6 || objMaterial.illum == 7 || objMaterial.illum == 9) {
+            material.refractionCoeff = 1.f - objMaterial.dissolve;
+        }
+    }
+
+    // Faces without material use a neutral one
+    _defaultMaterial = static_cast<int32_t>(_materials.size());
+    _materials.push_back(Material());
+
+    _descriptorSets.resize(texturePaths.size());
+    _textures.resize(texturePaths.size());
+    for (size_t i = 0; i < texturePaths.size(); i++) {
+        _textures[i] = _app._textureCache.loadFromFile(baseDir + texturePaths[i], _app._samplers[0]);
+    }
+
+    // Normal maps the texture compressor stored as BC5 come back without their z
+    for (Material& material : _materials) {
+        if (material.normalTextureIndex >= 0 && _textures[material.normalTextureIndex]->getFormat() == VK_FORMAT_BC5_UNORM_BLOCK) {
+            material.normalTextureBC5 = 1;
+        }
+    }
+}
+
+void ObjLoader::convertChunk(FaceChunk& chunk, const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes) const
+{
+    const tinyobj::mesh_t& mesh = shapes[chunk.shape].mesh;
+    std::unordered_map<Vertex, uint32_t> uniqueVertices;
+
+    chunk.vertices.reserve(chunk.faceCount * 3);
+    chunk.indices.reserve(chunk.faceCount * 3);
+
+    for (size_t f = chunk.firstFace; f < chunk.firstFace + chunk.faceCount; f++) {
+        int32_t materialId = mesh.material_ids.empty() ? -1 : mesh.material_ids[f];
+        if (materialId < 0) {
+            materialId = _defaultMaterial;
+        }
+
+        std::array<glm::vec3, 3> positions;
+        for (size_t v = 0; v < 3; v++) {
+            positions[v] = glm::make_vec3(&attrib.vertices[3 * mesh.indices[3 * f + v].vertex_index]);
+        }
+        // Flat normal for files without normals, degenerate faces fall back to a fixed axis instead of NaN
+        const glm::vec3 faceCross = glm::cross(positions[1] - positions[0], positions[2] - positions[0]);
+        const float faceCrossLength2 = glm::dot(faceCross, faceCross);
+        const glm::vec3 faceNormal = faceCrossLength2 > 1e-12f ? faceCross / std::sqrt(faceCrossLength2) : glm::vec3(0.f, 1.f, 0.f);
+
+        for (size_t v = 0; v < 3; v++) {
+            const tinyobj::index_t& index = mesh.indices[3 * f + v];
+
+            Vertex vertex {};
+            vertex.pos = positions[v];
+            vertex.normal = index.normal_index >= 0 ? glm::make_vec3(&attrib.normals[3 * index.normal_index]) : faceNormal;
+            vertex.texCoord = index.texcoord_index >= 0 ? glm::vec2(attrib.texcoords[2 * index.texcoord_index], 1.f - attrib.texcoords[2 * index.texcoord_index + 1]) : glm::vec2(0.f);
+            vertex.color = attrib.colors.empty() ? glm::vec4(1.f) : glm::vec4(glm::make_vec3(&attrib.colors[3 * index.vertex_index]), 1.f);
+            vertex.materialId = glm::vec4(static_cast<float>(materialId), 0.f, 0.f, 0.f);
+
+            // apply transforms
+            vertex.pos = glm::vec3(CHANGE_COORDS * glm::vec4(vertex.pos, 1.0f));
+            vertex.normal = glm::normalize(glm::mat3(CHANGE_COORDS) * vertex.normal);
+
+            auto it = uniqueVertices.find(vertex);
+            if (it == uniqueVertices.end()) {
+                it = uniqueVertices.emplace(vertex, static_cast<uint32_t>(chunk.vertices.size())).first;
+                chunk.vertices.push_back(vertex);
+            }
+            chunk.indices.push_back(it->second);
+        }
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "gltfLoader.hpp"
+#include <tiny_obj_loader.h>
+
+#include <string>
+#include <vector>
+
+class ObjLoader : public GltfLoader {
+public:
+    ObjLoader(Application& app, const std::string& fileName);
+    ~ObjLoader();
+
+    virtual void load(std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer) override;
+
+private:
+    // Range of faces of one shape, converted by a single worker
+    struct FaceChunk {
+        size_t shape;
+        size_t firstFace;
+        size_t faceCount;
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    void loadObjMaterials(const std::vector<tinyobj::material_t>& objMaterials, const std::string& baseDir);
+    void convertChunk(FaceChunk& chunk, const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes) const;
+
+private:
+    std::string _fileName;
+    int32_t _defaultMaterial { -1 };
+};
@@ -1,6 +1,12 @@
 #include "RandomScene.hpp"
+#include "Application.hpp"
 
-#include <random>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
 #include <time.h>
 #include <vector>
 
@@ -122,10 +128,10 @@ static std::pair<std::vector<glm::vec3>, std::vector<uint32_t>> getDefaultIcosah
     return std::make_pair(std::vector(vertices.begin(), vertices.end()), std::vector(indices.begin(), indices.end()));
 }
 
-static std::pair<std::vector<glm::vec3>, std::vector<uint32_t>> tesselateIcosahedron(std::pair<std::vector<glm::vec3>, std::vector<uint32_t>> icosahedron)
+static std::pair<std::vector<glm::vec3>, std::vector<uint32_t>> tesselateIcosahedron(const std::pair<std::vector<glm::vec3>, std::vector<uint32_t>>& icosahedron)
 {
     std::vector<uint32_t> indices;
-    indices.resize(icosahedron.second.size() * 4);
+    indices.reserve(icosahedron.second.size() * 4);
     std::vector<glm::vec3> vertices(icosahedron.first.begin(), icosahedron.first.end());
 
     for (size_t i = 0; i < icosahedron.second.size(); i += 3) {
@@ -162,7 +168,7 @@ static std::pair<std::vector<glm::vec3>, std::vector<uint32_t>> tesselateIcosahe
     return std::make_pair(vertices, indices);
 }
 
-static std::vector<glm::vec3> computeNormals(std::pair<std::vector<glm::vec3>, std::vector<uint32_t>> verticesData)
+static std::vector<glm::vec3> computeNormals(const std::pair<std::vector<glm::vec3>, std::vector<uint32_t>>& verticesData)
 {
     std::vector<glm::vec3> normals;
     std::vector<size_t> vertexGeoCount;
@@ -194,6 +200,64 @@ static std::vector<glm::vec3> computeNormals(std::pair<std::vector<glm::vec3>, s
     return normals;
 }
 
+// Base shape copied by every generated object
+struct BaseMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<uint32_t> indices;
+
+    explicit BaseMesh(const std::pair<std::vector<glm::vec3>, std::vector<uint32_t>>& mesh)
+        : positions(mesh.first)
+        , normals(computeNormals(mesh))
+        , indices(mesh.second)
+    {
+    }
+};
+
+// Base meshes are built once, on first use
+static const BaseMesh& getIcosphere()
+{
+    static const BaseMesh icosphere = []() {
+        auto icosahedron = getDefaultIcosahedron();
+        constexpr size_t nbTesselation = 5;
+        for (size_t i = 0; i < nbTesselation; i++) {
+            icosahedron = tesselateIcosahedron(icosahedron);
+        }
+        return BaseMesh(icosahedron);
+    }();
+    return icosphere;
+}
+
+static const BaseMesh& getCube()
+{
+    static const BaseMesh cube(getDefaultCube());
+    return cube;
+}
+
+// Runs task(i) for every i in [0, count[ on all cores, by chunks of chunkSize
+// The result must not depend on which worker runs which i
+template <typename Task>
+static void parallelFor(size_t count, size_t chunkSize, const Task& task)
+{
+    const size_t nbChunks = (count + chunkSize - 1) / chunkSize;
+    std::atomic<size_t> nextChunk { 0 };
+
+    const size_t nbWorkers = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, std::max<size_t>(nbChunks, 1));
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < nbWorkers; w++) {
+        workers.emplace_back([&]() {
+            for (size_t chunk = nextChunk++; chunk < nbChunks; chunk = nextChunk++) {
+                for (size_t i = chunk * chunkSize; i < std::min(count, (chunk + 1) * chunkSize); i++) {
+                    task(i);
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
 RandomScene::RandomScene(Application& app, float sceneSize, uint32_t scale, uint32_t seed)
     : GltfLoader(app)
     , _sceneSize(sceneSize)
@@ -201,14 +265,14 @@ RandomScene::RandomScene(Application& app, float sceneSize, uint32_t scale, uint
     if (seed == -1) {
         seed = static_cast<uint32_t>(time(NULL));
     }
-    // Init rand
-    srand(seed);
+    _seed = seed;
 
     // Generate all items counts
-    const size_t nbLights = static_cast<size_t>(rand() % (scale / 4)) + 1;
-    const size_t nbMaterials = 3 * static_cast<size_t>(rand() % (scale)) + scale * 3 / 4;
-    const size_t nbSpheres = static_cast<size_t>(rand() % scale) + scale / 2;
-    const size_t nbBoxes = static_cast<size_t>(rand() % scale) + scale / 2;
+    RandomStream random = getStream(Stream::Counts);
+    const size_t nbLights = static_cast<size_t>(random.next(std::max(scale / 4, 1u))) + 1;
+    const size_t nbMaterials = 3 * static_cast<size_t>(random.next(scale)) + scale * 3 / 4;
+    const size_t nbSpheres = static_cast<size_t>(random.next(scale)) + scale / 2;
+    const size_t nbBoxes = static_cast<size_t>(random.next(scale)) + scale / 2;
 
     // Generate lighting and materials
     generateLighting(nbLights, /* hasMovement */ true);
@@ -220,6 +284,10 @@ RandomScene::RandomScene(Application& app, float sceneSize, uint32_t scale, uint
     // generate all the objects
     generateSpheres(nbSpheres);
     generateBoxes(nbBoxes);
+
+    if (Application::getVerbose() > 0) {
+        std::cout << "Generated " << _indices.size() / 3 << " triangles and " << _spheres.size() << " procedural spheres from seed " << _seed << std::endl;
+    }
 }
 
 void RandomScene::load(std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer)
@@ -245,22 +313,42 @@ void RandomScene::update(float deltaTime)
     updateLights(deltaTime);
 }
 
+void RandomScene::trim()
+{
+    GltfLoader::trim();
+
+    // The generated geometry is only used for the upload
+    std::vector<Vertex>().swap(_vertices);
+    std::vector<uint32_t>().swap(_indices);
+}
+
+size_t RandomScene::getHostMemoryUsage() const
+{
+    return GltfLoader::getHostMemoryUsage() + _vertices.capacity() * sizeof(Vertex) + _indices.capacity() * sizeof(uint32_t);
+}
+
+RandomStream RandomScene::getStream(Stream stream, uint32_t index) const
+{
+    return RandomStream(_seed, (static_cast<uint64_t>(stream) << 32) | index);
+}
+
 void RandomScene::generateLighting(size_t nbLight, bool hasMovement)
 {
     _LightMouvement.resize(nbLight, std::make_pair(0, glm::vec3(1., 0., 0.)));
     // Possibly generate different type of lights
     // Generate nb of lights and applie transform
     for (size_t i = 0; i < nbLight; i++) {
+        RandomStream random = getStream(Stream::Lights, static_cast<uint32_t>(i));
         if (hasMovement) {
             // set speed
-            _LightMouvement[i].first = glm::radians(static_cast<float>(rand() % 500) / 100000.);
-            _LightMouvement[i].second = glm::normalize(glm::vec3(static_cast<float>(rand() % 10000) / 10000., static_cast<float>(rand() % 10000) / 10000., static_cast<float>(rand() % 10000) / 10000.));
+            _LightMouvement[i].first = glm::radians(0.005f * random.nextFloat());
+            _LightMouvement[i].second = glm::normalize(glm::vec3(random.nextFloat(), random.nextFloat(), random.nextFloat()) + glm::vec3(1e-4f));
         }
         Light light;
         // Generate random color
-        light.color = glm::vec4(static_cast<float>(rand() % 10000) / 10000.f, static_cast<float>(rand() % 10000) / 10000.f, static_cast<float>(rand() % 10000) / 10000.f, 1.f);
-        light.intensity = static_cast<float>(rand() % 5000) / 5000.f + .5f;
-        light.pos = getRandomTransformation() * glm::vec4(0.f, 0.f, 0.f, 1.f);
+        light.color = glm::vec4(random.nextFloat(), random.nextFloat(), random.nextFloat(), 1.f);
+        light.intensity = random.nextFloat() + .5f;
+        light.pos = getRandomTransformation(random) * glm::vec4(0.f, 0.f, 0.f, 1.f);
         _lights.push_back(light);
     }
 }
@@ -277,16 +365,16 @@ void RandomScene::generateMaterials(size_t nbMaterials)
 
     // Generate random Base color
     for (size_t i = 0; i < nbMaterials; i++) {
+        RandomStream random = getStream(Stream::Materials, static_cast<uint32_t>(i));
         Material mat;
-        mat.baseColorFactor = glm::vec4(static_cast<float>(rand() % 10000) / 10000.f, static_cast<float>(rand() % 10000) / 10000.f, static_cast<float>(rand() % 10000) / 10000.f, 1.f);
+        mat.baseColorFactor = glm::vec4(random.nextFloat(), random.nextFloat(), random.nextFloat(), 1.f);
         mat.baseColorTextureIndex = -1;
         mat.normalTextureIndex = -1;
-        mat.ambientCoeff = static_cast<float>(rand() % 50000) / 10000.f + 0.5;
-        mat.diffuseCoeff = static_cast<float>(rand() % 50000) / 10000.f + 0.5;
-        mat.reflexionCoeff = static_cast<float>(rand() % 10000) / 10000.f;
-        mat.shininessCoeff = static_cast<float>(rand() % 20);
-        mat.specularCoeff = static_cast<float>(rand() % 50000) / 10000.f + 0.5;
-        ;
+        mat.ambientCoeff = 5.f * random.nextFloat() + 0.5f;
+        mat.diffuseCoeff = 5.f * random.nextFloat() + 0.5f;
+        mat.reflexionCoeff = random.nextFloat();
+        mat.shininessCoeff = static_cast<float>(random.next(20));
+        mat.specularCoeff = 5.f * random.nextFloat() + 0.5f;
 
         _materials.push_back(mat);
     }
@@ -296,94 +384,111 @@ void RandomScene::generateMaterials(size_t nbMaterials)
 
 void RandomScene::generateSpheres(size_t nbSpheres)
 {
-    // Generate Icosahedron
-    auto simpleIcosahedron = getDefaultIcosahedron();
-
-    // Tesselate Icosahedron
-    constexpr size_t nbTesselation = 5;
-    for (size_t i = 0; i < nbTesselation; i++) {
-        simpleIcosahedron = tesselateIcosahedron(simpleIcosahedron);
+    if (USE_PROCEDURAL_SPHERES) {
+        const size_t firstSphere = _spheres.size();
+        _spheres.resize(firstSphere + nbSpheres);
+
+        parallelFor(nbSpheres, 256, [&](size_t i) {
+            // Same random draws as the tessellated spheres, so a seed gives the same scene in both modes
+            const RandomObject object = getRandomObject(Stream::Spheres, i, 4.f, 0.8f);
+            const glm::quat rotation = glm::quat_cast(glm::mat3(object.transform));
+
+            Sphere& sphere = _spheres[firstSphere + i];
+            sphere.center = glm::vec3(object.transform[3]);
+            sphere.materialIndex = static_cast<int32_t>(object.materialId);
+            sphere.rotation = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+            sphere.radii = glm::vec3(object.scale[0][0], object.scale[1][1], object.scale[2][2]);
+        });
+        return;
     }
 
-    const auto normals = computeNormals(simpleIcosahedron);
+    generateObjects(getIcosphere(), nbSpheres, Stream::Spheres, 4.f, 0.8f);
+}
+
+void RandomScene::generateBoxes(size_t nbBoxes)
+{
+    generateObjects(getCube(), nbBoxes, Stream::Boxes, 10.f, 0.5f);
+}
 
-    for (size_t i = 0; i < nbSpheres; i++) {
+RandomScene::RandomObject RandomScene::getRandomObject(Stream stream, size_t index, float ratioRange, float minRatio) const
+{
+    RandomStream random = getStream(stream, static_cast<uint32_t>(index));
 
-        // Applie random scale trasform (ratio only)
-        const glm::vec3 ratios = { 1.f, static_cast<float>(rand() % 400) / 100. + 0.8f, static_cast<float>(rand() % 400) / 100. + 0.8f };
-        const glm::mat4 scaleMat = glm::scale(glm::identity<glm::mat4>(), glm::normalize(ratios));
+    RandomObject object {};
 
-        // applie random transfom
-        const auto randomTransform = getRandomTransformation();
+    // Applie random scale trasform (ratio only)
+    const glm::vec3 ratios = { 1.f, ratioRange * random.nextFloat() + minRatio, ratioRange * random.nextFloat() + minRatio };
+    object.scale = glm::scale(glm::identity<glm::mat4>(), glm::normalize(ratios));
 
-        // Create Actual Data
-        const size_t randomMaterialId = rand() % _materials.size();
+    // applie random transfom
+    object.transform = getRandomTransformation(random);
 
-        // Create Actual Data
-        size_t startVertexCount = _vertices.size();
-        size_t startIndicesCount = _indices.size();
+    object.materialId = random.next(static_cast<uint32_t>(_materials.size()));
 
-        std::vector<Vertex> vertices;
-        vertices.resize(simpleIcosahedron.first.size());
+    return object;
+}
 
-        for (size_t j = 0; j < vertices.size(); j++) {
-            Vertex& vertex = vertices[j];
+void RandomScene::generateObjects(const BaseMesh& mesh, size_t nbObjects, Stream stream, float ratioRange, float minRatio)
+{
+    if (USE_MESH_INSTANCING) {
+        // The base mesh is stored once in object space, every object is a TLAS instance with its own material
+        const size_t startVertexCount = _vertices.size();
+        const size_t startIndicesCount = _indices.size();
+        for (size_t j = 0; j < mesh.positions.size(); j++) {
+            Vertex vertex {};
             vertex.color = glm::vec4(1.f);
-            vertex.pos = randomTransform * scaleMat * glm::vec4(simpleIcosahedron.first[j], 1.f);
-            vertex.normal = randomTransform * glm::vec4(normals[j], 0.f);
+            vertex.pos = mesh.positions[j];
+            vertex.normal = mesh.normals[j];
             vertex.texCoord = glm::vec2(0.f);
-            vertex.materialId = glm::vec4(randomMaterialId);
+            vertex.materialId = glm::vec4(0.f);
+            _vertices.push_back(vertex);
         }
-
-        std::vector<uint32_t> indices;
-        indices.resize(simpleIcosahedron.second.size());
-        for (size_t j = 0; j < indices.size(); j++) {
-            indices[j] = simpleIcosahedron.second[j] + startVertexCount;
+        for (uint32_t index : mesh.indices) {
+            _indices.push_back(static_cast<uint32_t>(index + startVertexCount));
         }
 
-        _vertices.insert(_vertices.end(), vertices.begin(), vertices.end());
-        _indices.insert(_indices.end(), indices.begin(), indices.end());
+        Node& node = addNode(static_cast<uint32_t>(startIndicesCount), static_cast<uint32_t>(mesh.indices.size()), -1);
+        node.instances.resize(nbObjects);
+        parallelFor(nbObjects, 256, [&](size_t i) {
+            const RandomObject object = getRandomObject(stream, i, ratioRange, minRatio);
+            node.instances[i] = { object.transform * object.scale, static_cast<int32_t>(object.materialId) };
+        });
+        return;
     }
-}
-
-void RandomScene::generateBoxes(size_t nbBoxes)
-{
 
-    // Create simple squarebox
-    const auto simpleBox = getDefaultCube();
-    for (size_t i = 0; i < nbBoxes; i++) {
-        // Applie random scale trasform (ratio only)
-        const glm::vec3 ratios = { 1.f, static_cast<float>(rand() % 1000) / 100. + 0.5, static_cast<float>(rand() % 1000) / 100. + 0.5 };
-        const glm::mat4 scaleMat = glm::scale(glm::identity<glm::mat4>(), glm::normalize(ratios));
-        const auto normals = computeNormals(simpleBox);
-        const auto randomTransform = getRandomTransformation();
+    // Every object has the size of the base mesh, so each one writes its own preallocated range
+    const size_t startVertexCount = _vertices.size();
+    const size_t startIndicesCount = _indices.size();
+    _vertices.resize(startVertexCount + nbObjects * mesh.positions.size());
+    _indices.resize(startIndicesCount + nbObjects * mesh.indices.size());
+    std::vector<uint32_t> materialIds(nbObjects);
 
-        const size_t randomMaterialId = rand() % _materials.size();
+    // Chunks of a few thousand vertices
+    const size_t chunkSize = std::max<size_t>(4096 / mesh.positions.size(), 1);
+    parallelFor(nbObjects, chunkSize, [&](size_t i) {
+        const RandomObject object = getRandomObject(stream, i, ratioRange, minRatio);
+        materialIds[i] = object.materialId;
 
         // Create Actual Data
-        size_t startVertexCount = _vertices.size();
-        size_t startIndicesCount = _indices.size();
-
-        std::vector<Vertex> vertices;
-        vertices.resize(simpleBox.first.size());
-
-        for (size_t j = 0; j < vertices.size(); j++) {
-            Vertex& vertex = vertices[j];
+        const size_t firstVertex = startVertexCount + i * mesh.positions.size();
+        for (size_t j = 0; j < mesh.positions.size(); j++) {
+            Vertex& vertex = _vertices[firstVertex + j];
             vertex.color = glm::vec4(1.f);
-            vertex.pos = randomTransform * scaleMat * glm::vec4(simpleBox.first[j], 1.f);
-            vertex.normal = randomTransform * glm::vec4(normals[j], 0.f);
+            vertex.pos = object.transform * object.scale * glm::vec4(mesh.positions[j], 1.f);
+            vertex.normal = object.transform * glm::vec4(mesh.normals[j], 0.f);
             vertex.texCoord = glm::vec2(0.f);
-            vertex.materialId = glm::vec4(randomMaterialId);
+            vertex.materialId = glm::vec4(static_cast<float>(object.materialId));
         }
 
-        std::vector<uint32_t> indices;
-        indices.resize(simpleBox.second.size());
-        for (size_t j = 0; j < indices.size(); j++) {
-            indices[j] = simpleBox.second[j] + startVertexCount;
+        const size_t firstIndex = startIndicesCount + i * mesh.indices.size();
+        for (size_t j = 0; j < mesh.indices.size(); j++) {
+            _indices[firstIndex + j] = static_cast<uint32_t>(mesh.indices[j] + firstVertex);
         }
+    });
 
-        _vertices.insert(_vertices.end(), vertices.begin(), vertices.end());
-        _indices.insert(_indices.end(), indices.begin(), indices.end());
+    // Nodes are added in order, they do not depend on the number of workers either
+    for (size_t i = 0; i < nbObjects; i++) {
+        addNode(static_cast<uint32_t>(startIndicesCount + i * mesh.indices.size()), static_cast<uint32_t>(mesh.indices.size()), static_cast<int32_t>(materialIds[i]));
     }
 }
 
@@ -396,7 +501,8 @@ void RandomScene::generateFloor()
     // Scale it to _sceneSize
     const auto scaleMat = glm::scale(glm::identity<glm::mat4>(), glm::vec3(_sceneSize * 2));
 
-    const size_t randomMaterialId = rand() % _materials.size();
+    RandomStream random = getStream(Stream::Floor);
+    const size_t randomMaterialId = random.next(static_cast<uint32_t>(_materials.size()));
 
     // Create Actual Data
     size_t startVertexCount = _vertices.size();
@@ -422,15 +528,19 @@ void RandomScene::generateFloor()
 
     _vertices.insert(_vertices.end(), vertices.begin(), vertices.end());
     _indices.insert(_indices.end(), indices.begin(), indices.end());
+    addNode(static_cast<uint32_t>(startIndicesCount), static_cast<uint32_t>(indices.size()), static_cast<int32_t>(randomMaterialId));
 }
 
-glm::mat4 RandomScene::getRandomTransformation() const
+glm::mat4 RandomScene::getRandomTransformation(RandomStream& random) const
 {
     // Get random Rotate
-    glm::mat4 transform = glm::rotate(glm::identity<glm::mat4>(), glm::radians(static_cast<float>(rand() % 360)), glm::normalize(glm::vec3(rand(), rand(), rand())));
+    const float angle = glm::radians(360.f * random.nextFloat());
+    const glm::vec3 axis = glm::normalize(glm::vec3(random.nextFloat(), random.nextFloat(), random.nextFloat()) + glm::vec3(1e-4f));
+    glm::mat4 transform = glm::rotate(glm::identity<glm::mat4>(), angle, axis);
 
     // Add Transform
-    transform = glm::translate(glm::identity<glm::mat4>(), glm::vec3(fmod(rand(), _sceneSize) - _sceneSize / 2.f, fmod(rand(), _sceneSize) - _sceneSize / 2.f, fmod(rand(), _sceneSize / 2.f))) * transform;
+    const glm::vec3 translation = { _sceneSize * (random.nextFloat() - 0.5f), _sceneSize * (random.nextFloat() - 0.5f), 0.5f * _sceneSize * random.nextFloat() };
+    transform = glm::translate(glm::identity<glm::mat4>(), translation) * transform;
 
     return transform;
 }
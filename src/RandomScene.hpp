@@ -1,10 +1,13 @@
 #pragma once
 
+#include "RandomStream.hpp"
 #include "gltfLoader.hpp"
 #include <glm/glm.hpp>
 
 #include <vector>
 
+struct BaseMesh;
+
 class RandomScene : public GltfLoader {
 public:
     RandomScene(Application& app, float sceneSize, uint32_t scale = 10, uint32_t seed = -1);
@@ -12,17 +15,40 @@ public:
     void updateLights(float deltaTime);
     ~RandomScene();
     virtual void update(float deltaTime) override;
+    virtual void trim() override;
+    virtual size_t getHostMemoryUsage() const override;
 
 private:
+    // Every generated item draws from its own stream, indexed by the item
+    enum class Stream : uint32_t {
+        Counts,
+        Lights,
+        Materials,
+        Floor,
+        Spheres,
+        Boxes,
+    };
+
+    // Scale, placement and material of one sphere or box, the same draws for every representation
+    struct RandomObject {
+        glm::mat4 scale;
+        glm::mat4 transform;
+        uint32_t materialId;
+    };
+
+    RandomStream getStream(Stream stream, uint32_t index = 0) const;
+    RandomObject getRandomObject(Stream stream, size_t index, float ratioRange, float minRatio) const;
     void generateLighting(size_t nbLight, bool hasMovement = false);
     void generateMaterials(size_t nbMaterials);
     void generateSpheres(size_t nbSpheres);
     void generateBoxes(size_t nbBoxes);
+    void generateObjects(const BaseMesh& mesh, size_t nbObjects, Stream stream, float ratioRange, float minRatio);
     void generateFloor();
-    glm::mat4 getRandomTransformation() const;
+    glm::mat4 getRandomTransformation(RandomStream& random) const;
 
 private:
     float _sceneSize;
+    uint32_t _seed;
     std::vector<Vertex> _vertices;
     std::vector<uint32_t> _indices;
     std::vector<std::pair<float, glm::vec3>> _LightMouvement;
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+// Counter based random numbers : the n-th draw of a stream is a hash of (seed, stream, n)
+// Streams do not share any state, so they can be consumed on any thread and in any order
+class RandomStream {
+public:
+    RandomStream(uint32_t seed, uint64_t stream)
+        : _key(mix(mix(seed) ^ stream))
+    {
+    }
+
+    uint32_t next()
+    {
+        return static_cast<uint32_t>(mix(_key + 0x9E3779B97F4A7C15ull * ++_counter) >> 32);
+    }
+
+    // In [0, bound)
+    uint32_t next(uint32_t bound)
+    {
+        return static_cast<uint32_t>((static_cast<uint64_t>(next()) * bound) >> 32);
+    }
+
+    // In [0, 1)
+    float nextFloat()
+    {
+        return static_cast<float>(next() >> 8) / 16777216.f;
+    }
+
+private:
+    // SplitMix64 finalizer
+    static uint64_t mix(uint64_t x)
+    {
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+private:
+    uint64_t _key;
+    uint64_t _counter { 0 };
+};
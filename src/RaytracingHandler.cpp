@@ -1,6 +1,9 @@
 #include "Application.hpp"
 #include "RaytracingHandler.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 
 RaytracingHandler::RaytracingHandler(Application& app)
     : _app(app)
@@ -39,16 +42,43 @@ void RaytracingHandler::init()
     vkCreateRayTracingPipelinesKHR = reinterpret_cast<PFN_vkCreateRayTracingPipelinesKHR>(vkGetDeviceProcAddr(_app._device, "vkCreateRayTracingPipelinesKHR"));
 
     createBottomLevelAccelerationStructure();
+    if (!_app._model->_spheres.empty()) {
+        createProceduralAccelerationStructure();
+    }
     createTopLevelAccelerationStructure();
 }
 
 void RaytracingHandler::cleanupRaytracingHandler()
 {
-    vkDestroyAccelerationStructureKHR(_app._device, bottomLevelAS.accelerationStructure, nullptr);
+    if (bottomLevelAS.accelerationStructure != VK_NULL_HANDLE) {
+        vkDestroyAccelerationStructureKHR(_app._device, bottomLevelAS.accelerationStructure, nullptr);
+    }
     vkDestroyAccelerationStructureKHR(_app._device, topLevelAS.accelerationStructure, nullptr);
+    if (proceduralAS.accelerationStructure != VK_NULL_HANDLE) {
+        vkDestroyAccelerationStructureKHR(_app._device, proceduralAS.accelerationStructure, nullptr);
+    }
 
     deleteObjectMemory(bottomLevelAS.objectMemory);
+    deleteObjectMemory(proceduralAS.objectMemory);
     deleteObjectMemory(topLevelAS.objectMemory);
+
+    for (auto& levels : lodLevelsAS) {
+        for (auto& level : levels) {
+            vkDestroyAccelerationStructureKHR(_app._device, level.accelerationStructure, nullptr);
+            deleteObjectMemory(level.objectMemory);
+        }
+    }
+    lodLevelsAS.clear();
+
+    deleteScratchBuffer(_topLevelScratchBuffer);
+    for (size_t i = 0; i < _instancesBuffers.size(); i++) {
+        vkDestroyBuffer(_app._device, _instancesBuffers[i].buffer, nullptr);
+        vkFreeMemory(_app._device, _instancesBuffers[i].memory, nullptr);
+        vkDestroyBuffer(_app._device, _instanceTrianglesBuffers[i].buffer, nullptr);
+        vkFreeMemory(_app._device, _instanceTrianglesBuffers[i].memory, nullptr);
+    }
+    _instancesBuffers.clear();
+    _instanceTrianglesBuffers.clear();
 }
 
 void RaytracingHandler::createBottomLevelAccelerationStructure()
@@ -56,18 +86,74 @@ void RaytracingHandler::createBottomLevelAccelerationStructure()
     VkDeviceOrHostAddressConstKHR vertexBufferDeviceAddress {};
     VkDeviceOrHostAddressConstKHR indexBufferDeviceAddress {};
 
-    vertexBufferDeviceAddress.deviceAddress = getBufferDeviceAddress(_app._model->_vertices.buffer);
+    vertexBufferDeviceAddress.deviceAddress = getBufferDeviceAddress(_app._model->_positions.buffer);
     indexBufferDeviceAddress.deviceAddress = getBufferDeviceAddress(_app._model->_indices.buffer);
 
     VkAccelerationStructureCreateGeometryTypeInfoKHR accelerationCreateGeometryInfo {};
     accelerationCreateGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_GEOMETRY_TYPE_INFO_KHR;
     accelerationCreateGeometryInfo.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
-    accelerationCreateGeometryInfo.maxPrimitiveCount = static_cast<uint32_t>(_app._indices.size() / 3);
+    accelerationCreateGeometryInfo.maxPrimitiveCount = static_cast<uint32_t>(_app._model->_indices.count / 3);
     accelerationCreateGeometryInfo.indexType = VK_INDEX_TYPE_UINT32;
-    accelerationCreateGeometryInfo.maxVertexCount = static_cast<uint32_t>(_app._vertices.size());
+    accelerationCreateGeometryInfo.maxVertexCount = static_cast<uint32_t>(_app._model->_vertexCount);
     accelerationCreateGeometryInfo.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
     accelerationCreateGeometryInfo.allowsTransforms = VK_FALSE;
 
+    VkAccelerationStructureGeometryKHR accelerationStructureGeometry {};
+    accelerationStructureGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+    accelerationStructureGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+    accelerationStructureGeometry.geometryType = accelerationCreateGeometryInfo.geometryType;
+    accelerationStructureGeometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+    accelerationStructureGeometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
+    accelerationStructureGeometry.geometry.triangles.vertexData.deviceAddress = vertexBufferDeviceAddress.deviceAddress;
+    accelerationStructureGeometry.geometry.triangles.vertexStride = sizeof(glm::vec3);
+    accelerationStructureGeometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT32;
+    accelerationStructureGeometry.geometry.triangles.indexData.deviceAddress = indexBufferDeviceAddress.deviceAddress;
+
+    if (_app._model->_meshLods.empty()) {
+        buildBottomLevelAccelerationStructure(accelerationCreateGeometryInfo, accelerationStructureGeometry, bottomLevelAS);
+        return;
+    }
+
+    // One BLAS per level of every mesh, they share the vertex and index buffers
+    // Instances of a mesh all reference these BLAS, each one at the level of its own distance
+    const glm::vec3& viewPosition = _app._character.getPosition();
+    lodLevelsAS.resize(_app._model->_meshLods.size());
+    _selectedLevels.clear();
+    for (size_t m = 0; m < _app._model->_meshLods.size(); m++) {
+        const GltfLoader::MeshLod& mesh = _app._model->_meshLods[m];
+        lodLevelsAS[m].resize(mesh.levels.size());
+        for (size_t l = 0; l < mesh.levels.size(); l++) {
+            accelerationCreateGeometryInfo.maxPrimitiveCount = mesh.levels[l].indexCount / 3;
+            buildBottomLevelAccelerationStructure(accelerationCreateGeometryInfo, accelerationStructureGeometry, lodLevelsAS[m][l], mesh.levels[l].firstIndex * sizeof(uint32_t));
+        }
+        for (const GltfLoader::MeshInstance& instance : mesh.instances) {
+            _selectedLevels.push_back(selectLevel(mesh, instance, viewPosition, 0));
+        }
+    }
+}
+
+void RaytracingHandler::createProceduralAccelerationStructure()
+{
+    // One AABB per analytic sphere, the hit itself is computed by the intersection shader
+    VkAccelerationStructureCreateGeometryTypeInfoKHR accelerationCreateGeometryInfo {};
+    accelerationCreateGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_GEOMETRY_TYPE_INFO_KHR;
+    accelerationCreateGeometryInfo.geometryType = VK_GEOMETRY_TYPE_AABBS_KHR;
+    accelerationCreateGeometryInfo.maxPrimitiveCount = static_cast<uint32_t>(_app._model->_spheres.size());
+    accelerationCreateGeometryInfo.allowsTransforms = VK_FALSE;
+
+    VkAccelerationStructureGeometryKHR accelerationStructureGeometry {};
+    accelerationStructureGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+    accelerationStructureGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+    accelerationStructureGeometry.geometryType = accelerationCreateGeometryInfo.geometryType;
+    accelerationStructureGeometry.geometry.aabbs.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_AABBS_DATA_KHR;
+    accelerationStructureGeometry.geometry.aabbs.data.deviceAddress = getBufferDeviceAddress(_app._model->_sphereAabbs.buffer);
+    accelerationStructureGeometry.geometry.aabbs.stride = sizeof(VkAabbPositionsKHR);
+
+    buildBottomLevelAccelerationStructure(accelerationCreateGeometryInfo, accelerationStructureGeometry, proceduralAS);
+}
+
+void RaytracingHandler::buildBottomLevelAccelerationStructure(const VkAccelerationStructureCreateGeometryTypeInfoKHR& accelerationCreateGeometryInfo, const VkAccelerationStructureGeometryKHR& accelerationStructureGeometry, AccelerationStructure& accelerationStructure, uint32_t primitiveOffset)
+{
     VkAccelerationStructureCreateInfoKHR accelerationCI {};
     accelerationCI.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
     accelerationCI.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
@@ -75,43 +161,31 @@ void RaytracingHandler::createBottomLevelAccelerationStructure()
     accelerationCI.maxGeometryCount = 1;
     accelerationCI.pGeometryInfos = &accelerationCreateGeometryInfo;
 
-    if (vkCreateAccelerationStructureKHR(_app._device, &accelerationCI, nullptr, &bottomLevelAS.accelerationStructure) != VK_SUCCESS) {
+    if (vkCreateAccelerationStructureKHR(_app._device, &accelerationCI, nullptr, &accelerationStructure.accelerationStructure) != VK_SUCCESS) {
         throw std::runtime_error("failed to create bottom level acceleration structure!");
     }
 
-    bottomLevelAS.objectMemory = createObjectMemory(bottomLevelAS.accelerationStructure);
+    accelerationStructure.objectMemory = createObjectMemory(accelerationStructure.accelerationStructure);
 
     VkBindAccelerationStructureMemoryInfoKHR bindAccelerationMemoryInfo {};
     bindAccelerationMemoryInfo.sType = VK_STRUCTURE_TYPE_BIND_ACCELERATION_STRUCTURE_MEMORY_INFO_KHR;
-    bindAccelerationMemoryInfo.accelerationStructure = bottomLevelAS.accelerationStructure;
-    bindAccelerationMemoryInfo.memory = bottomLevelAS.objectMemory.memory;
+    bindAccelerationMemoryInfo.accelerationStructure = accelerationStructure.accelerationStructure;
+    bindAccelerationMemoryInfo.memory = accelerationStructure.objectMemory.memory;
 
     if (vkBindAccelerationStructureMemoryKHR(_app._device, 1, &bindAccelerationMemoryInfo) != VK_SUCCESS) {
         throw std::runtime_error("failed to bind bottom level acceleration structure memory info!");
     }
 
-    VkAccelerationStructureGeometryKHR accelerationStructureGeometry {};
-    accelerationStructureGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
-    accelerationStructureGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
-    accelerationStructureGeometry.geometryType = accelerationCreateGeometryInfo.geometryType;
-    accelerationStructureGeometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
-    accelerationStructureGeometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
-    accelerationStructureGeometry.geometry.triangles.vertexData.deviceAddress = vertexBufferDeviceAddress.deviceAddress;
-    accelerationStructureGeometry.geometry.triangles.vertexStride = sizeof(Vertex);
-    accelerationStructureGeometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT32;
-    accelerationStructureGeometry.geometry.triangles.indexData.deviceAddress = indexBufferDeviceAddress.deviceAddress;
-
-    std::vector<VkAccelerationStructureGeometryKHR> accelerationGeometries = { accelerationStructureGeometry };
-    VkAccelerationStructureGeometryKHR* accelerationStructureGeometries = accelerationGeometries.data();
+    const VkAccelerationStructureGeometryKHR* accelerationStructureGeometries = &accelerationStructureGeometry;
 
-    RayTracingScratchBuffer scratchBuffer = createScratchBuffer(bottomLevelAS.accelerationStructure);
+    RayTracingScratchBuffer scratchBuffer = createScratchBuffer(accelerationStructure.accelerationStructure);
 
     VkAccelerationStructureBuildGeometryInfoKHR accelerationBuildGeometryInfo {};
     accelerationBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
     accelerationBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
     accelerationBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
     accelerationBuildGeometryInfo.update = VK_FALSE;
-    accelerationBuildGeometryInfo.dstAccelerationStructure = bottomLevelAS.accelerationStructure;
+    accelerationBuildGeometryInfo.dstAccelerationStructure = accelerationStructure.accelerationStructure;
     accelerationBuildGeometryInfo.geometryArrayOfPointers = VK_FALSE;
     accelerationBuildGeometryInfo.geometryCount = 1;
     accelerationBuildGeometryInfo.ppGeometries = &accelerationStructureGeometries;
@@ -119,7 +193,7 @@ void RaytracingHandler::createBottomLevelAccelerationStructure()
 
     VkAccelerationStructureBuildOffsetInfoKHR accelerationBuildOffsetInfo {};
     accelerationBuildOffsetInfo.primitiveCount = accelerationCreateGeometryInfo.maxPrimitiveCount;
-    accelerationBuildOffsetInfo.primitiveOffset = 0x0;
+    accelerationBuildOffsetInfo.primitiveOffset = primitiveOffset;
     accelerationBuildOffsetInfo.firstVertex = 0;
     accelerationBuildOffsetInfo.transformOffset = 0x0;
 
@@ -137,19 +211,21 @@ void RaytracingHandler::createBottomLevelAccelerationStructure()
 
     VkAccelerationStructureDeviceAddressInfoKHR accelerationDeviceAddressInfo {};
     accelerationDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
-    accelerationDeviceAddressInfo.accelerationStructure = bottomLevelAS.accelerationStructure;
+    accelerationDeviceAddressInfo.accelerationStructure = accelerationStructure.accelerationStructure;
 
-    bottomLevelAS.handle = vkGetAccelerationStructureDeviceAddressKHR(_app._device, &accelerationDeviceAddressInfo);
+    accelerationStructure.handle = vkGetAccelerationStructureDeviceAddressKHR(_app._device, &accelerationDeviceAddressInfo);
 
     deleteScratchBuffer(scratchBuffer);
 }
 
 void RaytracingHandler::createTopLevelAccelerationStructure()
 {
+    const size_t nbInstances = getInstanceCount();
+
     VkAccelerationStructureCreateGeometryTypeInfoKHR accelerationCreateGeometryInfo {};
     accelerationCreateGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_GEOMETRY_TYPE_INFO_KHR;
     accelerationCreateGeometryInfo.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
-    accelerationCreateGeometryInfo.maxPrimitiveCount = 1;
+    accelerationCreateGeometryInfo.maxPrimitiveCount = static_cast<uint32_t>(nbInstances);
     accelerationCreateGeometryInfo.allowsTransforms = VK_FALSE;
 
     VkAccelerationStructureCreateInfoKHR accelerationCI {};
@@ -174,32 +250,53 @@ void RaytracingHandler::createTopLevelAccelerationStructure()
         throw std::runtime_error("Could not bind Accleration Strucute Memory for top level acceleration");
     }
 
-    VkTransformMatrixKHR transformMatrix = {
-        1.0f, 0.0f, 0.0f, 0.0f,
-        0.0f, 1.f, 0.f, 0.0f,
-        0.0f, 0.f, 1.f, 0.0f
-    };
+    // The scratch memory is kept, every frame rebuilds the TLAS in place from the instances of its swapchain image
+    const size_t nbImages = _app._swapchainImages.size();
+    _instancesBuffers.resize(nbImages);
+    _instanceTrianglesBuffers.resize(nbImages);
+    for (size_t i = 0; i < nbImages; i++) {
+        _app.createBuffer(nbInstances * sizeof(VkAccelerationStructureInstanceKHR), VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            _instancesBuffers[i].buffer, _instancesBuffers[i].memory);
+        _app.createBuffer(nbInstances * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            _instanceTrianglesBuffers[i].buffer, _instanceTrianglesBuffers[i].memory);
+        writeInstances(i);
+    }
+    _staleInstances.assign(nbImages, false);
+    _topLevelScratchBuffer = createScratchBuffer(topLevelAS.accelerationStructure);
 
-    VkAccelerationStructureInstanceKHR instance {};
-    instance.transform = transformMatrix;
-    instance.instanceCustomIndex = 0;
-    instance.mask = 0xFF;
-    instance.instanceShaderBindingTableRecordOffset = 0;
-    instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
-    instance.accelerationStructureReference = bottomLevelAS.handle;
+    VkAccelerationStructureDeviceAddressInfoKHR accelerationDeviceAddressInfo {};
+    accelerationDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+    accelerationDeviceAddressInfo.accelerationStructure = topLevelAS.accelerationStructure;
 
-    VkBuffer instancesBuffer;
-    VkDeviceMemory instancesBufferMemory;
-    _app.createBuffer(sizeof(instance), VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        instancesBuffer, instancesBufferMemory);
+    topLevelAS.handle = vkGetAccelerationStructureDeviceAddressKHR(_app._device, &accelerationDeviceAddressInfo);
+}
+
+void RaytracingHandler::writeInstances(size_t imageIndex)
+{
+    std::vector<VkAccelerationStructureInstanceKHR> instances;
+    std::vector<uint32_t> firstTriangles;
+    getInstances(instances, firstTriangles);
+    const VkDeviceSize instancesSize = instances.size() * sizeof(VkAccelerationStructureInstanceKHR);
+    const VkDeviceSize firstTrianglesSize = firstTriangles.size() * sizeof(uint32_t);
 
     void* data;
-    vkMapMemory(_app._device, instancesBufferMemory, 0, sizeof(instance), NULL, &data);
-    memcpy(data, &instance, static_cast<size_t>(sizeof(instance)));
-    vkUnmapMemory(_app._device, instancesBufferMemory);
+    vkMapMemory(_app._device, _instancesBuffers[imageIndex].memory, 0, instancesSize, NULL, &data);
+    memcpy(data, instances.data(), static_cast<size_t>(instancesSize));
+    vkUnmapMemory(_app._device, _instancesBuffers[imageIndex].memory);
+
+    vkMapMemory(_app._device, _instanceTrianglesBuffers[imageIndex].memory, 0, firstTrianglesSize, NULL, &data);
+    memcpy(data, firstTriangles.data(), static_cast<size_t>(firstTrianglesSize));
+    vkUnmapMemory(_app._device, _instanceTrianglesBuffers[imageIndex].memory);
+}
 
-    VkDeviceOrHostAddressConstKHR instanceDataDeviceAddress {};
-    instanceDataDeviceAddress.deviceAddress = getBufferDeviceAddress(instancesBuffer);
+void RaytracingHandler::recordTopLevelBuild(VkCommandBuffer commandBuffer, size_t imageIndex)
+{
+    // The previous frame may still trace the TLAS, or build it with the same scratch memory
+    VkMemoryBarrier barrier {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 
     VkAccelerationStructureGeometryKHR accelerationStructureGeometry {};
     accelerationStructureGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
@@ -207,13 +304,11 @@ void RaytracingHandler::createTopLevelAccelerationStructure()
     accelerationStructureGeometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
     accelerationStructureGeometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
     accelerationStructureGeometry.geometry.instances.arrayOfPointers = VK_FALSE;
-    accelerationStructureGeometry.geometry.instances.data.deviceAddress = instanceDataDeviceAddress.deviceAddress;
+    accelerationStructureGeometry.geometry.instances.data.deviceAddress = getBufferDeviceAddress(_instancesBuffers[imageIndex].buffer);
 
     std::vector<VkAccelerationStructureGeometryKHR> accelerationGeometries = { accelerationStructureGeometry };
     VkAccelerationStructureGeometryKHR* accelerationStructureGeometries = accelerationGeometries.data();
 
-    RayTracingScratchBuffer scratchBuffer = createScratchBuffer(topLevelAS.accelerationStructure);
-
     VkAccelerationStructureBuildGeometryInfoKHR accelerationBuildGeometryInfo {};
     accelerationBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
     accelerationBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
@@ -224,34 +319,133 @@ void RaytracingHandler::createTopLevelAccelerationStructure()
     accelerationBuildGeometryInfo.geometryArrayOfPointers = VK_FALSE;
     accelerationBuildGeometryInfo.geometryCount = 1;
     accelerationBuildGeometryInfo.ppGeometries = &accelerationStructureGeometries;
-    accelerationBuildGeometryInfo.scratchData.deviceAddress = scratchBuffer.deviceAddress;
+    accelerationBuildGeometryInfo.scratchData.deviceAddress = _topLevelScratchBuffer.deviceAddress;
 
     VkAccelerationStructureBuildOffsetInfoKHR accelerationBuildOffsetInfo {};
-    accelerationBuildOffsetInfo.primitiveCount = 1;
+    accelerationBuildOffsetInfo.primitiveCount = static_cast<uint32_t>(getInstanceCount());
     accelerationBuildOffsetInfo.primitiveOffset = 0x0;
     accelerationBuildOffsetInfo.firstVertex = 0;
     accelerationBuildOffsetInfo.transformOffset = 0x0;
     std::vector<VkAccelerationStructureBuildOffsetInfoKHR*> accelerationBuildOffsets = { &accelerationBuildOffsetInfo };
 
-    if (_rtFeatures.rayTracingHostAccelerationStructureCommands) {
-        if (vkBuildAccelerationStructureKHR(_app._device, 1, &accelerationBuildGeometryInfo, accelerationBuildOffsets.data()) != VK_SUCCESS) {
-            throw std::runtime_error("Could not build acceleration structure for top level");
+    vkCmdBuildAccelerationStructureKHR(commandBuffer, 1, &accelerationBuildGeometryInfo, accelerationBuildOffsets.data());
+
+    // The trace of this frame reads the new TLAS
+    barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+size_t RaytracingHandler::getInstanceCount() const
+{
+    // Every instance of every mesh (or the single scene BLAS), plus the analytic spheres
+    const size_t nbSpheres = proceduralAS.accelerationStructure != VK_NULL_HANDLE ? 1 : 0;
+    return std::max<size_t>(_selectedLevels.size(), 1) + nbSpheres;
+}
+
+void RaytracingHandler::getInstances(std::vector<VkAccelerationStructureInstanceKHR>& instances, std::vector<uint32_t>& firstTriangles) const
+{
+    VkTransformMatrixKHR transformMatrix = {
+        1.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 1.f, 0.f, 0.0f,
+        0.0f, 0.f, 1.f, 0.0f
+    };
+
+    instances.clear();
+    instances.reserve(getInstanceCount());
+    firstTriangles.clear();
+    firstTriangles.reserve(getInstanceCount());
+
+    VkAccelerationStructureInstanceKHR instance {};
+    instance.transform = transformMatrix;
+    instance.instanceCustomIndex = NO_MATERIAL_OVERRIDE;
+    instance.mask = 0xFF;
+    instance.instanceShaderBindingTableRecordOffset = HIT_GROUP_TRIANGLES;
+    instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+
+    if (lodLevelsAS.empty()) {
+        instance.accelerationStructureReference = bottomLevelAS.handle;
+        instances.push_back(instance);
+        firstTriangles.push_back(0);
+    }
+
+    // The custom index is the material of the instance, the first triangle of its level is looked up with the instance ID
+    // as primitive IDs restart at 0 in every BLAS
+    size_t selected = 0;
+    for (size_t m = 0; m < lodLevelsAS.size(); m++) {
+        const GltfLoader::MeshLod& mesh = _app._model->_meshLods[m];
+        for (const GltfLoader::MeshInstance& meshInstance : mesh.instances) {
+            const uint32_t level = _selectedLevels[selected++];
+
+            // VkTransformMatrixKHR is a row major 3x4 matrix, glm is column major
+            for (int row = 0; row < 3; row++) {
+                for (int column = 0; column < 4; column++) {
+                    instance.transform.matrix[row][column] = meshInstance.transform[column][row];
+                }
+            }
+            instance.instanceCustomIndex = meshInstance.materialIndex >= 0 ? static_cast<uint32_t>(meshInstance.materialIndex) : NO_MATERIAL_OVERRIDE;
+            instance.accelerationStructureReference = lodLevelsAS[m][level].handle;
+            instances.push_back(instance);
+            firstTriangles.push_back(mesh.levels[level].firstIndex / 3);
         }
-    } else {
-        VkCommandBuffer commandBuffer = _app.beginSingleTimeCommands();
-        vkCmdBuildAccelerationStructureKHR(commandBuffer, 1, &accelerationBuildGeometryInfo, accelerationBuildOffsets.data());
-        _app.endSingleTimeCommands(commandBuffer);
     }
 
-    VkAccelerationStructureDeviceAddressInfoKHR accelerationDeviceAddressInfo {};
-    accelerationDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
-    accelerationDeviceAddressInfo.accelerationStructure = topLevelAS.accelerationStructure;
+    // Analytic spheres use their own hit groups (intersection shader)
+    if (proceduralAS.accelerationStructure != VK_NULL_HANDLE) {
+        instance.transform = transformMatrix;
+        instance.instanceCustomIndex = NO_MATERIAL_OVERRIDE;
+        instance.instanceShaderBindingTableRecordOffset = HIT_GROUP_SPHERES;
+        instance.accelerationStructureReference = proceduralAS.handle;
+        instances.push_back(instance);
+        firstTriangles.push_back(0);
+    }
+}
 
-    topLevelAS.handle = vkGetAccelerationStructureDeviceAddressKHR(_app._device, &accelerationDeviceAddressInfo);
+void RaytracingHandler::updateLevelsOfDetail(const glm::vec3& viewPosition, uint32_t imageIndex)
+{
+    bool changed = false;
+    size_t selected = 0;
+    for (const GltfLoader::MeshLod& mesh : _app._model->_meshLods) {
+        if (mesh.levels.size() < 2) {
+            selected += mesh.instances.size();
+            continue;
+        }
+        for (const GltfLoader::MeshInstance& instance : mesh.instances) {
+            const uint32_t level = selectLevel(mesh, instance, viewPosition, _selectedLevels[selected]);
+            changed |= level != _selectedLevels[selected];
+            _selectedLevels[selected++] = level;
+        }
+    }
 
-    deleteScratchBuffer(scratchBuffer);
-    vkDestroyBuffer(_app._device, instancesBuffer, nullptr);
-    vkFreeMemory(_app._device, instancesBufferMemory, nullptr);
+    if (changed) {
+        std::fill(_staleInstances.begin(), _staleInstances.end(), true);
+    }
+
+    // Like its uniform buffer, only the image about to be drawn is updated, its command buffer rebuilds the TLAS
+    if (_staleInstances[imageIndex]) {
+        writeInstances(imageIndex);
+        _staleInstances[imageIndex] = false;
+    }
+}
+
+uint32_t RaytracingHandler::selectLevel(const GltfLoader::MeshLod& mesh, const GltfLoader::MeshInstance& instance, const glm::vec3& viewPosition, uint32_t currentLevel)
+{
+    // Bounding sphere of the instance, the radius is scaled by the largest axis of the transform
+    const glm::vec3 center = instance.transform * glm::vec4(mesh.center, 1.f);
+    const float scale = std::max(std::max(glm::length(glm::vec3(instance.transform[0])), glm::length(glm::vec3(instance.transform[1]))), glm::length(glm::vec3(instance.transform[2])));
+    const float radius = mesh.radius * scale;
+
+    // Continuous level, one more each time the projected size of the bounding sphere halves
+    const float distance = std::max(glm::length(center - viewPosition), 1e-4f);
+    const float lod = std::log2(LOD_PROJECTED_SIZE * distance / std::max(radius, 1e-4f)) + 1.f;
+
+    // Small hysteresis so a mesh on a threshold does not trigger a rebuild every frame
+    if (lod > static_cast<float>(currentLevel) - 0.1f && lod < static_cast<float>(currentLevel) + 1.1f) {
+        return currentLevel;
+    }
+
+    const uint32_t level = static_cast<uint32_t>(std::max(lod, 0.f));
+    return std::min(level, static_cast<uint32_t>(mesh.levels.size() - 1));
 }
 
 uint64_t RaytracingHandler::getBufferDeviceAddress(VkBuffer buffer)
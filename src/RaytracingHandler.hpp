@@ -1,7 +1,12 @@
 #pragma once
 
+#include "gltfLoader.hpp"
+
+#include <glm/glm.hpp>
 #include <vulkan/vulkan_beta.h>
 
+#include <vector>
+
 class Application;
 
 struct RayTracingObjectMemory {
@@ -10,8 +15,8 @@ struct RayTracingObjectMemory {
 };
 
 struct AccelerationStructure {
-    VkAccelerationStructureKHR accelerationStructure;
-    uint64_t handle;
+    VkAccelerationStructureKHR accelerationStructure = VK_NULL_HANDLE;
+    uint64_t handle = 0;
     RayTracingObjectMemory objectMemory;
 };
 
@@ -28,6 +33,12 @@ public:
     void init();
     void cleanupRaytracingHandler();
 
+    // Picks the level of every mesh from the viewer position. When one changes, the instances of every swapchain image
+    // are rewritten before its next frame, the one of imageIndex right away
+    void updateLevelsOfDetail(const glm::vec3& viewPosition, uint32_t imageIndex);
+    // Rebuilds the TLAS from the instances of the image, between the trace of the previous frame and the one of this frame
+    void recordTopLevelBuild(VkCommandBuffer commandBuffer, size_t imageIndex);
+
     PFN_vkGetBufferDeviceAddressKHR vkGetBufferDeviceAddressKHR;
     PFN_vkBindAccelerationStructureMemoryKHR vkBindAccelerationStructureMemoryKHR;
     PFN_vkCreateAccelerationStructureKHR vkCreateAccelerationStructureKHR;
@@ -46,10 +57,30 @@ private:
     VkPhysicalDeviceRayTracingFeaturesKHR _rtFeatures {};
 
     AccelerationStructure bottomLevelAS;
+    AccelerationStructure proceduralAS;
     AccelerationStructure topLevelAS;
 
+    // Levels of detail of every mesh, and the level currently in the TLAS for every instance of the meshes
+    std::vector<std::vector<AccelerationStructure>> lodLevelsAS;
+    std::vector<uint32_t> _selectedLevels;
+
+    // One copy per swapchain image, as the uniform buffers: the host rewrites those of the next frame while the
+    // frames in flight still build from theirs
+    std::vector<Buffer> _instancesBuffers;
+    // First triangle of the level used by every TLAS instance, read by the hit shader with gl_InstanceID
+    std::vector<Buffer> _instanceTrianglesBuffers;
+    // Images whose instances predate the last level change
+    std::vector<bool> _staleInstances;
+    RayTracingScratchBuffer _topLevelScratchBuffer;
+
     void createBottomLevelAccelerationStructure();
+    void createProceduralAccelerationStructure();
+    void buildBottomLevelAccelerationStructure(const VkAccelerationStructureCreateGeometryTypeInfoKHR& accelerationCreateGeometryInfo, const VkAccelerationStructureGeometryKHR& accelerationStructureGeometry, AccelerationStructure& accelerationStructure, uint32_t primitiveOffset = 0);
     void createTopLevelAccelerationStructure();
+    void writeInstances(size_t imageIndex);
+    size_t getInstanceCount() const;
+    void getInstances(std::vector<VkAccelerationStructureInstanceKHR>& instances, std::vector<uint32_t>& firstTriangles) const;
+    static uint32_t selectLevel(const GltfLoader::MeshLod& mesh, const GltfLoader::MeshInstance& instance, const glm::vec3& viewPosition, uint32_t currentLevel);
     uint64_t getBufferDeviceAddress(VkBuffer buffer);
     RayTracingObjectMemory createObjectMemory(VkAccelerationStructureKHR accelerationStructure);
     RayTracingScratchBuffer createScratchBuffer(VkAccelerationStructureKHR accelerationStructure);
@@ -0,0 +1,270 @@
+#include "TextureCache.hpp"
+#include "Application.hpp"
+#include "ImageUtils.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include <stb_image.h>
+
+constexpr uint32_t DISK_CACHE_MAGIC = 0x43585452; // "RTXC"
+constexpr uint32_t DISK_CACHE_VERSION = 3;
+constexpr uint32_t DISK_CACHE_FORMAT = VK_FORMAT_R8G8B8A8_SRGB; // every level is RGBA8, filtered in linear space
+constexpr size_t DISK_CACHE_PIXEL_SIZE = 4;
+
+// Followed by every level of the mip chain, base level first
+struct DiskCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+    uint32_t format;
+};
+
+static uint64_t hashPixels(const stbi_uc* pixels, uint32_t width, uint32_t height)
+{
+    const uint32_t dimensions[2] = { width, height };
+    return hashBytes(pixels, static_cast<size_t>(width) * height * 4, hashBytes(dimensions, sizeof(dimensions)));
+}
+
+// Textures are bound to their sampler, so the sampler is part of the key
+static uint64_t makeKey(uint64_t contentHash, const SamplerModule& sampler)
+{
+    const SamplerModule* samplerPtr = &sampler;
+    return contentHash ^ hashBytes(&samplerPtr, sizeof(samplerPtr));
+}
+
+TextureCache::TextureCache(Application& app)
+    : _app(app)
+{
+}
+
+TextureCache::~TextureCache()
+{
+}
+
+void TextureCache::setDiskCacheDirectory(const std::string& directory)
+{
+    _diskCacheDirectory = directory;
+    if (!_diskCacheDirectory.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(_diskCacheDirectory, error);
+        if (error) {
+            std::cerr << "Texture disk cache disabled, could not create " << _diskCacheDirectory << std::endl;
+            _diskCacheDirectory.clear();
+        }
+    }
+}
+
+std::shared_ptr<TextureModule> TextureCache::loadFromFile(const std::string& filename, SamplerModule& sampler)
+{
+    // Identical files are found without decoding them
+    std::vector<unsigned char> content;
+    if (!readFile(filename, content)) {
+        throw std::runtime_error("Failed to load texture image!");
+    }
+
+    const uint64_t fileHash = hashBytes(content.data(), content.size());
+    const uint64_t fileKey = makeKey(fileHash, sampler);
+    if (auto texture = find(fileKey)) {
+        return texture;
+    }
+
+    // Block compressed textures are uploaded as they are, either given directly or prepared by the texture compressor
+    const std::string compressedPath = TextureModule::isCompressedFile(filename) ? filename : getDiskCachePath(fileHash, ".ktx");
+    if (!compressedPath.empty() && std::filesystem::exists(compressedPath)) {
+        auto texture = std::make_shared<TextureModule>(_app, sampler);
+        if (texture->loadFromCompressedFile(compressedPath)) {
+            _missCount++;
+            _textures[fileKey] = texture;
+            return texture;
+        }
+        if (compressedPath == filename) {
+            throw std::runtime_error("Failed to load compressed texture " + filename);
+        }
+    }
+
+    // The disk cache only depends on the content, so it stays valid across sessions
+    MipChain chain;
+    if (!readDiskCache(fileHash, chain)) {
+        int texWidth, texHeight, nbChannels;
+        stbi_uc* decoded = stbi_load_from_memory(content.data(), static_cast<int>(content.size()), &texWidth, &texHeight, &nbChannels, STBI_rgb_alpha);
+        if (!decoded) {
+            throw std::runtime_error("Failed to load texture image!");
+        }
+
+        // Without a disk cache there is nothing to gain from filtering on the CPU
+        if (_diskCacheDirectory.empty()) {
+            auto texture = loadFromBuffer(decoded, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), sampler);
+            stbi_image_free(decoded);
+            _textures[fileKey] = texture;
+
+            return texture;
+        }
+
+        chain = generateMipChain(decoded, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+        stbi_image_free(decoded);
+
+        writeDiskCache(fileHash, chain);
+    }
+
+    // The same pixels may already be loaded from another file or from an embedded image
+    const MipLevel& base = chain.levels[0];
+    const uint64_t key = makeKey(hashPixels(chain.data.data(), base.width, base.height), sampler);
+
+    auto texture = find(key);
+    if (!texture) {
+        _missCount++;
+        texture = std::make_shared<TextureModule>(_app, sampler);
+        texture->loadFromMipChain(chain);
+        _textures[key] = texture;
+    }
+    _textures[fileKey] = texture;
+
+    return texture;
+}
+
+std::shared_ptr<TextureModule> TextureCache::loadFromBuffer(const stbi_uc* pixels, uint32_t width, uint32_t height, SamplerModule& sampler)
+{
+    const uint64_t key = makeKey(hashPixels(pixels, width, height), sampler);
+
+    if (auto texture = find(key)) {
+        return texture;
+    }
+
+    return upload(key, pixels, width, height, sampler);
+}
+
+void TextureCache::purge()
+{
+    for (auto it = _textures.begin(); it != _textures.end();) {
+        if (it->second.use_count() == 1) {
+            it = _textures.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void TextureCache::clear()
+{
+    _textures.clear();
+}
+
+size_t TextureCache::getHitCount() const
+{
+    return _hitCount;
+}
+
+size_t TextureCache::getMissCount() const
+{
+    return _missCount;
+}
+
+std::shared_ptr<TextureModule> TextureCache::find(uint64_t key)
+{
+    auto it = _textures.find(key);
+    if (it == _textures.end()) {
+        return nullptr;
+    }
+
+    _hitCount++;
+    return it->second;
+}
+
+std::shared_ptr<TextureModule> TextureCache::upload(uint64_t key, const stbi_uc* pixels, uint32_t width, uint32_t height, SamplerModule& sampler)
+{
+    _missCount++;
+
+    auto texture = std::make_shared<TextureModule>(_app, sampler);
+    texture->loadFromBuffer(pixels, width, height);
+    _textures[key] = texture;
+
+    return texture;
+}
+
+bool TextureCache::readDiskCache(uint64_t hash, MipChain& chain) const
+{
+    if (_diskCacheDirectory.empty()) {
+        return false;
+    }
+
+    const std::string path = getDiskCachePath(hash, ".mips");
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::error_code error;
+    const uintmax_t fileSize = std::filesystem::file_size(path, error);
+    if (error || fileSize < sizeof(DiskCacheHeader)) {
+        return false;
+    }
+
+    // Any entry that does not match its own header is treated as a miss, it is rewritten after the decode
+    DiskCacheHeader header {};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || header.magic != DISK_CACHE_MAGIC || header.version != DISK_CACHE_VERSION || header.format != DISK_CACHE_FORMAT) {
+        return false;
+    }
+    const uintmax_t dataSize = fileSize - sizeof(DiskCacheHeader);
+    if (header.width == 0 || header.height == 0 || static_cast<uintmax_t>(header.width) * header.height > dataSize / DISK_CACHE_PIXEL_SIZE
+        || header.mipLevels != getMipLevelCount(header.width, header.height)) {
+        return false;
+    }
+
+    chain.levels.clear();
+    size_t totalSize = 0;
+    for (uint32_t i = 0; i < header.mipLevels; i++) {
+        MipLevel level {};
+        level.width = std::max(header.width >> i, 1u);
+        level.height = std::max(header.height >> i, 1u);
+        level.offset = totalSize;
+        totalSize += static_cast<size_t>(level.width) * level.height * DISK_CACHE_PIXEL_SIZE;
+        chain.levels.push_back(level);
+    }
+    if (totalSize != dataSize) {
+        chain.levels.clear();
+        return false;
+    }
+
+    chain.data.resize(totalSize);
+    file.read(reinterpret_cast<char*>(chain.data.data()), chain.data.size());
+
+    return static_cast<bool>(file);
+}
+
+void TextureCache::writeDiskCache(uint64_t hash, const MipChain& chain) const
+{
+    if (_diskCacheDirectory.empty()) {
+        return;
+    }
+
+    // Write to a temporary file first so concurrent sessions never read a partial entry
+    const std::string path = getDiskCachePath(hash, ".mips");
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return;
+        }
+
+        const DiskCacheHeader header { DISK_CACHE_MAGIC, DISK_CACHE_VERSION, chain.levels[0].width, chain.levels[0].height, static_cast<uint32_t>(chain.levels.size()), DISK_CACHE_FORMAT };
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(chain.data.data()), static_cast<std::streamsize>(chain.data.size()));
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tmpPath, path, error);
+}
+
+std::string TextureCache::getDiskCachePath(uint64_t hash, const std::string& extension) const
+{
+    if (_diskCacheDirectory.empty()) {
+        return "";
+    }
+    return _diskCacheDirectory + "/" + hashToString(hash) + extension;
+}
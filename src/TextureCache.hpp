@@ -0,0 +1,49 @@
+#pragma once
+
+#include "TextureModule.hpp"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+class Application;
+
+// Shares the GPU images of identical textures, recognized by a hash of their content,
+// and optionally keeps the decoded mip chains on disk so the next sessions skip the decode and the filtering.
+// Block compressed versions written in the same directory by tools/texture-compressor are preferred when present
+class TextureCache {
+public:
+    TextureCache(Application& app);
+    ~TextureCache();
+
+    // An empty directory disables the on-disk cache
+    void setDiskCacheDirectory(const std::string& directory);
+
+    std::shared_ptr<TextureModule> loadFromFile(const std::string& filename, SamplerModule& sampler);
+    std::shared_ptr<TextureModule> loadFromBuffer(const stbi_uc* pixels, uint32_t width, uint32_t height, SamplerModule& sampler);
+
+    // Releases the textures that are only referenced by the cache
+    void purge();
+    void clear();
+
+    size_t getHitCount() const;
+    size_t getMissCount() const;
+
+private:
+    std::shared_ptr<TextureModule> find(uint64_t key);
+    std::shared_ptr<TextureModule> upload(uint64_t key, const stbi_uc* pixels, uint32_t width, uint32_t height, SamplerModule& sampler);
+
+    bool readDiskCache(uint64_t hash, MipChain& chain) const;
+    void writeDiskCache(uint64_t hash, const MipChain& chain) const;
+    // Decoded mip chains are stored as .mips, the texture compressor writes .ktx files
+    std::string getDiskCachePath(uint64_t hash, const std::string& extension) const;
+
+private:
+    Application& _app;
+
+    std::unordered_map<uint64_t, std::shared_ptr<TextureModule>> _textures;
+    std::string _diskCacheDirectory;
+
+    size_t _hitCount { 0 };
+    size_t _missCount { 0 };
+};
@@ -1,11 +1,50 @@
 #include "TextureModule.hpp"
 #include "Application.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
 #include <stdexcept>
 
+#include <gli/gli.hpp>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+constexpr VkFormat TEXTURE_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+static VkFormat getVulkanFormat(gli::format format)
+{
+    switch (format) {
+    case gli::FORMAT_RGB_DXT1_UNORM_BLOCK8:
+        return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    case gli::FORMAT_RGB_DXT1_SRGB_BLOCK8:
+        return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+    case gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8:
+        return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    case gli::FORMAT_RGBA_DXT1_SRGB_BLOCK8:
+        return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+    case gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16:
+        return VK_FORMAT_BC3_UNORM_BLOCK;
+    case gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16:
+        return VK_FORMAT_BC3_SRGB_BLOCK;
+    case gli::FORMAT_RG_ATI2N_UNORM_BLOCK16:
+        return VK_FORMAT_BC5_UNORM_BLOCK;
+    case gli::FORMAT_RG_ATI2N_SNORM_BLOCK16:
+        return VK_FORMAT_BC5_SNORM_BLOCK;
+    case gli::FORMAT_RGBA_BP_UNORM_BLOCK16:
+        return VK_FORMAT_BC7_UNORM_BLOCK;
+    case gli::FORMAT_RGBA_BP_SRGB_BLOCK16:
+        return VK_FORMAT_BC7_SRGB_BLOCK;
+    case gli::FORMAT_RGBA8_UNORM_PACK8:
+        return VK_FORMAT_R8G8B8A8_UNORM;
+    case gli::FORMAT_RGBA8_SRGB_PACK8:
+        return VK_FORMAT_R8G8B8A8_SRGB;
+    default:
+        return VK_FORMAT_UNDEFINED;
+    }
+}
+
 TextureModule::TextureModule(Application& app, SamplerModule& sampler)
     : _app(app)
     , _sampler(sampler)
@@ -56,39 +95,223 @@ void TextureModule::loadFromFile(const std::string& filename, VkImageViewType vi
     loadTexture(filename, viewType);
 }
 
-void TextureModule::loadFromBuffer(stbi_uc* pixels, uint32_t texWidth, uint32_t texHeight, VkImageViewType viewType)
+void TextureModule::loadFromBuffer(const stbi_uc* pixels, uint32_t texWidth, uint32_t texHeight, VkImageViewType viewType)
 {
     assert(pixels);
 
+    if (!supportsLinearBlit(TEXTURE_FORMAT)) {
+        loadFromMipChain(generateMipChain(pixels, texWidth, texHeight), viewType);
+        return;
+    }
+
+    loadWithGpuMipmaps(pixels, static_cast<VkDeviceSize>(texWidth) * texHeight * 4, texWidth, texHeight, TEXTURE_FORMAT, viewType);
+}
+
+void TextureModule::loadFromHalfFloatBuffer(const uint16_t* pixels, uint32_t texWidth, uint32_t texHeight, VkImageViewType viewType)
+{
+    assert(pixels);
+
+    loadWithGpuMipmaps(pixels, static_cast<VkDeviceSize>(texWidth) * texHeight * 4 * sizeof(uint16_t), texWidth, texHeight, VK_FORMAT_R16G16B16A16_SFLOAT, viewType);
+}
+
+void TextureModule::loadFromMipChain(const MipChain& chain, VkImageViewType viewType)
+{
+    assert(!chain.levels.empty());
+
+    _width = chain.levels[0].width;
+    _height = chain.levels[0].height;
+    _mipLevels = static_cast<uint32_t>(chain.levels.size());
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createStagingBuffer(chain.data.data(), chain.data.size(), stagingBuffer, stagingBufferMemory);
+
+    std::vector<VkBufferImageCopy> regions(_mipLevels);
+    for (uint32_t i = 0; i < _mipLevels; i++) {
+        const MipLevel& level = chain.levels[i];
+
+        regions[i].bufferOffset = level.offset;
+        regions[i].bufferRowLength = 0;
+        regions[i].bufferImageHeight = 0;
+        regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        regions[i].imageSubresource.mipLevel = i;
+        regions[i].imageSubresource.baseArrayLayer = 0;
+        regions[i].imageSubresource.layerCount = 1;
+        regions[i].imageOffset = { 0, 0, 0 };
+        regions[i].imageExtent = { level.width, level.height, 1 };
+    }
+
+    _app.createImage(_width, _height, TEXTURE_FORMAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _textureImage, _textureImageMemory, _mipLevels);
+
+    _app.transitionImageLayout(nullptr, _textureImage, TEXTURE_FORMAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _mipLevels);
+    _app.copyBufferToImage(stagingBuffer, _textureImage, regions);
+    _app.transitionImageLayout(nullptr, _textureImage, TEXTURE_FORMAT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, _mipLevels);
+
+    vkDestroyBuffer(_app._device, stagingBuffer, nullptr);
+    vkFreeMemory(_app._device, stagingBufferMemory, nullptr);
+
+    _format = TEXTURE_FORMAT;
+    _textureImageView = _app.createImageView(_textureImage, TEXTURE_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, viewType, _mipLevels);
+    _loaded = true;
+}
+
+void TextureModule::loadFromCubemap(const Cubemap& cubemap)
+{
+    assert(!cubemap.levels.empty());
+
+    constexpr VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;
+    constexpr uint32_t nbFaces = 6;
+
+    _width = cubemap.faceSize;
+    _height = cubemap.faceSize;
+    _mipLevels = static_cast<uint32_t>(cubemap.levels.size());
+
+    size_t totalSize = 0;
+    for (const auto& level : cubemap.levels) {
+        totalSize += level.size();
+    }
+
+    // The faces of a level are consecutive, so a single region covers the 6 layers
+    std::vector<uint16_t> halfPixels(totalSize);
+    std::vector<VkBufferImageCopy> regions(_mipLevels);
+    size_t offset = 0;
+    for (uint32_t i = 0; i < _mipLevels; i++) {
+        const uint32_t size = std::max(cubemap.faceSize >> i, 1u);
+        convertFloatToHalf(cubemap.levels[i].data(), halfPixels.data() + offset, cubemap.levels[i].size());
+
+        regions[i].bufferOffset = offset * sizeof(uint16_t);
+        regions[i].bufferRowLength = 0;
+        regions[i].bufferImageHeight = 0;
+        regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        regions[i].imageSubresource.mipLevel = i;
+        regions[i].imageSubresource.baseArrayLayer = 0;
+        regions[i].imageSubresource.layerCount = nbFaces;
+        regions[i].imageOffset = { 0, 0, 0 };
+        regions[i].imageExtent = { size, size, 1 };
+
+        offset += cubemap.levels[i].size();
+    }
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createStagingBuffer(halfPixels.data(), halfPixels.size() * sizeof(uint16_t), stagingBuffer, stagingBufferMemory);
+
+    _app.createImage(_width, _height, format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _textureImage, _textureImageMemory, _mipLevels, nbFaces, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT);
+
+    _app.transitionImageLayout(nullptr, _textureImage, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _mipLevels, nbFaces);
+    _app.copyBufferToImage(stagingBuffer, _textureImage, regions);
+    _app.transitionImageLayout(nullptr, _textureImage, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, _mipLevels, nbFaces);
+
+    vkDestroyBuffer(_app._device, stagingBuffer, nullptr);
+    vkFreeMemory(_app._device, stagingBufferMemory, nullptr);
+
+    _format = format;
+    _textureImageView = _app.createImageView(_textureImage, format, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_VIEW_TYPE_CUBE, _mipLevels, nbFaces);
+    _loaded = true;
+}
+
+void TextureModule::loadWithGpuMipmaps(const void* pixels, VkDeviceSize imageSize, uint32_t texWidth, uint32_t texHeight, VkFormat format, VkImageViewType viewType)
+{
     _width = texWidth;
     _height = texHeight;
-    VkDeviceSize imageSize = _width * _height * 4;
+    // Formats that cannot be filtered by a blit only get their base level
+    _mipLevels = supportsLinearBlit(format) ? getMipLevelCount(texWidth, texHeight) : 1;
 
     VkBuffer stagingBuffer;
     VkDeviceMemory stagingBufferMemory;
-    _app.createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+    createStagingBuffer(pixels, imageSize, stagingBuffer, stagingBufferMemory);
 
-    void* data;
-    vkMapMemory(_app._device, stagingBufferMemory, 0, imageSize, NULL, &data);
-    memcpy(data, pixels, static_cast<size_t>(imageSize));
-    vkUnmapMemory(_app._device, stagingBufferMemory);
+    // The lower levels are blitted from the base level, so the image is also a transfer source
+    _app.createImage(_width, _height, format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _textureImage, _textureImageMemory, _mipLevels);
 
-    _app.createImage(_width, _height, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _textureImage, _textureImageMemory);
-
-    _app.transitionImageLayout(nullptr, _textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    _app.transitionImageLayout(nullptr, _textureImage, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _mipLevels);
     _app.copyBufferToImage(stagingBuffer, _textureImage, static_cast<uint32_t>(_width), static_cast<uint32_t>(_height));
 
-    _app.transitionImageLayout(nullptr, _textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    // Leaves every level in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    generateMipmaps(format);
 
     vkDestroyBuffer(_app._device, stagingBuffer, nullptr);
     vkFreeMemory(_app._device, stagingBufferMemory, nullptr);
 
-    _textureImageView = _app.createImageView(_textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, viewType);
+    _format = format;
+    _textureImageView = _app.createImageView(_textureImage, format, VK_IMAGE_ASPECT_COLOR_BIT, viewType, _mipLevels);
     _loaded = true;
 }
 
+bool TextureModule::loadFromCompressedFile(const std::string& filename, VkImageViewType viewType)
+{
+    const gli::texture2d texture(gli::load(filename));
+    if (texture.empty()) {
+        return false;
+    }
+
+    const VkFormat format = getVulkanFormat(texture.format());
+    if (format == VK_FORMAT_UNDEFINED || !supportsSampling(format)) {
+        return false;
+    }
+
+    _width = texture.extent(0).x;
+    _height = texture.extent(0).y;
+    _mipLevels = static_cast<uint32_t>(texture.levels());
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createStagingBuffer(texture.data(), texture.size(), stagingBuffer, stagingBufferMemory);
+
+    // The levels are stored one after the other, the blocks are copied without any decode
+    std::vector<VkBufferImageCopy> regions(_mipLevels);
+    for (uint32_t i = 0; i < _mipLevels; i++) {
+        const gli::extent2d extent = texture.extent(i);
+
+        regions[i].bufferOffset = static_cast<VkDeviceSize>(static_cast<const char*>(texture.data(0, 0, i)) - static_cast<const char*>(texture.data()));
+        regions[i].bufferRowLength = 0;
+        regions[i].bufferImageHeight = 0;
+        regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        regions[i].imageSubresource.mipLevel = i;
+        regions[i].imageSubresource.baseArrayLayer = 0;
+        regions[i].imageSubresource.layerCount = 1;
+        regions[i].imageOffset = { 0, 0, 0 };
+        regions[i].imageExtent = { static_cast<uint32_t>(extent.x), static_cast<uint32_t>(extent.y), 1 };
+    }
+
+    _app.createImage(_width, _height, format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _textureImage, _textureImageMemory, _mipLevels);
+
+    _app.transitionImageLayout(nullptr, _textureImage, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _mipLevels);
+    _app.copyBufferToImage(stagingBuffer, _textureImage, regions);
+    _app.transitionImageLayout(nullptr, _textureImage, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, _mipLevels);
+
+    vkDestroyBuffer(_app._device, stagingBuffer, nullptr);
+    vkFreeMemory(_app._device, stagingBufferMemory, nullptr);
+
+    _format = format;
+    _textureImageView = _app.createImageView(_textureImage, format, VK_IMAGE_ASPECT_COLOR_BIT, viewType, _mipLevels);
+    _loaded = true;
+
+    return true;
+}
+
+bool TextureModule::isCompressedFile(const std::string& filename)
+{
+    std::string extension = std::filesystem::path(filename).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    return extension == ".ktx" || extension == ".dds";
+}
+
+VkFormat TextureModule::getFormat() const
+{
+    return _format;
+}
+
 void TextureModule::loadTexture(const std::string& filename, VkImageViewType viewType)
 {
+    if (isCompressedFile(filename)) {
+        if (!loadFromCompressedFile(filename, viewType)) {
+            throw std::runtime_error("Failed to load compressed texture " + filename);
+        }
+        return;
+    }
+
     stbi_uc* pixels = stbi_load(filename.c_str(), &_width, &_height, &_nbChannels, STBI_rgb_alpha);
 
     if (!pixels) {
@@ -98,6 +321,106 @@ void TextureModule::loadTexture(const std::string& filename, VkImageViewType vie
     stbi_image_free(pixels);
 }
 
+void TextureModule::createStagingBuffer(const void* data, VkDeviceSize size, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+{
+    _app.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, bufferMemory);
+
+    void* mapped;
+    vkMapMemory(_app._device, bufferMemory, 0, size, NULL, &mapped);
+    memcpy(mapped, data, static_cast<size_t>(size));
+    vkUnmapMemory(_app._device, bufferMemory);
+}
+
+bool TextureModule::supportsLinearBlit(VkFormat format) const
+{
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(_app._physDevice, format, &formatProperties);
+
+    // The mip chain is generated by blitting each level into the next one, with linear filtering
+    constexpr VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (formatProperties.optimalTilingFeatures & requiredFeatures) == requiredFeatures;
+}
+
+bool TextureModule::supportsSampling(VkFormat format) const
+{
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(_app._physDevice, format, &formatProperties);
+
+    return formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+}
+
+void TextureModule::generateMipmaps(VkFormat format)
+{
+    if (_mipLevels == 1) {
+        _app.transitionImageLayout(nullptr, _textureImage, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        return;
+    }
+
+
+    VkCommandBuffer commandBuffer = _app.beginSingleTimeCommands();
+
+    VkImageMemoryBarrier barrier {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.image = _textureImage;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.subresourceRange.levelCount = 1;
+
+    int32_t mipWidth = _width;
+    int32_t mipHeight = _height;
+
+    for (uint32_t i = 1; i < _mipLevels; i++) {
+        // Level i - 1 has been written, it becomes the source of level i
+        barrier.subresourceRange.baseMipLevel = i - 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        const int32_t nextWidth = std::max(mipWidth / 2, 1);
+        const int32_t nextHeight = std::max(mipHeight / 2, 1);
+
+        VkImageBlit blit {};
+        blit.srcOffsets[0] = { 0, 0, 0 };
+        blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = i - 1;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = 1;
+        blit.dstOffsets[0] = { 0, 0, 0 };
+        blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.mipLevel = i;
+        blit.dstSubresource.baseArrayLayer = 0;
+        blit.dstSubresource.layerCount = 1;
+        vkCmdBlitImage(commandBuffer, _textureImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        // The source level is done, hand it over to the shaders
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        mipWidth = nextWidth;
+        mipHeight = nextHeight;
+    }
+
+    // The last level is never blitted from
+    barrier.subresourceRange.baseMipLevel = _mipLevels - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    _app.endSingleTimeCommands(commandBuffer);
+}
+
 SamplerModule::SamplerModule(Application& app)
     : _app(app)
 
@@ -118,7 +441,7 @@ SamplerModule::SamplerModule(Application& app)
     samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
     samplerInfo.mipLodBias = 0.f;
     samplerInfo.minLod = 0.f;
-    samplerInfo.maxLod = 0.f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
     if (vkCreateSampler(_app._device, &samplerInfo, nullptr, &_textureSampler) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create texture sampler");
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "ImageUtils.hpp"
+
 #include <string>
 #include <vulkan/vulkan.h>
 #include <stb_image.h>
@@ -27,11 +29,29 @@ public:
 
     VkWriteDescriptorSet getDescriptorSet(VkDescriptorSet dst, uint32_t binding);
     void loadFromFile(const std::string& filename, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D);
-    void loadFromBuffer(stbi_uc* pixels, uint32_t texWidth, uint32_t texHeight, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D);
+    // The mip chain is generated on the GPU, or on the CPU when the format cannot be blitted
+    void loadFromBuffer(const stbi_uc* pixels, uint32_t texWidth, uint32_t texHeight, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D);
+    void loadFromMipChain(const MipChain& chain, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D);
+    // Uploaded as half floats with all the levels of the cubemap
+    void loadFromCubemap(const Cubemap& cubemap);
+    // RGBA half floats, linear
+    void loadFromHalfFloatBuffer(const uint16_t* pixels, uint32_t texWidth, uint32_t texHeight, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D);
+    // KTX/DDS files in BC1/BC3/BC5/BC7 or RGBA8, uploaded as is with their mips
+    // Returns false when the file cannot be read or the device cannot sample its format
+    bool loadFromCompressedFile(const std::string& filename, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D);
+
+    static bool isCompressedFile(const std::string& filename);
+
+    VkFormat getFormat() const;
 
 private:
 
     void loadTexture(const std::string& filename, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D);
+    void loadWithGpuMipmaps(const void* pixels, VkDeviceSize imageSize, uint32_t texWidth, uint32_t texHeight, VkFormat format, VkImageViewType viewType);
+    void createStagingBuffer(const void* data, VkDeviceSize size, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+    bool supportsLinearBlit(VkFormat format) const;
+    bool supportsSampling(VkFormat format) const;
+    void generateMipmaps(VkFormat format);
 
 private:
     Application& _app;
@@ -40,6 +60,8 @@ private:
     int _width { 0 };
     int _height { 0 };
     int _nbChannels { 0 };
+    uint32_t _mipLevels { 1 };
+    VkFormat _format { VK_FORMAT_UNDEFINED };
 
     VkImage _textureImage;
     VkDeviceMemory _textureImageMemory;
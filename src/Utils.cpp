@@ -1,5 +1,22 @@
 #include "Utils.hpp"
 
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fstream>
+#include <unistd.h>
+#endif
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
 VkVertexInputBindingDescription Vertex::getBindingDescription()
 {
     VkVertexInputBindingDescription bindingDescription {};
@@ -41,3 +58,70 @@ std::array<VkVertexInputAttributeDescription, 5> Vertex::getAttributeDescription
 
     return attributeDescriptions;
 }
+
+glm::vec2 octahedralEncode(const glm::vec3& normal)
+{
+    const float l1Norm = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (l1Norm <= 0.f) {
+        return glm::vec2(0.f);
+    }
+
+    // Project on the octahedron and fold the lower hemisphere over the upper one
+    const glm::vec3 n = normal / l1Norm;
+    glm::vec2 encoded(n.x, n.y);
+    if (n.z < 0.f) {
+        encoded.x = (1.f - std::abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f);
+        encoded.y = (1.f - std::abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f);
+    }
+
+    return encoded;
+}
+
+glm::vec3 octahedralDecode(const glm::vec2& encoded)
+{
+    // Unfold the lower hemisphere
+    glm::vec3 n(encoded.x, encoded.y, 1.f - std::abs(encoded.x) - std::abs(encoded.y));
+    const float t = std::max(-n.z, 0.f);
+    n.x += n.x >= 0.f ? -t : t;
+    n.y += n.y >= 0.f ? -t : t;
+
+    return glm::normalize(n);
+}
+
+PackedVertex PackedVertex::pack(const Vertex& vertex)
+{
+    PackedVertex packed {};
+    packed.normal = glm::packSnorm2x16(octahedralEncode(vertex.normal));
+    packed.texCoord = glm::packHalf2x16(vertex.texCoord);
+    packed.color = glm::packUnorm4x8(glm::clamp(vertex.color, 0.f, 1.f));
+    packed.materialId = static_cast<glm::uint32>(std::clamp(static_cast<int>(vertex.materialId.x), 0, 0xFFFF));
+
+    return packed;
+}
+
+size_t getResidentMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters {};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.WorkingSetSize;
+    }
+    return 0;
+#else
+    // Second field of statm is the resident size in pages
+    std::ifstream statm("/proc/self/statm");
+    size_t totalPages = 0;
+    size_t residentPages = 0;
+    if (statm >> totalPages >> residentPages) {
+        return residentPages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+    return 0;
+#endif
+}
+
+void releaseFreedHostMemory()
+{
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
@@ -16,6 +16,13 @@ struct Buffer {
     VkDeviceMemory memory;
 };
 
+struct StorageImage {
+    VkDeviceMemory memory;
+    VkImage image;
+    VkImageView view;
+    VkFormat format;
+};
+
 struct Vertex {
     glm::vec3 pos;
     glm::vec4 color;
@@ -27,10 +34,30 @@ struct Vertex {
     static std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions();
 
     bool operator==(const Vertex& other) const {
-        return pos == other.pos && color == other.color && texCoord == other.texCoord && materialId == other.materialId;
+        return pos == other.pos && color == other.color && normal == other.normal && texCoord == other.texCoord && materialId == other.materialId;
     }
 };
 
+// Compact attributes fetched by the hit shader, positions are kept in their own tightly packed float3 stream for the BLAS
+struct PackedVertex {
+    glm::uint32 normal; // octahedral encoded, 2x snorm16
+    glm::uint32 texCoord; // 2x half float
+    glm::uint32 color; // 4x unorm8
+    glm::uint32 materialId; // 16 low bits, high bits are free
+
+    static PackedVertex pack(const Vertex& vertex);
+};
+
+glm::vec2 octahedralEncode(const glm::vec3& normal);
+// Unit normal back from its encoding, as octahedralDecode in gbuffer.glsl
+glm::vec3 octahedralDecode(const glm::vec2& encoded);
+
+// Resident set size of the process, in bytes
+size_t getResidentMemory();
+
+// Gives the memory freed by the allocator back to the system when possible
+void releaseFreedHostMemory();
+
 struct Light {
     glm::vec4 color;
     glm::vec3 pos;
@@ -50,6 +77,16 @@ namespace std {
 struct UniformBufferObject {
     glm::mat4 invView;
     glm::mat4 invProj;
+    glm::mat4 prevInvView; // Camera of the previous frame, for the motion vectors and the reprojection
+    glm::mat4 prevInvProj;
+    glm::mat4 prevViewProj; // World to clip space of the previous frame
     glm::uint32 vertexSize;
+    glm::uint32 frameIndex; // Seeds the random numbers of the shaders
+    glm::uint32 useIrradianceSH; // Ambient from the harmonics below, or from the irradiance cubemap
+    glm::uint32 useSoftShadows; // Stochastic shadow ray of the first hits towards disk lights of lightRadius
+    float lightRadius;
+    glm::uint32 maxExtraPaths; // Per pixel, 0 without adaptive sampling
+    float extraPathBudget; // Extra paths per pixel of the image on average
+    alignas(16) glm::vec4 irradianceSH[9];
     glm::vec4 lights[4];
 };
\ No newline at end of file
@@ -1,24 +1,39 @@
 
 #include "Application.hpp"
 
+#include "MeshOrdering.hpp"
+#include "MeshSimplifier.hpp"
 #include "gltfLoader.hpp"
 #include <tiny_gltf.h>
 
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #define TINYGLTF_IMPLEMENTATION
 #include <tiny_gltf.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
 #include <iostream>
+#include <thread>
 
-// used to change to current coords
-constexpr glm::mat4 CHANGE_COORDS = glm::mat4(
-    1.f, 0.f, 0.f, 0.f,
-    0.f, 0.f, 1.f, 0.f,
-    0.f, 1.f, 0.f, 0.f,
-    0.f, 0.f, 0.f, 1.f);
+// World space bounds of a rotated ellipsoid
+static VkAabbPositionsKHR getSphereBounds(const GltfLoader::Sphere& sphere)
+{
+    const glm::mat3 rotation = glm::mat3_cast(glm::quat(sphere.rotation.w, sphere.rotation.x, sphere.rotation.y, sphere.rotation.z));
+
+    glm::vec3 extent;
+    for (int i = 0; i < 3; i++) {
+        extent[i] = glm::length(glm::vec3(rotation[0][i] * sphere.radii.x, rotation[1][i] * sphere.radii.y, rotation[2][i] * sphere.radii.z));
+    }
+
+    const glm::vec3 min = sphere.center - extent;
+    const glm::vec3 max = sphere.center + extent;
+    return { min.x, min.y, min.z, max.x, max.y, max.z };
+}
 
 GltfLoader::GltfLoader(Application& app)
     : _app(app)
@@ -32,8 +47,14 @@ GltfLoader::~GltfLoader()
     if (_loaded) {
         vkDestroyBuffer(_app._device, _vertices.buffer, nullptr);
         vkFreeMemory(_app._device, _vertices.memory, nullptr);
+        vkDestroyBuffer(_app._device, _positions.buffer, nullptr);
+        vkFreeMemory(_app._device, _positions.memory, nullptr);
         vkDestroyBuffer(_app._device, _indices.buffer, nullptr);
         vkFreeMemory(_app._device, _indices.memory, nullptr);
+        vkDestroyBuffer(_app._device, _sphereBuffer.buffer, nullptr);
+        vkFreeMemory(_app._device, _sphereBuffer.memory, nullptr);
+        vkDestroyBuffer(_app._device, _sphereAabbs.buffer, nullptr);
+        vkFreeMemory(_app._device, _sphereAabbs.memory, nullptr);
     }
 }
 
@@ -54,7 +75,9 @@ tinygltf::Model& GltfLoader::loadModel(const std::string& fileName)
     }
 
     _descriptorSets.resize(_model.images.size());
-    _textures.resize(_model.images.size(), TextureModule(_app, _app._samplers[0]));
+    _textures.resize(_model.images.size());
+
+    return _model;
 }
 
 void GltfLoader::loadImages(tinygltf::Model& input)
@@ -84,7 +107,7 @@ void GltfLoader::loadImages(tinygltf::Model& input)
             bufferSize = glTFImage.image.size();
         }
         // Load texture from image buffer
-        _textures[i].loadFromBuffer(buffer, glTFImage.width, glTFImage.height);
+        _textures[i] = _app._textureCache.loadFromBuffer(buffer, glTFImage.width, glTFImage.height, _app._samplers[0]);
         if (deleteBuffer) {
             delete buffer;
         }
@@ -118,42 +141,240 @@ void GltfLoader::createBuffers(std::vector<uint32_t>& indexBuffer, std::vector<V
     // Create and upload vertex and index buffer
     // We will be using one single vertex buffer and one single index buffer for the whole glTF scene
     // Primitives (of the glTF model) will then index into these using index offsets
+    // Vertices are split in two streams : tightly packed positions for the BLAS and compact attributes for the hit shader
+    if (USE_SPATIAL_ORDER) {
+        reorderForLocality(indexBuffer, vertexBuffer);
+    }
+
+    std::vector<glm::vec3> positions(vertexBuffer.size());
+    std::vector<PackedVertex> attributes(vertexBuffer.size());
+    for (size_t i = 0; i < vertexBuffer.size(); i++) {
+        positions[i] = vertexBuffer[i].pos;
+        attributes[i] = PackedVertex::pack(vertexBuffer[i]);
+    }
+
+    // Simplified levels are appended to the index buffer, they reuse the vertices of the original meshes
+    createLevelsOfDetail(indexBuffer, positions);
 
-    size_t vertexBufferSize = vertexBuffer.size() * sizeof(Vertex);
-    size_t indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
     _indices.count = static_cast<uint32_t>(indexBuffer.size());
+    _vertexCount = vertexBuffer.size();
 
-    VkBuffer vertexstagingBuffer;
-    VkDeviceMemory vertexstagingBufferMemory;
-    _app.createBuffer(vertexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vertexstagingBuffer, vertexstagingBufferMemory);
+    createDeviceBuffer(positions.data(), positions.size() * sizeof(glm::vec3), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, _positions);
+    createDeviceBuffer(attributes.data(), attributes.size() * sizeof(PackedVertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, _vertices);
+    createDeviceBuffer(indexBuffer.data(), indexBuffer.size() * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, _indices.buffer, _indices.memory);
 
-    void* data;
-    vkMapMemory(_app._device, vertexstagingBufferMemory, 0, vertexBufferSize, NULL, &data);
-    memcpy(data, vertexBuffer.data(), static_cast<size_t>(vertexBufferSize));
-    vkUnmapMemory(_app._device, vertexstagingBufferMemory);
+    // Spheres only cost their parameters and a bounding box, the surface is found by the intersection shader
+    if (_spheres.empty()) {
+        const Sphere emptySphere {};
+        createDeviceBuffer(&emptySphere, sizeof(Sphere), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, _sphereBuffer);
+    } else {
+        std::vector<VkAabbPositionsKHR> aabbs(_spheres.size());
+        for (size_t i = 0; i < _spheres.size(); i++) {
+            aabbs[i] = getSphereBounds(_spheres[i]);
+        }
 
-    _app.createBuffer(vertexBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _vertices.buffer, _vertices.memory);
+        createDeviceBuffer(_spheres.data(), _spheres.size() * sizeof(Sphere), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, _sphereBuffer);
+        createDeviceBuffer(aabbs.data(), aabbs.size() * sizeof(VkAabbPositionsKHR), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, _sphereAabbs);
+    }
 
-    _app.copyBuffer(vertexstagingBuffer, _vertices.buffer, vertexBufferSize);
+    _loaded = true;
+}
 
-    vkDestroyBuffer(_app._device, vertexstagingBuffer, nullptr);
-    vkFreeMemory(_app._device, vertexstagingBufferMemory, nullptr);
+void GltfLoader::reorderForLocality(std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer) const
+{
+    // Triangles are only moved inside their primitive, so the ranges (and their material) stay valid
+    std::vector<Primitive> primitives;
+    std::vector<const Node*> nodes;
+    for (const auto& node : _nodes) {
+        nodes.push_back(node.get());
+    }
+    for (size_t i = 0; i < nodes.size(); i++) {
+        for (const auto& child : nodes[i]->children) {
+            nodes.push_back(child.get());
+        }
+        primitives.insert(primitives.end(), nodes[i]->mesh.primitives.begin(), nodes[i]->mesh.primitives.end());
+    }
+    if (primitives.empty()) {
+        primitives.push_back({ 0, static_cast<uint32_t>(indexBuffer.size()), -1 });
+    }
 
-    VkBuffer indexstagingBuffer;
-    VkDeviceMemory indexstagingBufferMemory;
-    _app.createBuffer(indexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, indexstagingBuffer, indexstagingBufferMemory);
+    std::vector<glm::vec3> positions(vertexBuffer.size());
+    for (size_t i = 0; i < vertexBuffer.size(); i++) {
+        positions[i] = vertexBuffer[i].pos;
+    }
 
-    vkMapMemory(_app._device, indexstagingBufferMemory, 0, indexBufferSize, NULL, &data);
-    memcpy(data, indexBuffer.data(), static_cast<size_t>(indexBufferSize));
-    vkUnmapMemory(_app._device, indexstagingBufferMemory);
+    // Fetches of the closest hit shader when neighboring rays hit neighboring triangles : three indices, then three vertices.
+    // Only simulated in verbose mode, they cost as much as the reordering itself
+    const bool statistics = Application::_verbose > 0;
+    std::vector<uint32_t> indexFetches;
+    std::vector<uint32_t> vertexFetches;
+    auto printStatistics = [&](const char* label) {
+        if (!statistics) {
+            return;
+        }
+        const FetchStatistics indexStatistics = simulateFetches(indexFetches, sizeof(uint32_t));
+        const FetchStatistics vertexStatistics = simulateFetches(vertexFetches, sizeof(PackedVertex));
+        std::cout << label << " : " << indexStatistics.fetchedLines << " index lines (" << 100.f * indexStatistics.getUtilization(FETCH_CACHE_LINE_SIZE) << "% used), "
+                  << vertexStatistics.fetchedLines << " vertex lines (" << 100.f * vertexStatistics.getUtilization(FETCH_CACHE_LINE_SIZE) << "% used)" << std::endl;
+    };
 
-    _app.createBuffer(indexBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _indices.buffer, _indices.memory);
+    std::vector<uint32_t> sorted(indexBuffer);
+    for (const Primitive& primitive : primitives) {
+        const std::vector<uint32_t> order = getMortonOrder(positions, indexBuffer.data() + primitive.firstIndex, primitive.indexCount);
+        for (size_t t = 0; t < order.size(); t++) {
+            for (uint32_t c = 0; c < 3; c++) {
+                const uint32_t source = primitive.firstIndex + 3 * order[t] + c;
+                sorted[primitive.firstIndex + 3 * t + c] = indexBuffer[source];
+                if (statistics) {
+                    indexFetches.push_back(source);
+                    vertexFetches.push_back(indexBuffer[source]);
+                }
+            }
+        }
+    }
+    printStatistics("Spatial fetches before reordering");
 
-    _app.copyBuffer(indexstagingBuffer, _indices.buffer, indexBufferSize);
+    // Primitives follow each other in the index buffer, so numbering by first use keeps the vertices of a mesh together
+    const std::vector<uint32_t> remap = getFirstUseOrder(sorted, vertexBuffer.size());
+    std::vector<Vertex> vertices(vertexBuffer.size());
+    for (size_t v = 0; v < vertexBuffer.size(); v++) {
+        vertices[remap[v]] = vertexBuffer[v];
+    }
+    vertexBuffer = std::move(vertices);
 
-    vkDestroyBuffer(_app._device, indexstagingBuffer, nullptr);
-    vkFreeMemory(_app._device, indexstagingBufferMemory, nullptr);
-    _loaded = true;
+    // Every index is renumbered, including the ones no primitive references, so none of them points to a moved vertex
+    for (size_t i = 0; i < indexBuffer.size(); i++) {
+        indexBuffer[i] = remap[sorted[i]];
+    }
+
+    if (statistics) {
+        indexFetches.clear();
+        vertexFetches.clear();
+        for (const Primitive& primitive : primitives) {
+            for (uint32_t i = primitive.firstIndex; i < primitive.firstIndex + primitive.indexCount; i++) {
+                indexFetches.push_back(i);
+                vertexFetches.push_back(indexBuffer[i]);
+            }
+        }
+    }
+    printStatistics("Spatial fetches after reordering");
+}
+
+void GltfLoader::createLevelsOfDetail(std::vector<uint32_t>& indexBuffer, const std::vector<glm::vec3>& positions)
+{
+    // One chain per node with geometry, the primitives of a node are contiguous in the index buffer
+    // The chains only hold the loaded level when USE_MESH_LODS is off, each mesh still gets its BLAS for the instances
+    std::vector<Node*> nodes;
+    for (const auto& node : _nodes) {
+        nodes.push_back(node.get());
+    }
+    for (size_t i = 0; i < nodes.size(); i++) {
+        for (const auto& child : nodes[i]->children) {
+            nodes.push_back(child.get());
+        }
+        if (nodes[i]->mesh.primitives.empty()) {
+            continue;
+        }
+
+        uint32_t firstIndex = UINT32_MAX;
+        uint32_t lastIndex = 0;
+        for (const Primitive& primitive : nodes[i]->mesh.primitives) {
+            firstIndex = std::min(firstIndex, primitive.firstIndex);
+            lastIndex = std::max(lastIndex, primitive.firstIndex + primitive.indexCount);
+        }
+        if (lastIndex <= firstIndex) {
+            continue;
+        }
+
+        MeshLod mesh {};
+        mesh.levels.push_back({ firstIndex, lastIndex - firstIndex });
+
+        glm::vec3 min(FLT_MAX);
+        glm::vec3 max(-FLT_MAX);
+        for (uint32_t j = firstIndex; j < lastIndex; j++) {
+            min = glm::min(min, positions[indexBuffer[j]]);
+            max = glm::max(max, positions[indexBuffer[j]]);
+        }
+        mesh.center = 0.5f * (min + max);
+        mesh.radius = 0.5f * glm::length(max - min);
+
+        mesh.instances = std::move(nodes[i]->instances);
+        if (mesh.instances.empty()) {
+            mesh.instances.push_back({ glm::mat4(1.f), -1 });
+        }
+
+        _meshLods.push_back(mesh);
+    }
+
+    // Each level halves the triangles of the previous one, meshes are simplified in parallel
+    std::vector<std::vector<std::vector<uint32_t>>> levels(_meshLods.size());
+    std::atomic<size_t> nextMesh { 0 };
+
+    const size_t nbWorkers = USE_MESH_LODS ? std::clamp<size_t>(std::thread::hardware_concurrency(), 1, std::max<size_t>(_meshLods.size(), 1)) : 0;
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < nbWorkers; w++) {
+        workers.emplace_back([&]() {
+            for (size_t m = nextMesh++; m < _meshLods.size(); m = nextMesh++) {
+                const LodLevel& original = _meshLods[m].levels[0];
+                std::vector<uint32_t> level(indexBuffer.begin() + original.firstIndex, indexBuffer.begin() + original.firstIndex + original.indexCount);
+
+                while (levels[m].size() + 1 < MAX_LOD_LEVELS && level.size() / 3 >= 2 * MIN_LOD_TRIANGLES) {
+                    std::vector<uint32_t> simplified = simplifyMesh(positions, level.data(), level.size(), level.size() / 2);
+
+                    // Stop when the mesh barely simplifies (mostly borders), the level would not be worth its BLAS
+                    if (simplified.size() * 4 > level.size() * 3) {
+                        break;
+                    }
+                    levels[m].push_back(simplified);
+                    level = std::move(simplified);
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // Merge in order, so the index buffer does not depend on the number of workers
+    size_t nbLevels = 0;
+    size_t nbInstances = 0;
+    for (size_t m = 0; m < _meshLods.size(); m++) {
+        for (const auto& level : levels[m]) {
+            _meshLods[m].levels.push_back({ static_cast<uint32_t>(indexBuffer.size()), static_cast<uint32_t>(level.size()) });
+            indexBuffer.insert(indexBuffer.end(), level.begin(), level.end());
+        }
+        nbLevels += _meshLods[m].levels.size();
+        nbInstances += _meshLods[m].instances.size();
+    }
+
+    if (Application::_verbose > 0) {
+        std::cout << "Generated " << nbLevels << " levels of detail for " << _meshLods.size() << " meshes (" << nbInstances << " instances)" << std::endl;
+    }
+}
+
+GltfLoader::Node& GltfLoader::addNode(uint32_t firstIndex, uint32_t indexCount, int32_t materialIndex)
+{
+    // Root node holding a single primitive, for generated geometry
+    _nodes.emplace_back(new GltfLoader::Node());
+    GltfLoader::Node& node = *_nodes.back();
+    node.parent = nullptr;
+    node.matrix = glm::mat4(1.f);
+    node.mesh.primitives.push_back({ firstIndex, indexCount, materialIndex });
+
+    _nbGeometries++;
+    _nbPrimitives = std::max<size_t>(_nbPrimitives, 1);
+
+    return node;
+}
+
+void GltfLoader::createDeviceBuffer(const void* src, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& memory)
+{
+    _app.createDeviceLocalBuffer(src, size, usage, buffer, memory);
+}
+
+void GltfLoader::createDeviceBuffer(const void* src, VkDeviceSize size, VkBufferUsageFlags usage, Buffer& buffer)
+{
+    createDeviceBuffer(src, size, usage, buffer.buffer, buffer.memory);
 }
 
 void GltfLoader::loadMaterials(tinygltf::Model& input)
@@ -355,3 +576,41 @@ void GltfLoader::update(float deltaTime)
     // What ever happend change light position to player
     _lights[0].pos = _app._character.getPosition();
 }
+
+void GltfLoader::trim()
+{
+    // Decoded images and raw buffers are on the GPU now, nodes and materials are kept for CPU queries
+    _model = tinygltf::Model();
+}
+
+size_t GltfLoader::getHostMemoryUsage() const
+{
+    size_t size = _materials.capacity() * sizeof(Material) + _lights.capacity() * sizeof(Light) + _spheres.capacity() * sizeof(Sphere);
+
+    for (const auto& mesh : _meshLods) {
+        size += sizeof(MeshLod) + mesh.levels.capacity() * sizeof(LodLevel) + mesh.instances.capacity() * sizeof(MeshInstance);
+    }
+
+    for (const auto& buffer : _model.buffers) {
+        size += buffer.data.capacity();
+    }
+
+    for (const auto& image : _model.images) {
+        size += image.image.capacity();
+    }
+
+    std::vector<const Node*> nodes;
+    for (const auto& node : _nodes) {
+        nodes.push_back(node.get());
+    }
+    while (!nodes.empty()) {
+        const Node* node = nodes.back();
+        nodes.pop_back();
+        size += sizeof(Node) + node->mesh.primitives.capacity() * sizeof(Primitive);
+        for (const auto& child : node->children) {
+            nodes.push_back(child.get());
+        }
+    }
+
+    return size;
+}
@@ -8,6 +8,13 @@
 
 class Application;
 
+// used to change to current coords (Y-up files to our Z-up world)
+constexpr glm::mat4 CHANGE_COORDS = glm::mat4(
+    1.f, 0.f, 0.f, 0.f,
+    0.f, 0.f, 1.f, 0.f,
+    0.f, 1.f, 0.f, 0.f,
+    0.f, 0.f, 0.f, 1.f);
+
 class GltfLoader {
 public:
     struct Material {
@@ -21,6 +28,16 @@ public:
         float reflexionCoeff = 0.f;
         float refractionCoeff = 0.f;
         float refractionIndice = 1.f;
+        int32_t normalTextureBC5 = 0; // The normal map only stores x and y, z is rebuilt by the shader
+    };
+
+    // Analytic ellipsoid traced as procedural geometry, matches the Sphere struct of the shaders
+    struct Sphere {
+        glm::vec3 center;
+        int32_t materialIndex;
+        glm::vec4 rotation; // Quaternion (x, y, z, w)
+        glm::vec3 radii;
+        float padding;
     };
 
     // A primitive contains the data for a single draw call
@@ -35,18 +52,39 @@ public:
         std::vector<Primitive> primitives;
     };
 
+    // One copy of a mesh in the scene, with a material replacing the one of its vertices
+    struct MeshInstance {
+        glm::mat4 transform;
+        int32_t materialIndex; // -1 keeps the material of the vertices
+    };
+
     // A node represents an object in the glTF scene graph
     struct Node {
         Node* parent;
         std::vector<std::shared_ptr<Node>> children;
         Mesh mesh;
         glm::mat4 matrix;
+        std::vector<MeshInstance> instances; // A single untransformed copy if empty, handed over to the MeshLod
     };
 
     struct Texture {
         int32_t imageIndex;
     };
 
+    // Index range of one level of detail in the index buffer
+    struct LodLevel {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+    };
+
+    // Simplified versions of the geometry of one node, level 0 is the loaded geometry
+    struct MeshLod {
+        std::vector<LodLevel> levels;
+        glm::vec3 center;
+        float radius;
+        std::vector<MeshInstance> instances;
+    };
+
 public:
     GltfLoader(Application& app);
     ~GltfLoader();
@@ -61,27 +99,46 @@ public:
 
     virtual void update(float deltaTime);
 
+    // Releases the CPU copies of the scene once it is uploaded
+    virtual void trim();
+    virtual size_t getHostMemoryUsage() const;
+
 protected:
     void createBuffers(std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer);
+    void reorderForLocality(std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer) const;
+    void createLevelsOfDetail(std::vector<uint32_t>& indexBuffer, const std::vector<glm::vec3>& positions);
+    Node& addNode(uint32_t firstIndex, uint32_t indexCount, int32_t materialIndex);
+    void createDeviceBuffer(const void* src, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& memory);
+    void createDeviceBuffer(const void* src, VkDeviceSize size, VkBufferUsageFlags usage, Buffer& buffer);
     void loadMaterials(tinygltf::Model& input);
     void loadTextures(tinygltf::Model& input);
 
 protected:
-    std::vector<TextureModule> _textures;
+    std::vector<std::shared_ptr<TextureModule>> _textures;
     std::vector<Texture> _textures_idx;
     std::vector<SamplerModule> _samplers;
     std::vector<Material> _materials;
     std::vector<std::shared_ptr<Node>> _nodes;
     std::vector<VkDescriptorSet> _descriptorSets;
     std::vector<Light> _lights;
+    std::vector<Sphere> _spheres;
+    std::vector<MeshLod> _meshLods;
     size_t _nbPrimitives;
     size_t _nbGeometries;
+    size_t _vertexCount { 0 };
 
     Application& _app;
 
-    // Single vertex buffer for all primitives
+    // Single vertex buffer for all primitives (PackedVertex attributes)
     Buffer _vertices;
 
+    // Tightly packed float3 positions matching _vertices, used to build the BLAS
+    Buffer _positions;
+
+    // Analytic spheres (at least one element to keep the descriptor valid) and their bounding boxes for the procedural BLAS
+    Buffer _sphereBuffer {};
+    Buffer _sphereAabbs {};
+
     // Single index buffer for all primitives
     struct {
         int count;
@@ -0,0 +1,33 @@
+// Packing of the G-buffer features shared by the ray generation shader and the denoising passes
+
+// Octahedral mapping of a unit vector to [-1, 1]^2, from "A Survey of Efficient Representations for Independent Unit Vectors" (Cigolle et al.)
+vec2 octahedralEncode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return n.xy;
+}
+
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	const float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+// Material of the pixels where the camera ray missed the scene
+#define GBUFFER_NO_MATERIAL 0xFFFFu
+
+// Sampling priorities in [0, 1] are summed as integers of this scale, the ray generation shader uses the same rounded values
+#define SAMPLE_PRIORITY_SCALE 256.0
+
+// Albedo the illumination images are divided by, the same 8 bit value the denoisers read back from the G-buffer
+// Filtering the illumination alone keeps the texture details sharp
+vec3 getDemodulationAlbedo(vec3 albedo)
+{
+	return max(round(clamp(albedo, 0.0, 1.0) * 255.0) / 255.0, vec3(1.0 / 255.0));
+}
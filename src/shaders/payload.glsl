@@ -0,0 +1,16 @@
+// Payload of the primary and reflection rays, shared by the ray generation, closest hit and miss shaders
+
+struct RayPayload {
+	vec3 color;
+	float distance;
+	vec3 normal;
+	float reflector;
+	float coneWidth; // Ray cone width at the ray origin, updated to the hit point
+	float coneSpread; // Ray cone spread angle
+	vec3 albedo; // Surface color before lighting, for the G-buffer
+	int materialId;
+	vec3 direct; // Lighting from the light sources, part of the lighting the albedo is multiplied by
+	bool stochasticShadow; // Set by the caller for the soft shadows, the lights are then unshadowed and a single shadow ray samples them
+	vec3 visibility; // Result of that ray : visibility, (1 - visibility) times the blocker distance, and the distance to the light
+	uint sampleIndex; // Path of the pixel, for its random numbers
+};
@@ -0,0 +1,15 @@
+// Hash based random numbers, shared by the ray tracing and compute shaders
+
+// PCG hash, from "Hash Functions for GPU Rendering" (Jarzynski and Olano)
+uint pcgHash(uint v)
+{
+	const uint state = v * 747796405u + 2891336453u;
+	const uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+float random(inout uint seed)
+{
+	seed = pcgHash(seed);
+	return float(seed >> 8) / 16777216.0;
+}
@@ -0,0 +1,232 @@
+// Lighting shared by the closest hit shaders
+// Requires GL_EXT_ray_tracing and GL_EXT_nonuniform_qualifier
+#define PI 3.1415926538
+
+#include "random.glsl"
+#include "payload.glsl"
+
+layout(location = 0) rayPayloadInEXT RayPayload hitValue;
+layout(location = 2) rayPayloadEXT float shadowDistance; // Distance to the blocker, negative when the shadow ray reaches the light
+
+layout(binding = 0, set = 0) uniform UBO 
+{
+	mat4 viewInverse;
+	mat4 projInverse;
+	mat4 prevViewInverse;
+	mat4 prevProjInverse;
+	mat4 prevViewProj;
+	int vertexSize;
+	uint frameIndex;
+	bool useIrradianceSH;
+	bool useSoftShadows;
+	float lightRadius;
+	uint maxExtraPaths;
+	float extraPathBudget;
+	vec4 irradianceSH[9];
+} ubo;
+
+layout(binding = 1, set = 0) uniform accelerationStructureEXT topLevelAS;
+layout(binding = 5, set = 0) uniform Material 
+{ 
+	vec4 baseColorFactor;
+	int baseColorTextureIndex;
+	int normalTextureIndex;
+	float ambientCoeff;
+    float diffuseCoeff;
+    float specularCoeff;
+    float shininessCoeff;
+    float reflexionCoeff;
+    float refractionCoeff;
+    float refractionIndice;
+    int normalTextureBC5; // The normal map only stores x and y, z is rebuilt from the unit length
+} materials[];
+
+layout(binding = 6, set = 0) uniform Light 
+{ 
+    vec4 color;
+    vec3 pos;
+    float intensity;
+} lights[];
+
+// Marginal CDF of the environment map rows, then the conditional CDF of every row
+layout(binding = 8, set = 0) buffer EnvironmentDistribution { float cdf[]; } environment;
+
+
+layout( push_constant ) uniform ColorBlock {
+  int nbLights;
+} PushConstant;
+
+layout(binding = 0, set = 1) uniform sampler2D texSamplers[];
+layout(binding = 2, set = 1) uniform samplerCube irradianceCube;
+
+// Last entry of cdf[first, first + count[ lower or equal to u
+int findInterval(int first, int count, float u)
+{
+	int low = 0;
+	int high = count - 1;
+	while (low < high) {
+		const int middle = (low + high + 1) / 2;
+		if (environment.cdf[first + middle] <= u) {
+			low = middle;
+		} else {
+			high = middle - 1;
+		}
+	}
+	return low;
+}
+
+// Picks a direction proportionally to the luminance of the environment map (texSamplers[0])
+// Returns the direction with its solid angle pdf, and its texture coordinates
+vec3 sampleEnvironment(vec2 u, out float pdf, out vec2 uv)
+{
+	const ivec2 size = textureSize(texSamplers[0], 0);
+
+	const int y = findInterval(0, size.y, u.y);
+	const float marginalPdf = environment.cdf[y + 1] - environment.cdf[y];
+	const float dv = (u.y - environment.cdf[y]) / max(marginalPdf, 1e-8);
+
+	const int row = size.y + 1 + y * (size.x + 1);
+	const int x = findInterval(row, size.x, u.x);
+	const float conditionalPdf = environment.cdf[row + x + 1] - environment.cdf[row + x];
+	const float du = (u.x - environment.cdf[row + x]) / max(conditionalPdf, 1e-8);
+
+	// Same mapping as the miss shader, v = 0 is up (+z)
+	uv = vec2((x + du) / size.x, (y + dv) / size.y);
+	const float theta = uv.y * PI;
+	const float phi = uv.x * 2.0 * PI - PI;
+	const float sinTheta = sin(theta);
+
+	pdf = marginalPdf * size.y * conditionalPdf * size.x / (2.0 * PI * PI * max(sinTheta, 1e-6));
+	return vec3(sinTheta * cos(phi), sinTheta * sin(phi), cos(theta));
+}
+
+// Irradiance (divided by pi) around n from the spherical harmonics of the environment
+vec3 evaluateIrradianceSH(vec3 n)
+{
+	vec3 irradiance = 0.282095 * ubo.irradianceSH[0].rgb;
+	irradiance += 0.488603 * (n.y * ubo.irradianceSH[1].rgb + n.z * ubo.irradianceSH[2].rgb + n.x * ubo.irradianceSH[3].rgb);
+	irradiance += 1.092548 * (n.x * n.y * ubo.irradianceSH[4].rgb + n.y * n.z * ubo.irradianceSH[5].rgb + n.x * n.z * ubo.irradianceSH[7].rgb);
+	irradiance += 0.315392 * (3.0 * n.z * n.z - 1.0) * ubo.irradianceSH[6].rgb;
+	irradiance += 0.546274 * (n.x * n.x - n.y * n.y) * ubo.irradianceSH[8].rgb;
+	return max(irradiance, vec3(0.));
+}
+
+// Lights the hit point and fills the payload
+// With the soft shadows, the analytic unshadowed lighting is returned with the visibility of one light point,
+// picked in proportion to the contribution of its light, as in "Combining Analytic Direct Illumination and Stochastic Shadows" (Heitz et al.)
+// The denoiser multiplies the direct lighting by that visibility once filtered
+void shadeHit(vec3 normal, vec4 color, int materialId, float coneWidth)
+{
+	const vec3 origin = gl_WorldRayOriginEXT + gl_WorldRayDirectionEXT * gl_HitTEXT;
+	const uint pixelIndex = gl_LaunchIDEXT.x + gl_LaunchIDEXT.y * gl_LaunchSizeEXT.x;
+	uint seed = pcgHash(pixelIndex + hitValue.sampleIndex * gl_LaunchSizeEXT.x * gl_LaunchSizeEXT.y) ^ pcgHash(ubo.frameIndex ^ floatBitsToUint(gl_HitTEXT));
+	const bool stochasticShadow = ubo.useSoftShadows && hitValue.stochasticShadow;
+
+	// Single light reservoir, every light replaces the kept one with the probability of its share of the contributions so far
+	int sampledLight = -1;
+	float totalWeight = 0.;
+
+	// Basic lighting
+	vec4 lightColor = vec4(0.,0.,0.,1.);
+	for (int i = 0; i < PushConstant.nbLights; i ++)
+	{
+		const vec3 lightVector = normalize(lights[i].pos - origin);
+		const float lightDistance = length(lights[i].pos - origin);
+		const float distanceFactor = min(1., 20. * lights[i].intensity / (lightDistance * lightDistance));
+		const float dot_product = dot(lightVector, normal);
+
+		if (dot_product > 0.) {
+			const float tmin = 0.001;
+			const float tmax = 10000.0;
+
+			bool shadowed = false;
+			if (!stochasticShadow) {
+				shadowDistance = 0.;
+				//	 Trace shadow ray and offset indices to match shadow hit/miss shader group indices
+				traceRayEXT(topLevelAS, gl_RayFlagsTerminateOnFirstHitEXT | gl_RayFlagsOpaqueEXT | gl_RayFlagsSkipClosestHitShaderEXT, 0xFF, 1, 0, 1, origin, tmin, lightVector, tmax, 2);
+				shadowed = shadowDistance >= 0.;
+			}
+			const float gouraudFactor = distanceFactor * materials[materialId].diffuseCoeff * dot_product;
+
+			vec3 contribution = lights[i].color.rgb * gouraudFactor;
+			if (shadowed) {
+				contribution *= 0.3;
+			} else {
+				const float alignement = dot(normalize(reflect(lightVector, normal)), gl_WorldRayDirectionEXT);
+				if (alignement > 0.)
+				{
+					const float phongfactor =distanceFactor *  materials[materialId].specularCoeff * pow(alignement, materials[materialId].shininessCoeff);
+					contribution += phongfactor * lights[i].color.rgb;
+
+				}
+			}
+			lightColor.rgb += contribution;
+
+			if (stochasticShadow) {
+				const float weight = dot(contribution, vec3(0.2126, 0.7152, 0.0722));
+				totalWeight += weight;
+				if (random(seed) * totalWeight < weight) {
+					sampledLight = i;
+				}
+			}
+		}
+	}
+
+	vec3 directColor = lightColor.rgb;
+
+	// Shadow ray towards a random point of the sampled light, a disk facing the hit point
+	// It does not skip the closest hit shader, which returns the distance to the first blocker found
+	hitValue.visibility = vec3(1., 0., 0.);
+	if (sampledLight >= 0) {
+		const vec3 axis = normalize(lights[sampledLight].pos - origin);
+		const vec3 tangent = normalize(cross(axis, abs(axis.x) > 0.9 ? vec3(0., 1., 0.) : vec3(1., 0., 0.)));
+		const vec3 bitangent = cross(axis, tangent);
+		const float radius = ubo.lightRadius * sqrt(random(seed));
+		const float angle = 2. * PI * random(seed);
+		const vec3 target = lights[sampledLight].pos + radius * (cos(angle) * tangent + sin(angle) * bitangent);
+		const float lightDistance = length(target - origin);
+
+		shadowDistance = -1.;
+		traceRayEXT(topLevelAS, gl_RayFlagsTerminateOnFirstHitEXT | gl_RayFlagsOpaqueEXT, 0xFF, 1, 0, 1, origin, 0.001, (target - origin) / lightDistance, lightDistance, 2);
+		hitValue.visibility = shadowDistance < 0. ? vec3(1., 0., lightDistance) : vec3(0., shadowDistance, lightDistance);
+	}
+
+	// Ambient term from the prefiltered environment, already divided by pi
+	const vec3 irradiance = ubo.useIrradianceSH ? evaluateIrradianceSH(normal) : textureLod(irradianceCube, normal, 0.).rgb;
+	lightColor.rgb += materials[materialId].ambientCoeff * irradiance;
+
+	// Environment lighting, one importance sampled direction per hit
+	{
+		float environmentPdf;
+		vec2 environmentUv;
+		const vec3 environmentDirection = sampleEnvironment(vec2(random(seed), random(seed)), environmentPdf, environmentUv);
+		const float cosine = dot(environmentDirection, normal);
+
+		if (cosine > 0. && environmentPdf > 0.) {
+			const float tmin = 0.001;
+			const float tmax = 10000.0;
+
+			shadowDistance = 0.;
+			traceRayEXT(topLevelAS, gl_RayFlagsTerminateOnFirstHitEXT | gl_RayFlagsOpaqueEXT | gl_RayFlagsSkipClosestHitShaderEXT, 0xFF, 1, 0, 1, origin, tmin, environmentDirection, tmax, 2);
+
+			if (shadowDistance < 0.) {
+				const vec3 radiance = textureLod(texSamplers[0], environmentUv, 0.).rgb;
+				lightColor.rgb += radiance * materials[materialId].diffuseCoeff * cosine / (PI * environmentPdf);
+			}
+		}
+	}
+
+	// The direct part keeps its share of the clamped lighting
+	const vec3 clampedColor = min(vec3(1.), lightColor.rgb);
+	directColor *= clampedColor / max(lightColor.rgb, vec3(1e-6));
+	lightColor = vec4(clampedColor, 1.);
+
+	hitValue.color = (lightColor * color).xyz;
+	hitValue.distance = gl_HitTEXT;
+	hitValue.normal = normal;
+	hitValue.reflector = materials[materialId].reflexionCoeff;
+	hitValue.coneWidth = coneWidth;
+	hitValue.albedo = color.rgb;
+	hitValue.materialId = materialId;
+	hitValue.direct = directColor;
+}
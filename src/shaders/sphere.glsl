@@ -0,0 +1,20 @@
+// Analytic ellipsoids, one per AABB of the procedural BLAS
+struct Sphere {
+	vec3 center;
+	int materialId;
+	vec4 rotation; // Quaternion (x, y, z, w)
+	vec3 radii;
+	float padding;
+};
+
+layout(binding = 9, set = 0) buffer Spheres { Sphere s[]; } spheres;
+
+vec3 rotate(vec4 q, vec3 v)
+{
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+vec3 inverseRotate(vec4 q, vec3 v)
+{
+	return rotate(vec4(-q.xyz, q.w), v);
+}
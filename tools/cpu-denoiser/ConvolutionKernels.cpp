@@ -0,0 +1,100 @@
+#include "ConvolutionKernels.hpp"
+
+#include "ImageUtils.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+Tensor::Tensor(uint32_t width, uint32_t height, uint32_t nbChannels)
+    : width(width)
+    , height(height)
+    , nbChannels(getPaddedChannels(nbChannels))
+    , data(static_cast<size_t>(width) * height * this->nbChannels, 0)
+{
+}
+
+uint16_t* Tensor::at(uint32_t x, uint32_t y)
+{
+    return data.data() + (static_cast<size_t>(y) * width + x) * nbChannels;
+}
+
+const uint16_t* Tensor::at(uint32_t x, uint32_t y) const
+{
+    return data.data() + (static_cast<size_t>(y) * width + x) * nbChannels;
+}
+
+uint32_t getPaddedChannels(uint32_t nbChannels)
+{
+    return (nbChannels + CHANNEL_BLOCK - 1) / CHANNEL_BLOCK * CHANNEL_BLOCK;
+}
+
+void convolveRowScalar(const ConvolutionLayer& layer, const Tensor& input, uint32_t y, uint32_t x0, uint32_t x1, Tensor& output)
+{
+    const uint32_t nbInputs = layer.inputChannels;
+    const uint32_t rowLength = x1 - x0 + 2;
+
+    // The three input rows around y as floats, with the zero padding, converted once for all the outputs
+    thread_local std::vector<float> rows;
+    rows.assign(static_cast<size_t>(3) * rowLength * nbInputs, 0.f);
+    for (uint32_t r = 0; r < 3; r++) {
+        const int64_t ty = static_cast<int64_t>(y) + r - 1;
+        if (ty < 0 || ty >= input.height) {
+            continue;
+        }
+        for (uint32_t i = 0; i < rowLength; i++) {
+            const int64_t tx = static_cast<int64_t>(x0) + i - 1;
+            if (tx < 0 || tx >= input.width) {
+                continue;
+            }
+            const uint16_t* src = input.at(static_cast<uint32_t>(tx), static_cast<uint32_t>(ty));
+            float* dst = &rows[(static_cast<size_t>(r) * rowLength + i) * nbInputs];
+            for (uint32_t c = 0; c < nbInputs; c++) {
+                dst[c] = halfToFloat(src[c]);
+            }
+        }
+    }
+
+    for (uint32_t x = x0; x < x1; x++) {
+        uint16_t* dst = output.at(x, y);
+        for (uint32_t block = 0; block < layer.outputChannels / CHANNEL_BLOCK; block++) {
+            float sums[CHANNEL_BLOCK];
+            std::copy_n(&layer.biases[block * CHANNEL_BLOCK], CHANNEL_BLOCK, sums);
+
+            for (uint32_t ky = 0; ky < 3; ky++) {
+                for (uint32_t kx = 0; kx < 3; kx++) {
+                    const float* tap = &rows[(static_cast<size_t>(ky) * rowLength + (x - x0) + kx) * nbInputs];
+                    const uint16_t* weights = &layer.weights[((static_cast<size_t>(block) * 9 + ky * 3 + kx) * nbInputs) * CHANNEL_BLOCK];
+                    for (uint32_t c = 0; c < nbInputs; c++) {
+                        for (uint32_t o = 0; o < CHANNEL_BLOCK; o++) {
+                            sums[o] += tap[c] * halfToFloat(weights[c * CHANNEL_BLOCK + o]);
+                        }
+                    }
+                }
+            }
+
+            for (uint32_t o = 0; o < CHANNEL_BLOCK; o++) {
+                dst[block * CHANNEL_BLOCK + o] = floatToHalf(layer.relu ? std::max(sums[o], 0.f) : sums[o]);
+            }
+        }
+    }
+}
+
+ConvolutionRowFunction getConvolutionRowFunction(KernelIsa isa)
+{
+    switch (isa) {
+    case KernelIsa::Scalar:
+    case KernelIsa::Neon:
+        return convolveRowScalar;
+#if defined(CPU_DENOISER_AVX2)
+    case KernelIsa::Avx2:
+        if (isAvx2Supported() && isF16cSupported()) {
+            return convolveRowAvx2;
+        }
+        break;
+#endif
+    default:
+        break;
+    }
+    throw std::runtime_error(std::string(getKernelIsaName(isa)) + " convolutions are not available on this machine");
+}
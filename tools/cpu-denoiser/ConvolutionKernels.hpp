@@ -0,0 +1,52 @@
+#pragma once
+
+#include "FilterKernels.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Direct 3x3 convolutions of the denoising network, shared by the scalar and AVX2 implementations
+// Activations and weights are half floats, to halve the memory traffic, the sums are done in floats
+
+constexpr uint32_t CHANNEL_BLOCK = 8; // Channels are padded to a multiple of it, the padding holds zeros
+
+// Pixels from the top row, each with all its channels (HWC), so a tap reads contiguous channels
+struct Tensor {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t nbChannels = 0; // Multiple of CHANNEL_BLOCK
+    std::vector<uint16_t> data;
+
+    Tensor() = default;
+    Tensor(uint32_t width, uint32_t height, uint32_t nbChannels);
+
+    uint16_t* at(uint32_t x, uint32_t y);
+    const uint16_t* at(uint32_t x, uint32_t y) const;
+};
+
+uint32_t getPaddedChannels(uint32_t nbChannels);
+
+// Zero padded 3x3 convolution, optionally followed by a ReLU
+// Weights are grouped by blocks of CHANNEL_BLOCK outputs : [output block][ky][kx][input][output in the block]
+struct ConvolutionLayer {
+    uint32_t inputChannels = 0; // Padded
+    uint32_t outputChannels = 0; // Padded
+    bool relu = true;
+    std::vector<uint16_t> weights;
+    std::vector<float> biases; // One per padded output channel
+};
+
+// Computes the pixels [x0, x1) of row y
+using ConvolutionRowFunction = void (*)(const ConvolutionLayer& layer, const Tensor& input, uint32_t y, uint32_t x0, uint32_t x1, Tensor& output);
+
+// There is no NEON convolution, it falls back to the scalar one
+// Throws if the ISA is not available on this machine
+ConvolutionRowFunction getConvolutionRowFunction(KernelIsa isa);
+
+void convolveRowScalar(const ConvolutionLayer& layer, const Tensor& input, uint32_t y, uint32_t x0, uint32_t x1, Tensor& output);
+
+#if defined(CPU_DENOISER_AVX2)
+// AVX2 with FMA and F16C
+bool isF16cSupported();
+void convolveRowAvx2(const ConvolutionLayer& layer, const Tensor& input, uint32_t y, uint32_t x0, uint32_t x1, Tensor& output);
+#endif
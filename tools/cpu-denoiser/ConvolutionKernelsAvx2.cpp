@@ -0,0 +1,123 @@
+#include "ConvolutionKernels.hpp"
+
+#include <algorithm>
+
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Compiled with AVX2, FMA and F16C enabled, only called after isAvx2Supported and isF16cSupported
+
+bool isF16cSupported()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 29)) != 0;
+#else
+    return __builtin_cpu_supports("f16c");
+#endif
+}
+
+// Eight output channels of NB_PIXELS consecutive pixels for each of NB_BLOCKS output blocks, all in registers
+// A weight vector is loaded once for all the pixels, an input value is broadcast once for all the blocks
+template <int NB_PIXELS, int NB_BLOCKS>
+static inline void convolveBlocks(const ConvolutionLayer& layer, const float* rows, uint32_t rowLength, uint32_t column, uint32_t firstBlock, uint16_t* const* outputs)
+{
+    const uint32_t nbInputs = layer.inputChannels;
+
+    __m256 sums[NB_BLOCKS][NB_PIXELS];
+    for (int b = 0; b < NB_BLOCKS; b++) {
+        const __m256 bias = _mm256_loadu_ps(&layer.biases[(firstBlock + b) * CHANNEL_BLOCK]);
+        for (int p = 0; p < NB_PIXELS; p++) {
+            sums[b][p] = bias;
+        }
+    }
+
+    for (uint32_t ky = 0; ky < 3; ky++) {
+        for (uint32_t kx = 0; kx < 3; kx++) {
+            const float* tap = rows + (static_cast<size_t>(ky) * rowLength + column + kx) * nbInputs;
+            const uint16_t* weights[NB_BLOCKS];
+            for (int b = 0; b < NB_BLOCKS; b++) {
+                weights[b] = &layer.weights[((static_cast<size_t>(firstBlock + b) * 9 + ky * 3 + kx) * nbInputs) * CHANNEL_BLOCK];
+            }
+
+            for (uint32_t c = 0; c < nbInputs; c++) {
+                __m256 weight[NB_BLOCKS];
+                for (int b = 0; b < NB_BLOCKS; b++) {
+                    weight[b] = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(weights[b] + c * CHANNEL_BLOCK)));
+                }
+                for (int p = 0; p < NB_PIXELS; p++) {
+                    const __m256 value = _mm256_broadcast_ss(tap + p * nbInputs + c);
+                    for (int b = 0; b < NB_BLOCKS; b++) {
+                        sums[b][p] = _mm256_fmadd_ps(value, weight[b], sums[b][p]);
+                    }
+                }
+            }
+        }
+    }
+
+    for (int b = 0; b < NB_BLOCKS; b++) {
+        for (int p = 0; p < NB_PIXELS; p++) {
+            const __m256 result = layer.relu ? _mm256_max_ps(sums[b][p], _mm256_setzero_ps()) : sums[b][p];
+            const __m128i halves = _mm256_cvtps_ph(result, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(outputs[p] + (firstBlock + b) * CHANNEL_BLOCK), halves);
+        }
+    }
+}
+
+// Output blocks two at a time, 4 pixels x 2 blocks of sums leave registers for the weights and the broadcast
+template <int NB_PIXELS>
+static void convolvePixels(const ConvolutionLayer& layer, const float* rows, uint32_t rowLength, uint32_t column, uint16_t* const* outputs)
+{
+    const uint32_t nbBlocks = layer.outputChannels / CHANNEL_BLOCK;
+    uint32_t block = 0;
+    for (; block + 2 <= nbBlocks; block += 2) {
+        convolveBlocks<NB_PIXELS, 2>(layer, rows, rowLength, column, block, outputs);
+    }
+    if (block < nbBlocks) {
+        convolveBlocks<NB_PIXELS, 1>(layer, rows, rowLength, column, block, outputs);
+    }
+}
+
+void convolveRowAvx2(const ConvolutionLayer& layer, const Tensor& input, uint32_t y, uint32_t x0, uint32_t x1, Tensor& output)
+{
+    constexpr uint32_t NB_PIXELS = 4;
+
+    const uint32_t nbInputs = layer.inputChannels;
+    const uint32_t rowLength = x1 - x0 + 2;
+
+    // The three input rows around y as floats, with the zero padding, so the inputs can be broadcast from memory
+    thread_local std::vector<float> rows;
+    rows.resize(static_cast<size_t>(3) * rowLength * nbInputs);
+    for (uint32_t r = 0; r < 3; r++) {
+        const int64_t ty = static_cast<int64_t>(y) + r - 1;
+        for (uint32_t i = 0; i < rowLength; i++) {
+            const int64_t tx = static_cast<int64_t>(x0) + i - 1;
+            float* dst = &rows[(static_cast<size_t>(r) * rowLength + i) * nbInputs];
+            if (ty < 0 || ty >= input.height || tx < 0 || tx >= input.width) {
+                std::fill_n(dst, nbInputs, 0.f);
+                continue;
+            }
+            const uint16_t* src = input.at(static_cast<uint32_t>(tx), static_cast<uint32_t>(ty));
+            for (uint32_t c = 0; c < nbInputs; c += CHANNEL_BLOCK) {
+                _mm256_storeu_ps(dst + c, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + c))));
+            }
+        }
+    }
+
+    uint16_t* outputs[NB_PIXELS];
+    uint32_t x = x0;
+    for (; x + NB_PIXELS <= x1; x += NB_PIXELS) {
+        for (uint32_t p = 0; p < NB_PIXELS; p++) {
+            outputs[p] = output.at(x + p, y);
+        }
+        convolvePixels<NB_PIXELS>(layer, rows.data(), rowLength, x - x0, outputs);
+    }
+    for (; x < x1; x++) {
+        outputs[0] = output.at(x, y);
+        convolvePixels<1>(layer, rows.data(), rowLength, x - x0, outputs);
+    }
+}
@@ -0,0 +1,145 @@
+#include "FilterKernels.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+void filterPixel(const FilterPlanes& planes, const EdgeStopping& edges, const std::vector<FilterTap>& taps,
+    uint32_t x, uint32_t y, const FilterOutput& output)
+{
+    const size_t center = static_cast<size_t>(y) * planes.width + x;
+
+    // The sky is not noisy, and must not bleed onto the geometry
+    if (planes.depth && planes.depth[center] <= 0.f) {
+        for (size_t c = 0; c < 3; c++) {
+            output.color[c][center] = planes.color[c][center];
+        }
+        if (planes.variance) {
+            output.variance[center] = planes.variance[center];
+        }
+        return;
+    }
+
+    float colorSum[3] = { 0.f, 0.f, 0.f };
+    float varianceSum = 0.f;
+    float weightSum = 0.f;
+
+    for (const FilterTap& tap : taps) {
+        const int64_t tx = static_cast<int64_t>(x) + tap.dx;
+        const int64_t ty = static_cast<int64_t>(y) + tap.dy;
+        if (tx < 0 || ty < 0 || tx >= planes.width || ty >= planes.height) {
+            continue;
+        }
+
+        const size_t index = static_cast<size_t>(ty) * planes.width + static_cast<size_t>(tx);
+        if (planes.depth && planes.depth[index] <= 0.f) {
+            continue;
+        }
+
+        // All the edge-stopping functions are exponentials, their exponents are summed to evaluate a single one
+        float exponent = 0.f;
+        if (edges.colorDistance == ColorDistance::Luminance) {
+            exponent = std::abs(planes.luminance[center] - planes.luminance[index]) * planes.colorScale[center];
+        } else {
+            float distance = 0.f;
+            for (size_t c = 0; c < 3; c++) {
+                const float delta = planes.color[c][center] - planes.color[c][index];
+                distance += delta * delta;
+            }
+            exponent = distance * planes.colorScale[center];
+        }
+
+        if (planes.normal[0]) {
+            float cosine = 0.f;
+            for (size_t c = 0; c < 3; c++) {
+                cosine += planes.normal[c][center] * planes.normal[c][index];
+            }
+            exponent += (1.f - cosine) * edges.normalScale;
+        }
+
+        if (planes.depth) {
+            exponent += std::abs(planes.depth[center] - planes.depth[index]) * planes.depthScale[center] * tap.depthScale;
+        }
+
+        if (planes.albedo[0]) {
+            float distance = 0.f;
+            for (size_t c = 0; c < 3; c++) {
+                const float delta = planes.albedo[c][center] - planes.albedo[c][index];
+                distance += delta * delta;
+            }
+            exponent += distance * edges.albedoScale;
+        }
+
+        const float weight = tap.weight * std::exp(-exponent);
+        for (size_t c = 0; c < 3; c++) {
+            colorSum[c] += weight * planes.color[c][index];
+        }
+        if (planes.variance) {
+            varianceSum += weight * weight * planes.variance[index];
+        }
+        weightSum += weight;
+    }
+
+    // The center tap always has a non zero weight
+    for (size_t c = 0; c < 3; c++) {
+        output.color[c][center] = colorSum[c] / weightSum;
+    }
+    if (planes.variance) {
+        output.variance[center] = varianceSum / (weightSum * weightSum);
+    }
+}
+
+void filterSpanScalar(const FilterPlanes& planes, const EdgeStopping& edges, const std::vector<FilterTap>& taps,
+    uint32_t y, uint32_t x0, uint32_t x1, const FilterOutput& output)
+{
+    for (uint32_t x = x0; x < x1; x++) {
+        filterPixel(planes, edges, taps, x, y, output);
+    }
+}
+
+KernelIsa getBestKernelIsa()
+{
+#if defined(CPU_DENOISER_AVX2)
+    if (isAvx2Supported()) {
+        return KernelIsa::Avx2;
+    }
+#endif
+#if defined(CPU_DENOISER_NEON)
+    return KernelIsa::Neon;
+#endif
+    return KernelIsa::Scalar;
+}
+
+FilterSpanFunction getFilterSpanFunction(KernelIsa isa)
+{
+    switch (isa) {
+    case KernelIsa::Scalar:
+        return filterSpanScalar;
+#if defined(CPU_DENOISER_AVX2)
+    case KernelIsa::Avx2:
+        if (isAvx2Supported()) {
+            return filterSpanAvx2;
+        }
+        break;
+#endif
+#if defined(CPU_DENOISER_NEON)
+    case KernelIsa::Neon:
+        return filterSpanNeon;
+#endif
+    default:
+        break;
+    }
+    throw std::runtime_error(std::string(getKernelIsaName(isa)) + " kernels are not available on this machine");
+}
+
+const char* getKernelIsaName(KernelIsa isa)
+{
+    switch (isa) {
+    case KernelIsa::Avx2:
+        return "AVX2";
+    case KernelIsa::Neon:
+        return "NEON";
+    default:
+        return "scalar";
+    }
+}
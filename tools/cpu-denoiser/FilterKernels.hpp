@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Inner loop of the edge-avoiding filters, shared by the scalar, AVX2 and NEON implementations
+// Every plane is a width x height array of floats, the optional ones are null when the feature is missing
+
+enum class KernelIsa {
+    Scalar,
+    Avx2, // x86 with AVX2 and FMA, checked at runtime
+    Neon, // AArch64
+};
+
+enum class ColorDistance {
+    RgbSquared, // Squared RGB distance, as the bilateral filter
+    Luminance, // Absolute luminance difference, as the a-trous and SVGF shaders
+};
+
+struct FilterPlanes {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::array<const float*, 3> color {};
+    const float* luminance = nullptr; // Required by ColorDistance::Luminance
+    const float* variance = nullptr; // Filtered with the squared weights when not null
+    std::array<const float*, 3> normal {}; // Unit length
+    const float* depth = nullptr; // Taps with a depth <= 0 (sky) are ignored, and the sky is left as is
+    std::array<const float*, 3> albedo {};
+
+    const float* colorScale = nullptr; // Divides the color distance, per center pixel
+    const float* depthScale = nullptr; // Inverse of the relative depth tolerance of the center pixel, required with the depth
+};
+
+struct EdgeStopping {
+    ColorDistance colorDistance = ColorDistance::Luminance;
+    float normalScale = 0.f; // pow(cos, phi) is approximated by exp(-phi * (1 - cos)), both match near 1
+    float albedoScale = 0.f; // Inverse of the squared albedo distance tolerated
+};
+
+struct FilterTap {
+    int32_t dx = 0;
+    int32_t dy = 0;
+    float weight = 0.f; // Spatial kernel
+    float depthScale = 0.f; // Inverse of the distance to the center, 0 for the center itself
+};
+
+struct FilterOutput {
+    std::array<float*, 3> color {};
+    float* variance = nullptr; // Written when the planes have a variance
+};
+
+// Filters the pixels [x0, x1) of row y, the taps are assumed to contain the center
+using FilterSpanFunction = void (*)(const FilterPlanes& planes, const EdgeStopping& edges, const std::vector<FilterTap>& taps,
+    uint32_t y, uint32_t x0, uint32_t x1, const FilterOutput& output);
+
+KernelIsa getBestKernelIsa();
+// Throws if the ISA is not available on this machine
+FilterSpanFunction getFilterSpanFunction(KernelIsa isa);
+const char* getKernelIsaName(KernelIsa isa);
+
+// Scalar reference, also used by the SIMD kernels for the pixels whose taps cross the borders
+void filterPixel(const FilterPlanes& planes, const EdgeStopping& edges, const std::vector<FilterTap>& taps,
+    uint32_t x, uint32_t y, const FilterOutput& output);
+void filterSpanScalar(const FilterPlanes& planes, const EdgeStopping& edges, const std::vector<FilterTap>& taps,
+    uint32_t y, uint32_t x0, uint32_t x1, const FilterOutput& output);
+
+#if defined(CPU_DENOISER_AVX2)
+bool isAvx2Supported();
+void filterSpanAvx2(const FilterPlanes& planes, const EdgeStopping& edges, const std::vector<FilterTap>& taps,
+    uint32_t y, uint32_t x0, uint32_t x1, const FilterOutput& output);
+#endif
+
+#if defined(CPU_DENOISER_NEON)
+void filterSpanNeon(const FilterPlanes& planes, const EdgeStopping& edges, const std::vector<FilterTap>& taps,
+    uint32_t y, uint32_t x0, uint32_t x1, const FilterOutput& output);
+#endif
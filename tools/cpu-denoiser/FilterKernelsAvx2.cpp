@@ -0,0 +1,193 @@
+#include "FilterKernels.hpp"
+
+#include <algorithm>
+
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Compiled with AVX2 and FMA enabled, only called after isAvx2Supported
+
+bool isAvx2Supported()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    const bool fma = (info[2] & (1 << 12)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    // The OS must save the YMM registers too
+    if (!fma || !osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+// exp(-x) for x >= 0, rounding to the nearest power of two leaves a polynomial on [-0.5, 0.5] (relative error under 1e-6)
+static inline __m256 negativeExp(__m256 x)
+{
+    const __m256 t = _mm256_mul_ps(_mm256_min_ps(x, _mm256_set1_ps(87.f)), _mm256_set1_ps(-1.44269504f));
+    const __m256 n = _mm256_round_ps(t, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    const __m256 f = _mm256_mul_ps(_mm256_sub_ps(t, n), _mm256_set1_ps(0.69314718f));
+
+    __m256 p = _mm256_set1_ps(1.f / 720.f);
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.f / 120.f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.f / 24.f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.f / 6.f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(0.5f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.f));
+
+    const __m256i exponent = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(exponent));
+}
+
+static inline __m256 absolute(__m256 x)
+{
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.f), x);
+}
+
+// 8 pixels whose taps are all inside the rows
+static void filterPixels(const FilterPlanes& planes, const EdgeStopping& edges, const std::vector<FilterTap>& taps,
+    uint32_t x, uint32_t y, const FilterOutput& output)
+{
+    const size_t center = static_cast<size_t>(y) * planes.width + x;
+
+    __m256 color[3];
+    for (size_t c = 0; c < 3; c++) {
+        color[c] = _mm256_loadu_ps(planes.color[c] + center);
+    }
+    const __m256 colorScale = _mm256_loadu_ps(planes.colorScale + center);
+
+    const bool luminanceDistance = edges.colorDistance == ColorDistance::Luminance;
+    const __m256 luminance = luminanceDistance ? _mm256_loadu_ps(planes.luminance + center) : _mm256_setzero_ps();
+
+    __m256 normal[3] = {};
+    if (planes.normal[0]) {
+        for (size_t c = 0; c < 3; c++) {
+            normal[c] = _mm256_loadu_ps(planes.normal[c] + center);
+        }
+    }
+
+    __m256 depth = _mm256_setzero_ps();
+    __m256 depthScale = _mm256_setzero_ps();
+    if (planes.depth) {
+        depth = _mm256_loadu_ps(planes.depth + center);
+        depthScale = _mm256_loadu_ps(planes.depthScale + center);
+    }
+
+    __m256 albedo[3] = {};
+    if (planes.albedo[0]) {
+        for (size_t c = 0; c < 3; c++) {
+            albedo[c] = _mm256_loadu_ps(planes.albedo[c] + center);
+        }
+    }
+
+    const __m256 normalScale = _mm256_set1_ps(edges.normalScale);
+    const __m256 albedoScale = _mm256_set1_ps(edges.albedoScale);
+
+    __m256 colorSum[3] = { _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps() };
+    __m256 varianceSum = _mm256_setzero_ps();
+    __m256 weightSum = _mm256_setzero_ps();
+
+    for (const FilterTap& tap : taps) {
+        const int64_t ty = static_cast<int64_t>(y) + tap.dy;
+        if (ty < 0 || ty >= planes.height) {
+            continue;
+        }
+        const size_t index = static_cast<size_t>(ty * planes.width + static_cast<int64_t>(x) + tap.dx);
+
+        __m256 tapColor[3];
+        for (size_t c = 0; c < 3; c++) {
+            tapColor[c] = _mm256_loadu_ps(planes.color[c] + index);
+        }
+
+        __m256 exponent;
+        if (luminanceDistance) {
+            exponent = _mm256_mul_ps(absolute(_mm256_sub_ps(luminance, _mm256_loadu_ps(planes.luminance + index))), colorScale);
+        } else {
+            const __m256 d0 = _mm256_sub_ps(color[0], tapColor[0]);
+            const __m256 d1 = _mm256_sub_ps(color[1], tapColor[1]);
+            const __m256 d2 = _mm256_sub_ps(color[2], tapColor[2]);
+            const __m256 distance = _mm256_fmadd_ps(d2, d2, _mm256_fmadd_ps(d1, d1, _mm256_mul_ps(d0, d0)));
+            exponent = _mm256_mul_ps(distance, colorScale);
+        }
+
+        if (planes.normal[0]) {
+            __m256 cosine = _mm256_mul_ps(normal[0], _mm256_loadu_ps(planes.normal[0] + index));
+            cosine = _mm256_fmadd_ps(normal[1], _mm256_loadu_ps(planes.normal[1] + index), cosine);
+            cosine = _mm256_fmadd_ps(normal[2], _mm256_loadu_ps(planes.normal[2] + index), cosine);
+            exponent = _mm256_fmadd_ps(_mm256_sub_ps(_mm256_set1_ps(1.f), cosine), normalScale, exponent);
+        }
+
+        __m256 valid = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        if (planes.depth) {
+            const __m256 tapDepth = _mm256_loadu_ps(planes.depth + index);
+            valid = _mm256_cmp_ps(tapDepth, _mm256_setzero_ps(), _CMP_GT_OQ);
+            const __m256 scale = _mm256_mul_ps(depthScale, _mm256_set1_ps(tap.depthScale));
+            exponent = _mm256_fmadd_ps(absolute(_mm256_sub_ps(depth, tapDepth)), scale, exponent);
+        }
+
+        if (planes.albedo[0]) {
+            const __m256 d0 = _mm256_sub_ps(albedo[0], _mm256_loadu_ps(planes.albedo[0] + index));
+            const __m256 d1 = _mm256_sub_ps(albedo[1], _mm256_loadu_ps(planes.albedo[1] + index));
+            const __m256 d2 = _mm256_sub_ps(albedo[2], _mm256_loadu_ps(planes.albedo[2] + index));
+            const __m256 distance = _mm256_fmadd_ps(d2, d2, _mm256_fmadd_ps(d1, d1, _mm256_mul_ps(d0, d0)));
+            exponent = _mm256_fmadd_ps(distance, albedoScale, exponent);
+        }
+
+        const __m256 weight = _mm256_and_ps(_mm256_mul_ps(_mm256_set1_ps(tap.weight), negativeExp(exponent)), valid);
+        for (size_t c = 0; c < 3; c++) {
+            colorSum[c] = _mm256_fmadd_ps(weight, tapColor[c], colorSum[c]);
+        }
+        if (planes.variance) {
+            varianceSum = _mm256_fmadd_ps(_mm256_mul_ps(weight, weight), _mm256_loadu_ps(planes.variance + index), varianceSum);
+        }
+        weightSum = _mm256_add_ps(weightSum, weight);
+    }
+
+    // Sky pixels have no weight at all, they are copied as the scalar kernel does
+    const __m256 sky = planes.depth ? _mm256_cmp_ps(depth, _mm256_setzero_ps(), _CMP_LE_OQ) : _mm256_setzero_ps();
+    const __m256 inverseWeight = _mm256_div_ps(_mm256_set1_ps(1.f), weightSum);
+    for (size_t c = 0; c < 3; c++) {
+        _mm256_storeu_ps(output.color[c] + center, _mm256_blendv_ps(_mm256_mul_ps(colorSum[c], inverseWeight), color[c], sky));
+    }
+    if (planes.variance) {
+        const __m256 variance = _mm256_mul_ps(varianceSum, _mm256_mul_ps(inverseWeight, inverseWeight));
+        _mm256_storeu_ps(output.variance + center, _mm256_blendv_ps(variance, _mm256_loadu_ps(planes.variance + center), sky));
+    }
+}
+
+void filterSpanAvx2(const FilterPlanes& planes, const EdgeStopping& edges, const std::vector<FilterTap>& taps,
+    uint32_t y, uint32_t x0, uint32_t x1, const FilterOutput& output)
+{
+    int32_t minDx = 0;
+    int32_t maxDx = 0;
+    for (const FilterTap& tap : taps) {
+        minDx = std::min(minDx, tap.dx);
+        maxDx = std::max(maxDx, tap.dx);
+    }
+
+    // Pixels close to the left and right borders have taps outside of the row, they are left to the scalar kernel
+    const int64_t interiorBegin = std::max<int64_t>(x0, -minDx);
+    const int64_t interiorEnd = std::min<int64_t>(x1, static_cast<int64_t>(planes.width) - maxDx);
+
+    uint32_t x = x0;
+    if (interiorBegin + 8 <= interiorEnd) {
+        for (; x < interiorBegin; x++) {
+            filterPixel(planes, edges, taps, x, y, output);
+        }
+        for (; x + 8 <= interiorEnd; x += 8) {
+            filterPixels(planes, edges, taps, x, y, output);
+        }
+    }
+    for (; x < x1; x++) {
+        filterPixel(planes, edges, taps, x, y, output);
+    }
+}
@@ -0,0 +1,163 @@
+#include "FilterKernels.hpp"
+
+#include <algorithm>
+
+#include <arm_neon.h>
+
+// AArch64 only, NEON is always available there
+
+// exp(-x) for x >= 0, rounding to the nearest power of two leaves a polynomial on [-0.5, 0.5] (relative error under 1e-6)
+static inline float32x4_t negativeExp(float32x4_t x)
+{
+    const float32x4_t t = vmulq_f32(vminq_f32(x, vdupq_n_f32(87.f)), vdupq_n_f32(-1.44269504f));
+    const float32x4_t n = vrndnq_f32(t);
+    const float32x4_t f = vmulq_f32(vsubq_f32(t, n), vdupq_n_f32(0.69314718f));
+
+    float32x4_t p = vdupq_n_f32(1.f / 720.f);
+    p = vfmaq_f32(vdupq_n_f32(1.f / 120.f), p, f);
+    p = vfmaq_f32(vdupq_n_f32(1.f / 24.f), p, f);
+    p = vfmaq_f32(vdupq_n_f32(1.f / 6.f), p, f);
+    p = vfmaq_f32(vdupq_n_f32(0.5f), p, f);
+    p = vfmaq_f32(vdupq_n_f32(1.f), p, f);
+    p = vfmaq_f32(vdupq_n_f32(1.f), p, f);
+
+    const int32x4_t exponent = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)), 23);
+    return vmulq_f32(p, vreinterpretq_f32_s32(exponent));
+}
+
+static inline float32x4_t squaredDistance(const float32x4_t a[3], const float* const b[3], size_t index)
+{
+    const float32x4_t d0 = vsubq_f32(a[0], vld1q_f32(b[0] + index));
+    const float32x4_t d1 = vsubq_f32(a[1], vld1q_f32(b[1] + index));
+    const float32x4_t d2 = vsubq_f32(a[2], vld1q_f32(b[2] + index));
+    return vfmaq_f32(vfmaq_f32(vmulq_f32(d0, d0), d1, d1), d2, d2);
+}
+
+// 4 pixels whose taps are all inside the rows
+static void filterPixels(const FilterPlanes& planes, const EdgeStopping& edges, const std::vector<FilterTap>& taps,
+    uint32_t x, uint32_t y, const FilterOutput& output)
+{
+    const size_t center = static_cast<size_t>(y) * planes.width + x;
+
+    float32x4_t color[3];
+    for (size_t c = 0; c < 3; c++) {
+        color[c] = vld1q_f32(planes.color[c] + center);
+    }
+    const float32x4_t colorScale = vld1q_f32(planes.colorScale + center);
+
+    const bool luminanceDistance = edges.colorDistance == ColorDistance::Luminance;
+    const float32x4_t luminance = luminanceDistance ? vld1q_f32(planes.luminance + center) : vdupq_n_f32(0.f);
+
+    float32x4_t normal[3] = {};
+    if (planes.normal[0]) {
+        for (size_t c = 0; c < 3; c++) {
+            normal[c] = vld1q_f32(planes.normal[c] + center);
+        }
+    }
+
+    float32x4_t depth = vdupq_n_f32(0.f);
+    float32x4_t depthScale = vdupq_n_f32(0.f);
+    if (planes.depth) {
+        depth = vld1q_f32(planes.depth + center);
+        depthScale = vld1q_f32(planes.depthScale + center);
+    }
+
+    float32x4_t albedo[3] = {};
+    if (planes.albedo[0]) {
+        for (size_t c = 0; c < 3; c++) {
+            albedo[c] = vld1q_f32(planes.albedo[c] + center);
+        }
+    }
+
+    float32x4_t colorSum[3] = { vdupq_n_f32(0.f), vdupq_n_f32(0.f), vdupq_n_f32(0.f) };
+    float32x4_t varianceSum = vdupq_n_f32(0.f);
+    float32x4_t weightSum = vdupq_n_f32(0.f);
+
+    for (const FilterTap& tap : taps) {
+        const int64_t ty = static_cast<int64_t>(y) + tap.dy;
+        if (ty < 0 || ty >= planes.height) {
+            continue;
+        }
+        const size_t index = static_cast<size_t>(ty * planes.width + static_cast<int64_t>(x) + tap.dx);
+
+        float32x4_t tapColor[3];
+        for (size_t c = 0; c < 3; c++) {
+            tapColor[c] = vld1q_f32(planes.color[c] + index);
+        }
+
+        float32x4_t exponent;
+        if (luminanceDistance) {
+            exponent = vmulq_f32(vabdq_f32(luminance, vld1q_f32(planes.luminance + index)), colorScale);
+        } else {
+            const float* const tapPlanes[3] = { planes.color[0], planes.color[1], planes.color[2] };
+            exponent = vmulq_f32(squaredDistance(color, tapPlanes, index), colorScale);
+        }
+
+        if (planes.normal[0]) {
+            float32x4_t cosine = vmulq_f32(normal[0], vld1q_f32(planes.normal[0] + index));
+            cosine = vfmaq_f32(cosine, normal[1], vld1q_f32(planes.normal[1] + index));
+            cosine = vfmaq_f32(cosine, normal[2], vld1q_f32(planes.normal[2] + index));
+            exponent = vfmaq_f32(exponent, vsubq_f32(vdupq_n_f32(1.f), cosine), vdupq_n_f32(edges.normalScale));
+        }
+
+        uint32x4_t valid = vdupq_n_u32(0xFFFFFFFF);
+        if (planes.depth) {
+            const float32x4_t tapDepth = vld1q_f32(planes.depth + index);
+            valid = vcgtq_f32(tapDepth, vdupq_n_f32(0.f));
+            exponent = vfmaq_f32(exponent, vabdq_f32(depth, tapDepth), vmulq_n_f32(depthScale, tap.depthScale));
+        }
+
+        if (planes.albedo[0]) {
+            const float* const tapPlanes[3] = { planes.albedo[0], planes.albedo[1], planes.albedo[2] };
+            exponent = vfmaq_f32(exponent, squaredDistance(albedo, tapPlanes, index), vdupq_n_f32(edges.albedoScale));
+        }
+
+        const float32x4_t weight = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(vmulq_n_f32(negativeExp(exponent), tap.weight)), valid));
+        for (size_t c = 0; c < 3; c++) {
+            colorSum[c] = vfmaq_f32(colorSum[c], weight, tapColor[c]);
+        }
+        if (planes.variance) {
+            varianceSum = vfmaq_f32(varianceSum, vmulq_f32(weight, weight), vld1q_f32(planes.variance + index));
+        }
+        weightSum = vaddq_f32(weightSum, weight);
+    }
+
+    // Sky pixels have no weight at all, they are copied as the scalar kernel does
+    const uint32x4_t sky = planes.depth ? vcleq_f32(depth, vdupq_n_f32(0.f)) : vdupq_n_u32(0);
+    const float32x4_t inverseWeight = vdivq_f32(vdupq_n_f32(1.f), weightSum);
+    for (size_t c = 0; c < 3; c++) {
+        vst1q_f32(output.color[c] + center, vbslq_f32(sky, color[c], vmulq_f32(colorSum[c], inverseWeight)));
+    }
+    if (planes.variance) {
+        const float32x4_t variance = vmulq_f32(varianceSum, vmulq_f32(inverseWeight, inverseWeight));
+        vst1q_f32(output.variance + center, vbslq_f32(sky, vld1q_f32(planes.variance + center), variance));
+    }
+}
+
+void filterSpanNeon(const FilterPlanes& planes, const EdgeStopping& edges, const std::vector<FilterTap>& taps,
+    uint32_t y, uint32_t x0, uint32_t x1, const FilterOutput& output)
+{
+    int32_t minDx = 0;
+    int32_t maxDx = 0;
+    for (const FilterTap& tap : taps) {
+        minDx = std::min(minDx, tap.dx);
+        maxDx = std::max(maxDx, tap.dx);
+    }
+
+    // Pixels close to the left and right borders have taps outside of the row, they are left to the scalar kernel
+    const int64_t interiorBegin = std::max<int64_t>(x0, -minDx);
+    const int64_t interiorEnd = std::min<int64_t>(x1, static_cast<int64_t>(planes.width) - maxDx);
+
+    uint32_t x = x0;
+    if (interiorBegin + 4 <= interiorEnd) {
+        for (; x < interiorBegin; x++) {
+            filterPixel(planes, edges, taps, x, y, output);
+        }
+        for (; x + 4 <= interiorEnd; x += 4) {
+            filterPixels(planes, edges, taps, x, y, output);
+        }
+    }
+    for (; x < x1; x++) {
+        filterPixel(planes, edges, taps, x, y, output);
+    }
+}
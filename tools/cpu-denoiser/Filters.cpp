@@ -0,0 +1,484 @@
+#include "Filters.hpp"
+#include "TileScheduler.hpp"
+
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using Plane = std::vector<float>;
+
+// Same value as getDemodulationAlbedo in the shaders, black albedos would divide by zero
+constexpr float MIN_DEMODULATION_ALBEDO = 1.f / 255.f;
+
+// Same hash as pcgHash in the shaders, so the blocks are shifted like the ones of the application
+static uint32_t pcgHash(uint32_t v)
+{
+    const uint32_t state = v * 747796405u + 2891336453u;
+    const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+static float luminance(float r, float g, float b)
+{
+    return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+}
+
+static void checkFeature(const Image& color, const Image& feature, uint32_t nbChannels, const std::string& name)
+{
+    if (feature.empty()) {
+        return;
+    }
+    if (feature.width != color.width || feature.height != color.height) {
+        throw std::invalid_argument("The " + name + " image does not have the size of the color");
+    }
+    if (feature.nbChannels < nbChannels) {
+        throw std::invalid_argument("The " + name + " image needs " + std::to_string(nbChannels) + " channels");
+    }
+}
+
+static std::array<Plane, 3> splitChannels(const Image& image)
+{
+    std::array<Plane, 3> planes;
+    for (size_t c = 0; c < 3; c++) {
+        planes[c].resize(image.getPixelCount());
+        for (size_t i = 0; i < image.getPixelCount(); i++) {
+            planes[c][i] = image.pixels[i * image.nbChannels + c];
+        }
+    }
+    return planes;
+}
+
+static void computeLuminance(const std::array<Plane, 3>& color, Plane& output)
+{
+    for (size_t i = 0; i < output.size(); i++) {
+        output[i] = luminance(color[0][i], color[1][i], color[2][i]);
+    }
+}
+
+// 5x5 B3 spline kernel spread by stepSize
+static std::vector<FilterTap> getAtrousTaps(int32_t stepSize)
+{
+    const float kernel[3] = { 3.f / 8.f, 1.f / 4.f, 1.f / 16.f };
+
+    std::vector<FilterTap> taps;
+    for (int32_t y = -2; y <= 2; y++) {
+        for (int32_t x = -2; x <= 2; x++) {
+            FilterTap tap;
+            tap.dx = x * stepSize;
+            tap.dy = y * stepSize;
+            tap.weight = kernel[std::abs(x)] * kernel[std::abs(y)];
+            // Depth differences are expected to grow with the distance to the center pixel
+            tap.depthScale = (x || y) ? 1.f / (stepSize * std::sqrt(static_cast<float>(x * x + y * y))) : 0.f;
+            taps.push_back(tap);
+        }
+    }
+    return taps;
+}
+
+// Square neighborhood, with a Gaussian kernel or a box one when sigma is 0
+static std::vector<FilterTap> getSquareTaps(int32_t radius, float sigma)
+{
+    std::vector<FilterTap> taps;
+    for (int32_t y = -radius; y <= radius; y++) {
+        for (int32_t x = -radius; x <= radius; x++) {
+            const float distance = std::sqrt(static_cast<float>(x * x + y * y));
+            FilterTap tap;
+            tap.dx = x;
+            tap.dy = y;
+            tap.weight = sigma > 0.f ? std::exp(-distance * distance / (2.f * sigma * sigma)) : 1.f;
+            tap.depthScale = (x || y) ? 1.f / distance : 0.f;
+            taps.push_back(tap);
+        }
+    }
+    return taps;
+}
+
+static void runPass(const FilterPlanes& planes, const EdgeStopping& edges, const std::vector<FilterTap>& taps,
+    const FilterOutput& output, const FilterSettings& settings)
+{
+    const FilterSpanFunction filterSpan = getFilterSpanFunction(settings.isa);
+    parallelForTiles(planes.width, planes.height, settings.tileSize, settings.nbThreads, [&](const Tile& tile) {
+        for (uint32_t y = tile.y0; y < tile.y1; y++) {
+            filterSpan(planes, edges, taps, y, tile.x0, tile.x1, output);
+        }
+    });
+}
+
+// 3x3 Gaussian of the variance, a single pixel estimate is too noisy to drive the filter
+static void blurVariance(const Plane& variance, uint32_t width, uint32_t height, Plane& output)
+{
+    const float gaussian[2] = { 1.f / 2.f, 1.f / 4.f };
+
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            float sum = 0.f;
+            for (int32_t dy = -1; dy <= 1; dy++) {
+                for (int32_t dx = -1; dx <= 1; dx++) {
+                    const int64_t tx = std::clamp<int64_t>(static_cast<int64_t>(x) + dx, 0, width - 1);
+                    const int64_t ty = std::clamp<int64_t>(static_cast<int64_t>(y) + dy, 0, height - 1);
+                    sum += gaussian[std::abs(dx)] * gaussian[std::abs(dy)] * variance[ty * width + tx];
+                }
+            }
+            output[static_cast<size_t>(y) * width + x] = sum;
+        }
+    }
+}
+
+static void filterBilateral(FilterPlanes planes, const FilterSettings& settings, std::array<Plane, 3>& color)
+{
+    const size_t nbPixels = color[0].size();
+    const Plane colorScale(nbPixels, 1.f / (2.f * settings.colorSigma * settings.colorSigma));
+    planes.colorScale = colorScale.data();
+
+    EdgeStopping edges;
+    edges.colorDistance = ColorDistance::RgbSquared;
+    edges.normalScale = settings.normalPhi;
+    edges.albedoScale = planes.albedo[0] ? 1.f / (2.f * settings.albedoSigma * settings.albedoSigma) : 0.f;
+
+    std::array<Plane, 3> filtered;
+    FilterOutput output;
+    for (size_t c = 0; c < 3; c++) {
+        filtered[c].resize(nbPixels);
+        planes.color[c] = color[c].data();
+        output.color[c] = filtered[c].data();
+    }
+
+    const int32_t radius = std::max(static_cast<int32_t>(std::ceil(2.f * settings.spatialSigma)), 1);
+    runPass(planes, edges, getSquareTaps(radius, settings.spatialSigma), output, settings);
+    color = std::move(filtered);
+}
+
+static void filterAtrous(FilterPlanes planes, const FilterSettings& settings, std::array<Plane, 3>& color)
+{
+    const size_t nbPixels = color[0].size();
+    Plane luminance(nbPixels);
+    Plane colorScale(nbPixels);
+    planes.luminance = luminance.data();
+    planes.colorScale = colorScale.data();
+
+    EdgeStopping edges;
+    edges.colorDistance = ColorDistance::Luminance;
+    edges.normalScale = settings.normalPhi;
+
+    std::array<Plane, 3> filtered;
+    for (size_t c = 0; c < 3; c++) {
+        filtered[c].resize(nbPixels);
+    }
+
+    for (uint32_t i = 0; i < settings.iterations; i++) {
+        computeLuminance(color, luminance);
+        // Every iteration tolerates half the luminance difference of the previous one
+        std::fill(colorScale.begin(), colorScale.end(), std::ldexp(1.f, static_cast<int>(i)) / settings.colorPhi);
+
+        FilterOutput output;
+        for (size_t c = 0; c < 3; c++) {
+            planes.color[c] = color[c].data();
+            output.color[c] = filtered[c].data();
+        }
+        runPass(planes, edges, getAtrousTaps(1 << i), output, settings);
+        std::swap(color, filtered);
+    }
+}
+
+static void filterSvgf(FilterPlanes planes, const FilterSettings& settings, std::array<Plane, 3>& color)
+{
+    const size_t nbPixels = color[0].size();
+    Plane luminance(nbPixels);
+    Plane colorScale(nbPixels);
+    Plane variance(nbPixels);
+    Plane filteredVariance(nbPixels);
+    std::array<Plane, 3> filtered;
+    for (size_t c = 0; c < 3; c++) {
+        filtered[c].resize(nbPixels);
+    }
+
+    EdgeStopping edges;
+    edges.colorDistance = ColorDistance::Luminance;
+    edges.normalScale = settings.normalPhi;
+
+    // There is no temporal history, the luminance moments are estimated over a 7x7 edge-aware neighborhood
+    // The luminance and its square are filtered as the first two color channels
+    {
+        Plane squaredLuminance(nbPixels);
+        computeLuminance(color, luminance);
+        for (size_t i = 0; i < nbPixels; i++) {
+            squaredLuminance[i] = luminance[i] * luminance[i];
+        }
+        std::fill(colorScale.begin(), colorScale.end(), 1.f / settings.luminancePhi);
+
+        FilterPlanes momentPlanes = planes;
+        momentPlanes.color = { luminance.data(), squaredLuminance.data(), luminance.data() };
+        momentPlanes.luminance = luminance.data();
+        momentPlanes.colorScale = colorScale.data();
+
+        FilterOutput output;
+        output.color = { filtered[0].data(), filtered[1].data(), filtered[2].data() };
+        runPass(momentPlanes, edges, getSquareTaps(3, 0.f), output, settings);
+
+        for (size_t i = 0; i < nbPixels; i++) {
+            variance[i] = std::max(filtered[1][i] - filtered[0][i] * filtered[0][i], 0.f);
+        }
+    }
+
+    planes.luminance = luminance.data();
+    planes.colorScale = colorScale.data();
+
+    for (uint32_t i = 0; i < settings.iterations; i++) {
+        // Luminance edges are scaled by the standard deviation of the pixel, so noisy areas are filtered more than converged ones
+        computeLuminance(color, luminance);
+        blurVariance(variance, planes.width, planes.height, colorScale);
+        for (float& scale : colorScale) {
+            scale = 1.f / (settings.luminancePhi * std::sqrt(scale) + 1e-10f);
+        }
+
+        planes.variance = variance.data();
+        FilterOutput output;
+        output.variance = filteredVariance.data();
+        for (size_t c = 0; c < 3; c++) {
+            planes.color[c] = color[c].data();
+            output.color[c] = filtered[c].data();
+        }
+        runPass(planes, edges, getAtrousTaps(1 << i), output, settings);
+        std::swap(color, filtered);
+        std::swap(variance, filteredVariance);
+    }
+}
+
+// Every block is fitted by a linear combination of 1, the normal, the position and its square, one per color channel
+// The normal equations are solved in double precision with a Cholesky factorization, instead of the QR of the paper
+static void filterBmfr(const FilterPlanes& planes, const std::array<Plane, 3>& position, const FilterSettings& settings, std::array<Plane, 3>& color)
+{
+    constexpr size_t NB_FEATURES = 10;
+
+    const uint32_t blockSize = std::max(settings.blockSize, 1u);
+    const uint32_t jitter = pcgHash(settings.frameIndex);
+    const uint32_t offsetX = jitter % blockSize;
+    const uint32_t offsetY = (jitter / blockSize) % blockSize;
+
+    auto isSky = [&](size_t i) {
+        return planes.depth && planes.depth[i] <= 0.f;
+    };
+
+    std::array<Plane, 3> filtered = color;
+
+    // Blocks of the shifted grid, each tile is a block
+    parallelForTiles(planes.width + offsetX, planes.height + offsetY, blockSize, settings.nbThreads, [&](const Tile& tile) {
+        const uint32_t x0 = std::max(tile.x0, offsetX) - offsetX;
+        const uint32_t y0 = std::max(tile.y0, offsetY) - offsetY;
+        const uint32_t x1 = tile.x1 - offsetX;
+        const uint32_t y1 = tile.y1 - offsetY;
+        if (x0 >= x1 || y0 >= y1) {
+            return;
+        }
+
+        // Positions are brought to [-1, 1] inside the block, so their squares have the same scale
+        std::array<float, 3> minPosition;
+        std::array<float, 3> invRange;
+        {
+            std::array<float, 3> maxPosition;
+            minPosition.fill(INFINITY);
+            maxPosition.fill(-INFINITY);
+            for (uint32_t y = y0; y < y1; y++) {
+                for (uint32_t x = x0; x < x1; x++) {
+                    const size_t i = static_cast<size_t>(y) * planes.width + x;
+                    for (size_t c = 0; c < 3 && !isSky(i); c++) {
+                        minPosition[c] = std::min(minPosition[c], position[c][i]);
+                        maxPosition[c] = std::max(maxPosition[c], position[c][i]);
+                    }
+                }
+            }
+            for (size_t c = 0; c < 3; c++) {
+                invRange[c] = 1.f / std::max(maxPosition[c] - minPosition[c], 1e-4f);
+            }
+        }
+
+        auto getFeatures = [&](size_t i, std::array<double, NB_FEATURES>& features) {
+            features[0] = 1.;
+            for (size_t c = 0; c < 3; c++) {
+                const double p = (position[c][i] - minPosition[c]) * invRange[c] * 2. - 1.;
+                features[1 + c] = planes.normal[0] ? planes.normal[c][i] : 0.;
+                features[4 + c] = p;
+                features[7 + c] = p * p;
+            }
+        };
+
+        // Normal equations F^T F a = F^T y, the sky does not weigh in the fit
+        std::array<std::array<double, NB_FEATURES>, NB_FEATURES> matrix {};
+        std::array<std::array<double, 3>, NB_FEATURES> rightHandSide {};
+        std::array<double, NB_FEATURES> features;
+        for (uint32_t y = y0; y < y1; y++) {
+            for (uint32_t x = x0; x < x1; x++) {
+                const size_t i = static_cast<size_t>(y) * planes.width + x;
+                if (isSky(i)) {
+                    continue;
+                }
+                getFeatures(i, features);
+                for (size_t row = 0; row < NB_FEATURES; row++) {
+                    for (size_t column = 0; column <= row; column++) {
+                        matrix[row][column] += features[row] * features[column];
+                    }
+                    for (size_t c = 0; c < 3; c++) {
+                        rightHandSide[row][c] += features[row] * color[c][i];
+                    }
+                }
+            }
+        }
+
+        // Cholesky factorization in place, the diagonal is raised relative to itself so collinear features (flat surfaces) keep a stable solution
+        for (size_t j = 0; j < NB_FEATURES; j++) {
+            double diagonal = matrix[j][j] * (1. + settings.regularization);
+            for (size_t k = 0; k < j; k++) {
+                diagonal -= matrix[j][k] * matrix[j][k];
+            }
+            matrix[j][j] = std::sqrt(std::max(diagonal, 1e-8));
+            for (size_t i = j + 1; i < NB_FEATURES; i++) {
+                double value = matrix[i][j];
+                for (size_t k = 0; k < j; k++) {
+                    value -= matrix[i][k] * matrix[j][k];
+                }
+                matrix[i][j] = value / matrix[j][j];
+            }
+        }
+
+        // Forward then backward substitution, the three channels at once
+        std::array<std::array<double, 3>, NB_FEATURES> coefficients = rightHandSide;
+        for (size_t i = 0; i < NB_FEATURES; i++) {
+            for (size_t c = 0; c < 3; c++) {
+                for (size_t k = 0; k < i; k++) {
+                    coefficients[i][c] -= matrix[i][k] * coefficients[k][c];
+                }
+                coefficients[i][c] /= matrix[i][i];
+            }
+        }
+        for (size_t i = NB_FEATURES; i-- > 0;) {
+            for (size_t c = 0; c < 3; c++) {
+                for (size_t k = i + 1; k < NB_FEATURES; k++) {
+                    coefficients[i][c] -= matrix[k][i] * coefficients[k][c];
+                }
+                coefficients[i][c] /= matrix[i][i];
+            }
+        }
+
+        for (uint32_t y = y0; y < y1; y++) {
+            for (uint32_t x = x0; x < x1; x++) {
+                const size_t i = static_cast<size_t>(y) * planes.width + x;
+                if (isSky(i)) {
+                    continue;
+                }
+                getFeatures(i, features);
+                for (size_t c = 0; c < 3; c++) {
+                    double value = 0.;
+                    for (size_t f = 0; f < NB_FEATURES; f++) {
+                        value += features[f] * coefficients[f][c];
+                    }
+                    filtered[c][i] = static_cast<float>(std::max(value, 0.));
+                }
+            }
+        }
+    });
+
+    color = std::move(filtered);
+}
+
+Image denoise(const FeatureImages& inputs, const FilterSettings& settings)
+{
+    const Image& color = inputs.color;
+    if (color.empty() || color.nbChannels < 3) {
+        throw std::invalid_argument("The color image needs 3 channels");
+    }
+    checkFeature(color, inputs.normal, 3, "normal");
+    checkFeature(color, inputs.depth, 1, "depth");
+    checkFeature(color, inputs.albedo, 3, "albedo");
+    checkFeature(color, inputs.position, 3, "position");
+    if (settings.type == FilterType::Bmfr && inputs.position.empty()) {
+        throw std::invalid_argument("BMFR needs the position image");
+    }
+
+    const size_t nbPixels = color.getPixelCount();
+    std::array<Plane, 3> colorPlanes = splitChannels(color);
+
+    FilterPlanes planes;
+    planes.width = color.width;
+    planes.height = color.height;
+
+    std::array<Plane, 3> normal;
+    if (!inputs.normal.empty()) {
+        normal = splitChannels(inputs.normal);
+        for (size_t i = 0; i < nbPixels; i++) {
+            const float length = std::sqrt(normal[0][i] * normal[0][i] + normal[1][i] * normal[1][i] + normal[2][i] * normal[2][i]);
+            const float scale = length > 0.f ? 1.f / length : 0.f;
+            for (size_t c = 0; c < 3; c++) {
+                normal[c][i] *= scale;
+            }
+        }
+        planes.normal = { normal[0].data(), normal[1].data(), normal[2].data() };
+    }
+
+    Plane depth;
+    Plane depthScale;
+    if (!inputs.depth.empty()) {
+        depth.resize(nbPixels);
+        depthScale.resize(nbPixels);
+        for (size_t i = 0; i < nbPixels; i++) {
+            depth[i] = inputs.depth.pixels[i * inputs.depth.nbChannels];
+            depthScale[i] = depth[i] > 0.f ? 1.f / (settings.depthPhi * depth[i]) : 0.f;
+        }
+        planes.depth = depth.data();
+        planes.depthScale = depthScale.data();
+    }
+
+    std::array<Plane, 3> albedo;
+    const bool demodulate = !inputs.albedo.empty() && settings.type != FilterType::Bilateral;
+    if (!inputs.albedo.empty()) {
+        albedo = splitChannels(inputs.albedo);
+        if (demodulate) {
+            for (size_t c = 0; c < 3; c++) {
+                for (size_t i = 0; i < nbPixels; i++) {
+                    albedo[c][i] = std::max(albedo[c][i], MIN_DEMODULATION_ALBEDO);
+                    colorPlanes[c][i] /= albedo[c][i];
+                }
+            }
+        } else {
+            planes.albedo = { albedo[0].data(), albedo[1].data(), albedo[2].data() };
+        }
+    }
+
+    switch (settings.type) {
+    case FilterType::Bilateral:
+        filterBilateral(planes, settings, colorPlanes);
+        break;
+    case FilterType::Atrous:
+        filterAtrous(planes, settings, colorPlanes);
+        break;
+    case FilterType::Svgf:
+        filterSvgf(planes, settings, colorPlanes);
+        break;
+    case FilterType::Bmfr:
+        filterBmfr(planes, splitChannels(inputs.position), settings, colorPlanes);
+        break;
+    }
+
+    Image result(color.width, color.height, 3);
+    for (size_t c = 0; c < 3; c++) {
+        for (size_t i = 0; i < nbPixels; i++) {
+            result.pixels[i * 3 + c] = demodulate ? colorPlanes[c][i] * albedo[c][i] : colorPlanes[c][i];
+        }
+    }
+    return result;
+}
+
+const char* getFilterName(FilterType type)
+{
+    switch (type) {
+    case FilterType::Bilateral:
+        return "bilateral";
+    case FilterType::Atrous:
+        return "atrous";
+    case FilterType::Bmfr:
+        return "bmfr";
+    default:
+        return "svgf";
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "FilterKernels.hpp"
+#include "Image.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+
+// CPU versions of the filters of the application denoiser, for frames rendered offline
+enum class FilterType {
+    Bilateral, // Single joint bilateral pass, the features only stop the edges
+    Atrous, // Edge-avoiding a-trous wavelet iterations (Dammertz et al.)
+    Svgf, // Spatial part of SVGF : luminance variance estimate, then variance-guided a-trous iterations (Schied et al.)
+    Bmfr, // Blockwise multi-order feature regression, a least squares fit of the features in every block (Koskela et al.)
+};
+
+// Defaults match the constants of the application
+struct FilterSettings {
+    FilterType type { FilterType::Svgf };
+    uint32_t iterations { 5 }; // A-trous and SVGF, step sizes from 1 to 2^(iterations - 1) pixels
+    float spatialSigma { 2.f }; // Bilateral, standard deviation of the Gaussian in pixels
+    float colorSigma { 0.5f }; // Bilateral, RGB distance tolerated
+    float colorPhi { 4.f }; // A-trous, luminance difference tolerated by the first iteration, halved by every following one
+    float luminancePhi { 4.f }; // SVGF, luminance difference tolerated, in standard deviations
+    float normalPhi { 64.f }; // Exponent of the cosine between normals
+    float depthPhi { 0.05f }; // Relative depth difference tolerated per pixel of distance
+    float albedoSigma { 0.1f }; // Bilateral, albedo distance tolerated
+    uint32_t blockSize { 32 }; // BMFR, side of the fitted blocks
+    float regularization { 1e-3f }; // BMFR, added to the diagonal of the normal equations, relative to it
+    uint32_t frameIndex { 0 }; // BMFR, shifts the blocks as the frames of the application do
+    uint32_t nbThreads { std::max(std::thread::hardware_concurrency(), 1u) };
+    uint32_t tileSize { 64 }; // Side of the square tiles shared between the threads
+    KernelIsa isa { getBestKernelIsa() };
+};
+
+// Returns the filtered RGB color, the optional features are used when not empty
+// The a-trous, SVGF and BMFR filters divide the color by the albedo when there is one, and multiply it back at the end
+Image denoise(const FeatureImages& inputs, const FilterSettings& settings);
+
+const char* getFilterName(FilterType type);
@@ -0,0 +1,29 @@
+#include "Image.hpp"
+
+Image::Image(uint32_t width, uint32_t height, uint32_t nbChannels)
+    : width(width)
+    , height(height)
+    , nbChannels(nbChannels)
+    , pixels(static_cast<size_t>(width) * height * nbChannels, 0.f)
+{
+}
+
+bool Image::empty() const
+{
+    return pixels.empty();
+}
+
+size_t Image::getPixelCount() const
+{
+    return static_cast<size_t>(width) * height;
+}
+
+float& Image::at(uint32_t x, uint32_t y, uint32_t channel)
+{
+    return pixels[(static_cast<size_t>(y) * width + x) * nbChannels + channel];
+}
+
+float Image::at(uint32_t x, uint32_t y, uint32_t channel) const
+{
+    return pixels[(static_cast<size_t>(y) * width + x) * nbChannels + channel];
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Float image with interleaved channels, rows from the top
+struct Image {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t nbChannels = 0;
+    std::vector<float> pixels;
+
+    Image() = default;
+    Image(uint32_t width, uint32_t height, uint32_t nbChannels);
+
+    bool empty() const;
+    size_t getPixelCount() const;
+
+    float& at(uint32_t x, uint32_t y, uint32_t channel);
+    float at(uint32_t x, uint32_t y, uint32_t channel) const;
+};
+
+// Inputs of the filters, only the color is required, and the position by BMFR
+// Feature images must have the size of the color, normal with 3 channels, depth with 1, albedo and position with 3
+struct FeatureImages {
+    Image color;
+    Image normal;
+    Image depth;
+    Image albedo;
+    Image position; // World space
+};
@@ -0,0 +1,450 @@
+#include "ImageIO.hpp"
+#include "ImageUtils.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+// Only the zlib decoder is needed, for the ZIP compressed EXR files
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_STATIC
+#define STBI_ONLY_PNG
+#include <stb_image.h>
+
+static bool hasExtension(const std::string& filename, const std::string& extension)
+{
+    if (filename.size() < extension.size()) {
+        return false;
+    }
+    std::string end = filename.substr(filename.size() - extension.size());
+    std::transform(end.begin(), end.end(), end.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return end == extension;
+}
+
+static void writeFile(const std::string& filename, const std::vector<unsigned char>& content)
+{
+    std::ofstream file(filename, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(content.data()), static_cast<std::streamsize>(content.size()));
+    if (!file) {
+        throw std::runtime_error("Failed to write " + filename);
+    }
+}
+
+// Both formats are little endian here, bytes are assembled explicitly so the host order does not matter
+class ByteReader {
+public:
+    ByteReader(const std::vector<unsigned char>& content, const std::string& filename)
+        : _content(content)
+        , _filename(filename)
+    {
+    }
+
+    size_t getOffset() const { return _offset; }
+    void seek(size_t offset) { _offset = offset; }
+
+    const unsigned char* read(size_t size)
+    {
+        if (_offset + size > _content.size() || _offset + size < _offset) {
+            throw std::runtime_error("Unexpected end of " + _filename);
+        }
+        const unsigned char* data = _content.data() + _offset;
+        _offset += size;
+        return data;
+    }
+
+    uint8_t readU8() { return *read(1); }
+
+    uint32_t readU32()
+    {
+        const unsigned char* bytes = read(4);
+        return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+    }
+
+    int32_t readI32() { return static_cast<int32_t>(readU32()); }
+
+    uint64_t readU64()
+    {
+        const uint64_t low = readU32();
+        return low | (static_cast<uint64_t>(readU32()) << 32);
+    }
+
+    std::string readString()
+    {
+        std::string value;
+        for (char c = static_cast<char>(readU8()); c != '\0'; c = static_cast<char>(readU8())) {
+            value += c;
+        }
+        return value;
+    }
+
+private:
+    const std::vector<unsigned char>& _content;
+    const std::string& _filename;
+    size_t _offset = 0;
+};
+
+static void appendU32(std::vector<unsigned char>& content, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        content.push_back(static_cast<unsigned char>(value >> (8 * i)));
+    }
+}
+
+static void appendFloat(std::vector<unsigned char>& content, float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    appendU32(content, bits);
+}
+
+static void appendString(std::vector<unsigned char>& content, const std::string& value)
+{
+    content.insert(content.end(), value.begin(), value.end());
+    content.push_back('\0');
+}
+
+static float bitsToFloat(uint32_t bits)
+{
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// PFM : text header "PF" (RGB) or "Pf" (grayscale), the size and a scale whose sign gives the endianness,
+// then the rows from the bottom
+static Image loadPfm(const std::string& filename, const std::vector<unsigned char>& content)
+{
+    // The header is short, 64 bytes always hold it
+    std::istringstream header(std::string(content.begin(), content.begin() + std::min<size_t>(content.size(), 64)));
+    std::string magic;
+    uint32_t width = 0, height = 0;
+    float scale = 0.f;
+    header >> magic >> width >> height >> scale;
+    if (!header || (magic != "PF" && magic != "Pf") || width == 0 || height == 0 || scale == 0.f) {
+        throw std::runtime_error("Invalid PFM header in " + filename);
+    }
+
+    // A single whitespace separates the header from the data
+    const size_t dataOffset = static_cast<size_t>(header.tellg()) + 1;
+    Image image(width, height, magic == "PF" ? 3 : 1);
+    const size_t rowSize = static_cast<size_t>(width) * image.nbChannels;
+    if (content.size() < dataOffset + rowSize * height * 4) {
+        throw std::runtime_error("Unexpected end of " + filename);
+    }
+
+    const bool littleEndian = scale < 0.f;
+    const unsigned char* data = content.data() + dataOffset;
+    for (uint32_t y = 0; y < height; y++) {
+        float* row = image.pixels.data() + (height - 1 - y) * rowSize;
+        for (size_t i = 0; i < rowSize; i++) {
+            const unsigned char* bytes = data + (y * rowSize + i) * 4;
+            const uint32_t bits = littleEndian
+                ? bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24)
+                : bytes[3] | (bytes[2] << 8) | (bytes[1] << 16) | (static_cast<uint32_t>(bytes[0]) << 24);
+            row[i] = bitsToFloat(bits);
+        }
+    }
+    return image;
+}
+
+static void savePfm(const std::string& filename, const Image& image)
+{
+    if (!writePfm(filename, image.pixels.data(), image.width, image.height, image.nbChannels)) {
+        throw std::runtime_error("Failed to write " + filename);
+    }
+}
+
+enum ExrPixelType : int32_t {
+    EXR_UINT = 0,
+    EXR_HALF = 1,
+    EXR_FLOAT = 2,
+};
+
+enum ExrCompression : uint8_t {
+    EXR_NO_COMPRESSION = 0,
+    EXR_ZIPS_COMPRESSION = 2, // zlib, one scanline per block
+    EXR_ZIP_COMPRESSION = 3, // zlib, 16 scanlines per block
+};
+
+constexpr uint32_t EXR_MAGIC = 20000630;
+constexpr uint32_t EXR_VERSION = 2;
+constexpr uint32_t EXR_UNSUPPORTED_FLAGS = 0x200 | 0x800 | 0x1000; // Tiled, deep and multipart files
+
+struct ExrChannel {
+    std::string name;
+    int32_t pixelType;
+    size_t offset; // In bytes, inside a scanline
+};
+
+// The ZIP compressor reorders the bytes and stores differences before deflating them
+static void unpredictExrBytes(const std::vector<unsigned char>& inflated, std::vector<unsigned char>& bytes)
+{
+    std::vector<unsigned char> delta = inflated;
+    for (size_t i = 1; i < delta.size(); i++) {
+        delta[i] = static_cast<unsigned char>(delta[i - 1] + delta[i] - 128);
+    }
+
+    // The first half holds the even bytes, the second half the odd ones
+    const size_t half = (delta.size() + 1) / 2;
+    bytes.resize(delta.size());
+    for (size_t i = 0; i < delta.size(); i++) {
+        bytes[i] = (i % 2 == 0) ? delta[i / 2] : delta[half + i / 2];
+    }
+}
+
+static float readExrValue(const unsigned char* bytes, int32_t pixelType)
+{
+    const uint32_t low = bytes[0] | (bytes[1] << 8);
+    if (pixelType == EXR_HALF) {
+        return halfToFloat(static_cast<uint16_t>(low));
+    }
+    const uint32_t bits = low | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+    return pixelType == EXR_FLOAT ? bitsToFloat(bits) : static_cast<float>(bits);
+}
+
+static Image loadExr(const std::string& filename, const std::vector<unsigned char>& content)
+{
+    ByteReader reader(content, filename);
+    const uint32_t magic = reader.readU32();
+    const uint32_t version = reader.readU32();
+    if (magic != EXR_MAGIC || (version & 0xFF) != EXR_VERSION) {
+        throw std::runtime_error("Invalid EXR header in " + filename);
+    }
+    if (version & EXR_UNSUPPORTED_FLAGS) {
+        throw std::runtime_error("Only scanline EXR files are supported, " + filename + " is tiled, deep or multipart");
+    }
+
+    std::vector<ExrChannel> channels;
+    int32_t compression = -1;
+    int32_t dataWindow[4] = {};
+    bool hasDataWindow = false;
+
+    for (std::string name = reader.readString(); !name.empty(); name = reader.readString()) {
+        const std::string type = reader.readString();
+        const uint32_t size = reader.readU32();
+        const size_t end = reader.getOffset() + size;
+
+        if (name == "channels" && type == "chlist") {
+            // Sorted by name in the file, which is also their order inside the scanlines
+            for (std::string channel = reader.readString(); !channel.empty(); channel = reader.readString()) {
+                const int32_t pixelType = reader.readI32();
+                reader.read(4); // pLinear and reserved
+                const int32_t xSampling = reader.readI32();
+                const int32_t ySampling = reader.readI32();
+                if (pixelType < EXR_UINT || pixelType > EXR_FLOAT || xSampling != 1 || ySampling != 1) {
+                    throw std::runtime_error("Unsupported channel " + channel + " in " + filename);
+                }
+                channels.push_back({ channel, pixelType, 0 });
+            }
+        } else if (name == "compression" && type == "compression") {
+            compression = reader.readU8();
+        } else if (name == "dataWindow" && type == "box2i") {
+            for (int32_t& value : dataWindow) {
+                value = reader.readI32();
+            }
+            hasDataWindow = true;
+        }
+        reader.seek(end);
+    }
+
+    if (channels.empty() || !hasDataWindow || dataWindow[2] < dataWindow[0] || dataWindow[3] < dataWindow[1]) {
+        throw std::runtime_error("Invalid EXR header in " + filename);
+    }
+    if (compression != EXR_NO_COMPRESSION && compression != EXR_ZIPS_COMPRESSION && compression != EXR_ZIP_COMPRESSION) {
+        throw std::runtime_error("Unsupported EXR compression in " + filename + ", only NONE, ZIPS and ZIP are read");
+    }
+
+    const uint32_t width = static_cast<uint32_t>(dataWindow[2] - dataWindow[0] + 1);
+    const uint32_t height = static_cast<uint32_t>(dataWindow[3] - dataWindow[1] + 1);
+
+    size_t scanlineSize = 0;
+    for (ExrChannel& channel : channels) {
+        channel.offset = scanlineSize;
+        scanlineSize += static_cast<size_t>(width) * (channel.pixelType == EXR_HALF ? 2 : 4);
+    }
+
+    // R, G and B first, then any single channel (depth), then three unnamed ones (normal or position layers)
+    std::vector<const ExrChannel*> selected;
+    for (const char* name : { "R", "G", "B" }) {
+        for (const ExrChannel& channel : channels) {
+            if (channel.name == name) {
+                selected.push_back(&channel);
+            }
+        }
+    }
+    if (selected.size() != 3) {
+        selected.clear();
+        for (const ExrChannel& channel : channels) {
+            if (channel.name != "A") {
+                selected.push_back(&channel);
+            }
+        }
+        if (selected.size() != 1 && selected.size() != 3) {
+            throw std::runtime_error("No R, G and B or single channel in " + filename);
+        }
+    }
+
+    Image image(width, height, static_cast<uint32_t>(selected.size()));
+    const uint32_t linesPerBlock = compression == EXR_ZIP_COMPRESSION ? 16 : 1;
+    const uint32_t nbBlocks = (height + linesPerBlock - 1) / linesPerBlock;
+
+    std::vector<uint64_t> offsets(nbBlocks);
+    for (uint64_t& offset : offsets) {
+        offset = reader.readU64();
+    }
+
+    std::vector<unsigned char> inflated;
+    std::vector<unsigned char> block;
+    for (uint64_t offset : offsets) {
+        reader.seek(static_cast<size_t>(offset));
+        const int32_t firstLine = reader.readI32() - dataWindow[1];
+        const uint32_t packedSize = reader.readU32();
+        const unsigned char* packed = reader.read(packedSize);
+        if (firstLine < 0 || static_cast<uint32_t>(firstLine) >= height) {
+            throw std::runtime_error("Invalid EXR block in " + filename);
+        }
+
+        const uint32_t nbLines = std::min(linesPerBlock, height - firstLine);
+        const size_t blockSize = scanlineSize * nbLines;
+
+        // Blocks that deflate would make larger are stored as is
+        if (compression == EXR_NO_COMPRESSION || packedSize == blockSize) {
+            block.assign(packed, packed + packedSize);
+        } else {
+            inflated.resize(blockSize);
+            const int size = stbi_zlib_decode_buffer(reinterpret_cast<char*>(inflated.data()), static_cast<int>(blockSize),
+                reinterpret_cast<const char*>(packed), static_cast<int>(packedSize));
+            if (size < 0) {
+                throw std::runtime_error("Failed to inflate an EXR block of " + filename);
+            }
+            inflated.resize(static_cast<size_t>(size));
+            unpredictExrBytes(inflated, block);
+        }
+        if (block.size() != blockSize) {
+            throw std::runtime_error("Invalid EXR block in " + filename);
+        }
+
+        for (uint32_t line = 0; line < nbLines; line++) {
+            const unsigned char* scanline = block.data() + line * scanlineSize;
+            for (uint32_t c = 0; c < image.nbChannels; c++) {
+                const ExrChannel& channel = *selected[c];
+                const size_t valueSize = channel.pixelType == EXR_HALF ? 2 : 4;
+                for (uint32_t x = 0; x < width; x++) {
+                    image.at(x, firstLine + line, c) = readExrValue(scanline + channel.offset + x * valueSize, channel.pixelType);
+                }
+            }
+        }
+    }
+    return image;
+}
+
+static void appendExrAttribute(std::vector<unsigned char>& content, const std::string& name, const std::string& type, uint32_t size)
+{
+    appendString(content, name);
+    appendString(content, type);
+    appendU32(content, size);
+}
+
+static void saveExr(const std::string& filename, const Image& image)
+{
+    // Channels must be sorted by name
+    const std::vector<std::string> names = image.nbChannels == 3 ? std::vector<std::string> { "B", "G", "R" } : std::vector<std::string> { "Y" };
+    const uint32_t channelIndices[3] = { 2, 1, 0 };
+
+    std::vector<unsigned char> content;
+    appendU32(content, EXR_MAGIC);
+    appendU32(content, EXR_VERSION);
+
+    uint32_t channelListSize = 1;
+    for (const std::string& name : names) {
+        channelListSize += static_cast<uint32_t>(name.size()) + 1 + 16;
+    }
+    appendExrAttribute(content, "channels", "chlist", channelListSize);
+    for (const std::string& name : names) {
+        appendString(content, name);
+        appendU32(content, EXR_FLOAT);
+        appendU32(content, 0); // pLinear and reserved
+        appendU32(content, 1);
+        appendU32(content, 1);
+    }
+    content.push_back('\0');
+
+    appendExrAttribute(content, "compression", "compression", 1);
+    content.push_back(EXR_NO_COMPRESSION);
+
+    for (const char* window : { "dataWindow", "displayWindow" }) {
+        appendExrAttribute(content, window, "box2i", 16);
+        appendU32(content, 0);
+        appendU32(content, 0);
+        appendU32(content, image.width - 1);
+        appendU32(content, image.height - 1);
+    }
+
+    appendExrAttribute(content, "lineOrder", "lineOrder", 1);
+    content.push_back(0); // Increasing y
+
+    appendExrAttribute(content, "pixelAspectRatio", "float", 4);
+    appendFloat(content, 1.f);
+    appendExrAttribute(content, "screenWindowCenter", "v2f", 8);
+    appendFloat(content, 0.f);
+    appendFloat(content, 0.f);
+    appendExrAttribute(content, "screenWindowWidth", "float", 4);
+    appendFloat(content, 1.f);
+    content.push_back('\0');
+
+    const uint32_t scanlineSize = image.width * image.nbChannels * 4;
+    const uint64_t firstBlock = content.size() + static_cast<uint64_t>(image.height) * 8;
+    for (uint32_t y = 0; y < image.height; y++) {
+        const uint64_t offset = firstBlock + static_cast<uint64_t>(y) * (scanlineSize + 8);
+        appendU32(content, static_cast<uint32_t>(offset));
+        appendU32(content, static_cast<uint32_t>(offset >> 32));
+    }
+
+    for (uint32_t y = 0; y < image.height; y++) {
+        appendU32(content, y);
+        appendU32(content, scanlineSize);
+        for (uint32_t c = 0; c < image.nbChannels; c++) {
+            const uint32_t channel = image.nbChannels == 3 ? channelIndices[c] : 0;
+            for (uint32_t x = 0; x < image.width; x++) {
+                appendFloat(content, image.at(x, y, channel));
+            }
+        }
+    }
+    writeFile(filename, content);
+}
+
+Image loadImage(const std::string& filename)
+{
+    std::vector<unsigned char> content;
+    if (!readFile(filename, content)) {
+        throw std::runtime_error("Failed to read " + filename);
+    }
+
+    if (hasExtension(filename, ".pfm")) {
+        return loadPfm(filename, content);
+    }
+    if (hasExtension(filename, ".exr")) {
+        return loadExr(filename, content);
+    }
+    throw std::runtime_error("Unknown image format of " + filename + ", expected .pfm or .exr");
+}
+
+void saveImage(const std::string& filename, const Image& image)
+{
+    if (image.nbChannels != 1 && image.nbChannels != 3) {
+        throw std::invalid_argument("Only 1 or 3 channel images can be saved");
+    }
+
+    if (hasExtension(filename, ".pfm")) {
+        savePfm(filename, image);
+    } else if (hasExtension(filename, ".exr")) {
+        saveExr(filename, image);
+    } else {
+        throw std::runtime_error("Unknown image format of " + filename + ", expected .pfm or .exr");
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "Image.hpp"
+
+#include <string>
+
+// Float images exchanged with the renderers, picked by the extension of the file :
+// - .pfm : Portable Float Map, grayscale or RGB
+// - .exr : OpenEXR scanline images with NONE, ZIPS or ZIP compression, reading R, G and B, or a single channel
+//          (or three channels without R, G and B, like the X, Y and Z of a normal layer), written uncompressed as floats
+Image loadImage(const std::string& filename);
+// Only 1 or 3 channel images can be saved
+void saveImage(const std::string& filename, const Image& image);
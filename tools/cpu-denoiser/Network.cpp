@@ -0,0 +1,238 @@
+#include "Network.hpp"
+
+#include "ImageUtils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+struct LayerShape {
+    std::vector<uint32_t> inputs; // Channels of the concatenated tensors, each padded on its own
+    uint32_t outputs;
+    bool relu;
+};
+
+enum Layer {
+    ENC0A,
+    ENC0B,
+    ENC1,
+    ENC2,
+    BOTTLENECK0,
+    BOTTLENECK1,
+    DEC2,
+    DEC1,
+    DEC0A,
+    DEC0B,
+    OUTPUT,
+    LAYER_COUNT
+};
+
+const LayerShape LAYER_SHAPES[LAYER_COUNT] = {
+    { { 9 }, 16, true },
+    { { 16 }, 16, true },
+    { { 16 }, 32, true },
+    { { 32 }, 48, true },
+    { { 48 }, 64, true },
+    { { 64 }, 64, true },
+    { { 64, 48 }, 48, true },
+    { { 48, 32 }, 32, true },
+    { { 32, 16 }, 16, true },
+    { { 16 }, 16, true },
+    { { 16 }, 3, false },
+};
+
+constexpr uint32_t WEIGHTS_VERSION = 1;
+
+}
+
+NetworkDenoiser::NetworkDenoiser(const std::string& weightsFile, uint32_t nbThreads, uint32_t tileSize, KernelIsa isa)
+    : _convolveRow(getConvolutionRowFunction(isa))
+    , _tileSize(std::max(tileSize, 1u))
+    , _pool(nbThreads)
+{
+    loadWeights(weightsFile);
+}
+
+uint32_t NetworkDenoiser::getThreadCount() const
+{
+    return _pool.getThreadCount();
+}
+
+void NetworkDenoiser::loadWeights(const std::string& weightsFile)
+{
+    std::vector<unsigned char> content;
+    if (!readFile(weightsFile, content)) {
+        throw std::runtime_error("Failed to read " + weightsFile);
+    }
+
+    size_t offset = 0;
+    auto read = [&](size_t size) {
+        if (offset + size > content.size()) {
+            throw std::runtime_error("Unexpected end of " + weightsFile);
+        }
+        const unsigned char* data = content.data() + offset;
+        offset += size;
+        return data;
+    };
+    auto readU32 = [&]() {
+        const unsigned char* bytes = read(4);
+        return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+    };
+    auto readHalf = [&]() {
+        const unsigned char* bytes = read(2);
+        return static_cast<uint16_t>(bytes[0] | (bytes[1] << 8));
+    };
+
+    if (std::memcmp(read(4), "UNET", 4) != 0 || readU32() != WEIGHTS_VERSION) {
+        throw std::runtime_error(weightsFile + " is not a version " + std::to_string(WEIGHTS_VERSION) + " weights file");
+    }
+    if (readU32() != LAYER_COUNT) {
+        throw std::runtime_error(weightsFile + " does not have the layers of the network");
+    }
+
+    _layers.resize(LAYER_COUNT);
+    for (uint32_t l = 0; l < LAYER_COUNT; l++) {
+        const LayerShape& shape = LAYER_SHAPES[l];
+
+        // Where every input channel of the file lands in the padded tensor
+        std::vector<uint32_t> inputIndices;
+        uint32_t paddedInputs = 0;
+        for (uint32_t part : shape.inputs) {
+            for (uint32_t i = 0; i < part; i++) {
+                inputIndices.push_back(paddedInputs + i);
+            }
+            paddedInputs += getPaddedChannels(part);
+        }
+
+        const uint32_t nbInputs = readU32();
+        const uint32_t nbOutputs = readU32();
+        if (nbInputs != inputIndices.size() || nbOutputs != shape.outputs) {
+            throw std::runtime_error("Layer " + std::to_string(l) + " of " + weightsFile + " is " + std::to_string(nbInputs) + " -> " + std::to_string(nbOutputs)
+                + ", the network expects " + std::to_string(inputIndices.size()) + " -> " + std::to_string(shape.outputs));
+        }
+
+        ConvolutionLayer& layer = _layers[l];
+        layer.inputChannels = paddedInputs;
+        layer.outputChannels = getPaddedChannels(nbOutputs);
+        layer.relu = shape.relu;
+        layer.weights.assign(static_cast<size_t>(layer.outputChannels) * 9 * layer.inputChannels, 0);
+        layer.biases.assign(layer.outputChannels, 0.f);
+
+        for (uint32_t o = 0; o < nbOutputs; o++) {
+            for (uint32_t i = 0; i < nbInputs; i++) {
+                for (uint32_t k = 0; k < 9; k++) {
+                    const size_t index = ((static_cast<size_t>(o / CHANNEL_BLOCK) * 9 + k) * layer.inputChannels + inputIndices[i]) * CHANNEL_BLOCK + o % CHANNEL_BLOCK;
+                    layer.weights[index] = readHalf();
+                }
+            }
+        }
+        for (uint32_t o = 0; o < nbOutputs; o++) {
+            layer.biases[o] = halfToFloat(readHalf());
+        }
+    }
+
+    if (offset != content.size()) {
+        throw std::runtime_error(weightsFile + " has more weights than the network");
+    }
+}
+
+Tensor NetworkDenoiser::convolve(const ConvolutionLayer& layer, const Tensor& input)
+{
+    Tensor output(input.width, input.height, layer.outputChannels);
+    _pool.parallelForTiles(input.width, input.height, _tileSize, [&](const Tile& tile) {
+        for (uint32_t y = tile.y0; y < tile.y1; y++) {
+            _convolveRow(layer, input, y, tile.x0, tile.x1, output);
+        }
+    });
+    return output;
+}
+
+Tensor NetworkDenoiser::pool(const Tensor& input)
+{
+    Tensor output((input.width + 1) / 2, (input.height + 1) / 2, input.nbChannels);
+    _pool.parallelForTiles(output.width, output.height, _tileSize, [&](const Tile& tile) {
+        for (uint32_t y = tile.y0; y < tile.y1; y++) {
+            for (uint32_t x = tile.x0; x < tile.x1; x++) {
+                uint16_t* dst = output.at(x, y);
+                // The pooled activations come out of a ReLU, the bits of positive halves sort as their values
+                for (uint32_t dy = 0; dy < 2 && 2 * y + dy < input.height; dy++) {
+                    for (uint32_t dx = 0; dx < 2 && 2 * x + dx < input.width; dx++) {
+                        const uint16_t* src = input.at(2 * x + dx, 2 * y + dy);
+                        for (uint32_t c = 0; c < input.nbChannels; c++) {
+                            dst[c] = std::max(dst[c], src[c]);
+                        }
+                    }
+                }
+            }
+        }
+    });
+    return output;
+}
+
+Tensor NetworkDenoiser::upsampleConcat(const Tensor& low, const Tensor& skip)
+{
+    Tensor output(skip.width, skip.height, low.nbChannels + skip.nbChannels);
+    _pool.parallelForTiles(output.width, output.height, _tileSize, [&](const Tile& tile) {
+        for (uint32_t y = tile.y0; y < tile.y1; y++) {
+            for (uint32_t x = tile.x0; x < tile.x1; x++) {
+                uint16_t* dst = output.at(x, y);
+                const uint16_t* upsampled = low.at(std::min(x / 2, low.width - 1), std::min(y / 2, low.height - 1));
+                std::copy_n(upsampled, low.nbChannels, dst);
+                std::copy_n(skip.at(x, y), skip.nbChannels, dst + low.nbChannels);
+            }
+        }
+    });
+    return output;
+}
+
+Image NetworkDenoiser::denoise(const FeatureImages& inputs)
+{
+    const Image& color = inputs.color;
+    if (color.empty() || color.nbChannels < 3) {
+        throw std::invalid_argument("The color image needs 3 channels");
+    }
+    for (const Image* feature : { &inputs.albedo, &inputs.normal }) {
+        if (feature->width != color.width || feature->height != color.height || feature->nbChannels < 3) {
+            throw std::invalid_argument("The network needs albedo and normal images of 3 channels, with the size of the color");
+        }
+    }
+
+    // The network was trained on the logarithm of the color, which brings the highlights to the range of the features
+    Tensor input(color.width, color.height, 9);
+    _pool.parallelForTiles(color.width, color.height, _tileSize, [&](const Tile& tile) {
+        for (uint32_t y = tile.y0; y < tile.y1; y++) {
+            for (uint32_t x = tile.x0; x < tile.x1; x++) {
+                uint16_t* dst = input.at(x, y);
+                for (uint32_t c = 0; c < 3; c++) {
+                    dst[c] = floatToHalf(std::log1p(std::max(color.at(x, y, c), 0.f)));
+                    dst[3 + c] = floatToHalf(std::clamp(inputs.albedo.at(x, y, c), 0.f, 1.f));
+                    dst[6 + c] = floatToHalf(std::clamp(inputs.normal.at(x, y, c), -1.f, 1.f));
+                }
+            }
+        }
+    });
+
+    Tensor enc0 = convolve(_layers[ENC0B], convolve(_layers[ENC0A], input));
+    Tensor enc1 = convolve(_layers[ENC1], pool(enc0));
+    Tensor enc2 = convolve(_layers[ENC2], pool(enc1));
+    Tensor bottleneck = convolve(_layers[BOTTLENECK1], convolve(_layers[BOTTLENECK0], pool(enc2)));
+
+    Tensor dec2 = convolve(_layers[DEC2], upsampleConcat(bottleneck, enc2));
+    Tensor dec1 = convolve(_layers[DEC1], upsampleConcat(dec2, enc1));
+    Tensor dec0 = convolve(_layers[DEC0B], convolve(_layers[DEC0A], upsampleConcat(dec1, enc0)));
+    const Tensor output = convolve(_layers[OUTPUT], dec0);
+
+    Image result(color.width, color.height, 3);
+    for (uint32_t y = 0; y < color.height; y++) {
+        for (uint32_t x = 0; x < color.width; x++) {
+            const uint16_t* src = output.at(x, y);
+            for (uint32_t c = 0; c < 3; c++) {
+                result.at(x, y, c) = std::expm1(std::max(halfToFloat(src[c]), 0.f));
+            }
+        }
+    }
+    return result;
+}
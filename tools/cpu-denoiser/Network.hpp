@@ -0,0 +1,43 @@
+#pragma once
+
+#include "ConvolutionKernels.hpp"
+#include "Image.hpp"
+#include "TileScheduler.hpp"
+
+#include <string>
+#include <vector>
+
+// Compact U-Net denoiser for the final frames, inference only, with weights trained offline by train_unet.py (none are committed)
+// The inputs are log(1 + color), the albedo and the normal (9 channels), the output is log(1 + denoised color)
+// Three 2x2 max pooling levels of 16, 32, 48 then 64 channels, nearest upsampling concatenated with the skips :
+//   enc0a 9 -> 16, enc0b 16 -> 16, pool, enc1 16 -> 32, pool, enc2 32 -> 48, pool, bottleneck0 48 -> 64, bottleneck1 64 -> 64,
+//   up + enc2, dec2 64 + 48 -> 48, up + enc1, dec1 48 + 32 -> 32, up + enc0b, dec0a 32 + 16 -> 16, dec0b 16 -> 16, output 16 -> 3
+// Every convolution is 3x3 with a ReLU, except the output one
+//
+// Weights file, little endian : "UNET", version (uint32 1), number of layers (uint32 11), then for every layer in the order above
+// its input and output channels (uint32), its weights as half floats in the [output][input][ky][kx] order of PyTorch Conv2d,
+// and its biases as half floats
+class NetworkDenoiser {
+public:
+    // Throws std::runtime_error if the weights do not match the network
+    NetworkDenoiser(const std::string& weightsFile, uint32_t nbThreads, uint32_t tileSize, KernelIsa isa);
+
+    // Needs the albedo and the normal, throws std::invalid_argument without them
+    Image denoise(const FeatureImages& inputs);
+
+    uint32_t getThreadCount() const;
+
+private:
+    void loadWeights(const std::string& weightsFile);
+
+    Tensor convolve(const ConvolutionLayer& layer, const Tensor& input);
+    Tensor pool(const Tensor& input);
+    // Nearest upsampling of low to the size of skip, followed by the channels of skip
+    Tensor upsampleConcat(const Tensor& low, const Tensor& skip);
+
+private:
+    std::vector<ConvolutionLayer> _layers;
+    ConvolutionRowFunction _convolveRow;
+    uint32_t _tileSize;
+    TileThreadPool _pool;
+};
@@ -0,0 +1,120 @@
+#include "TileScheduler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+void parallelForTiles(uint32_t width, uint32_t height, uint32_t tileSize, uint32_t nbThreads, const std::function<void(const Tile&)>& process)
+{
+    tileSize = std::max(tileSize, 1u);
+    const uint32_t tilesX = (width + tileSize - 1) / tileSize;
+    const uint32_t tilesY = (height + tileSize - 1) / tileSize;
+    const uint32_t nbTiles = tilesX * tilesY;
+
+    // Tiles are handed out one at a time, the cost of a tile depends on how much sky it covers
+    std::atomic<uint32_t> nextTile { 0 };
+    auto worker = [&]() {
+        for (uint32_t i = nextTile++; i < nbTiles; i = nextTile++) {
+            Tile tile;
+            tile.x0 = (i % tilesX) * tileSize;
+            tile.y0 = (i / tilesX) * tileSize;
+            tile.x1 = std::min(tile.x0 + tileSize, width);
+            tile.y1 = std::min(tile.y0 + tileSize, height);
+            process(tile);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < std::min(nbThreads, nbTiles); i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+
+    for (auto& thread : workers) {
+        thread.join();
+    }
+}
+
+TileThreadPool::TileThreadPool(uint32_t nbThreads)
+{
+    // The calling thread is the first worker
+    for (uint32_t i = 1; i < std::max(nbThreads, 1u); i++) {
+        _workers.emplace_back(&TileThreadPool::workerLoop, this);
+    }
+}
+
+TileThreadPool::~TileThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _startCondition.notify_all();
+    for (auto& thread : _workers) {
+        thread.join();
+    }
+}
+
+uint32_t TileThreadPool::getThreadCount() const
+{
+    return static_cast<uint32_t>(_workers.size()) + 1;
+}
+
+void TileThreadPool::parallelForTiles(uint32_t width, uint32_t height, uint32_t tileSize, const std::function<void(const Tile&)>& process)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _process = &process;
+        _width = width;
+        _height = height;
+        _tileSize = std::max(tileSize, 1u);
+        _tilesX = (width + _tileSize - 1) / _tileSize;
+        _nbTiles = _tilesX * ((height + _tileSize - 1) / _tileSize);
+        _nextTile = 0;
+        _nbBusyWorkers = static_cast<uint32_t>(_workers.size());
+        _generation++;
+    }
+    _startCondition.notify_all();
+
+    processTiles();
+
+    // The workers may still be on their last tile
+    std::unique_lock<std::mutex> lock(_mutex);
+    _doneCondition.wait(lock, [this]() { return _nbBusyWorkers == 0; });
+    _process = nullptr;
+}
+
+void TileThreadPool::workerLoop()
+{
+    uint64_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _startCondition.wait(lock, [&]() { return _stopping || _generation != generation; });
+            if (_stopping) {
+                return;
+            }
+            generation = _generation;
+        }
+
+        processTiles();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (--_nbBusyWorkers == 0) {
+            _doneCondition.notify_one();
+        }
+    }
+}
+
+void TileThreadPool::processTiles()
+{
+    for (uint32_t i = _nextTile++; i < _nbTiles; i = _nextTile++) {
+        Tile tile;
+        tile.x0 = (i % _tilesX) * _tileSize;
+        tile.y0 = (i / _tilesX) * _tileSize;
+        tile.x1 = std::min(tile.x0 + _tileSize, _width);
+        tile.y1 = std::min(tile.y0 + _tileSize, _height);
+        (*_process)(tile);
+    }
+}
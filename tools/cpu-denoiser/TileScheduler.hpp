@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Tile {
+    uint32_t x0, y0;
+    uint32_t x1, y1; // Exclusive
+};
+
+// Calls process on every tile of a width x height image, from nbThreads threads including the calling one
+// Returns once all the tiles are processed, so successive passes can read the output of the previous one
+void parallelForTiles(uint32_t width, uint32_t height, uint32_t tileSize, uint32_t nbThreads, const std::function<void(const Tile&)>& process);
+
+// Same scheduling from threads kept alive between the calls, for the many short passes of the network,
+// where starting the threads of every pass would cost as much as the pass itself
+class TileThreadPool {
+public:
+    explicit TileThreadPool(uint32_t nbThreads);
+    ~TileThreadPool();
+
+    TileThreadPool(const TileThreadPool&) = delete;
+    TileThreadPool& operator=(const TileThreadPool&) = delete;
+
+    uint32_t getThreadCount() const;
+
+    // Not reentrant, process must not call it
+    void parallelForTiles(uint32_t width, uint32_t height, uint32_t tileSize, const std::function<void(const Tile&)>& process);
+
+private:
+    void workerLoop();
+    void processTiles();
+
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _startCondition;
+    std::condition_variable _doneCondition;
+    bool _stopping = false;
+    uint64_t _generation = 0; // Incremented by every call, wakes the workers
+    uint32_t _nbBusyWorkers = 0;
+
+    // Work of the current call
+    const std::function<void(const Tile&)>* _process = nullptr;
+    uint32_t _width = 0;
+    uint32_t _height = 0;
+    uint32_t _tileSize = 1;
+    uint32_t _tilesX = 0;
+    uint32_t _nbTiles = 0;
+    std::atomic<uint32_t> _nextTile { 0 };
+};
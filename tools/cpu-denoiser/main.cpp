@@ -0,0 +1,152 @@
+#include "Filters.hpp"
+#include "ImageIO.hpp"
+#include "Network.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+struct Options {
+    FilterSettings settings;
+    std::string normalFile;
+    std::string depthFile;
+    std::string albedoFile;
+    std::string positionFile;
+    std::string weightsFile;
+    std::string outputFile;
+    std::string colorFile;
+};
+
+static void printUsage()
+{
+    std::cout << "Usage : cpu-denoiser [--filter bilateral|atrous|svgf|bmfr] [--normal F] [--depth F] [--albedo F] [--position F]" << std::endl;
+    std::cout << "                     [--iterations N] [--color-sigma S] [--frame N] [--weights F] [--threads N] [--tile N] [--scalar]" << std::endl;
+    std::cout << "                     --output F COLOR" << std::endl;
+    std::cout << "Denoises a rendered frame without a GPU, the images are PFM or EXR files." << std::endl;
+    std::cout << "  --filter F        bilateral, atrous, svgf or bmfr (default svgf)" << std::endl;
+    std::cout << "  --normal F        world or view space normals, stopping the filter across geometric edges" << std::endl;
+    std::cout << "  --depth F         distance to the camera, 0 for the sky which is not filtered" << std::endl;
+    std::cout << "  --albedo F        first hit albedo, divided out of the color by the a-trous, SVGF and BMFR filters" << std::endl;
+    std::cout << "  --position F      world space position of the first hits, required by BMFR" << std::endl;
+    std::cout << "  --iterations N    a-trous and SVGF iterations (default 5)" << std::endl;
+    std::cout << "  --color-sigma S   bilateral RGB distance, a-trous luminance difference or SVGF standard deviations tolerated" << std::endl;
+    std::cout << "  --frame N         BMFR, frame index shifting the blocks as in the application (default 0)" << std::endl;
+    std::cout << "  --weights F       U-Net weights, the frame is denoised by the network instead of the filter (needs the albedo and normal)" << std::endl;
+    std::cout << "  --threads N       number of filtering threads (default " << FilterSettings().nbThreads << ")" << std::endl;
+    std::cout << "  --tile N          side of the tiles shared between the threads (default 64)" << std::endl;
+    std::cout << "  --scalar          disable the SIMD kernels" << std::endl;
+    std::cout << "  --output F        filtered color" << std::endl;
+}
+
+static FilterType parseFilterType(const std::string& name)
+{
+    for (FilterType type : { FilterType::Bilateral, FilterType::Atrous, FilterType::Svgf, FilterType::Bmfr }) {
+        if (name == getFilterName(type)) {
+            return type;
+        }
+    }
+    throw std::invalid_argument("Unknown filter " + name);
+}
+
+static Options parseOptions(int argc, char** argv)
+{
+    Options options;
+    bool hasColorSigma = false;
+    float colorSigma = 0.f;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) {
+            options.settings.type = parseFilterType(argv[++i]);
+        } else if (arg == "--normal" && i + 1 < argc) {
+            options.normalFile = argv[++i];
+        } else if (arg == "--depth" && i + 1 < argc) {
+            options.depthFile = argv[++i];
+        } else if (arg == "--albedo" && i + 1 < argc) {
+            options.albedoFile = argv[++i];
+        } else if (arg == "--position" && i + 1 < argc) {
+            options.positionFile = argv[++i];
+        } else if (arg == "--weights" && i + 1 < argc) {
+            options.weightsFile = argv[++i];
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            options.settings.iterations = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--color-sigma" && i + 1 < argc) {
+            colorSigma = std::stof(argv[++i]);
+            hasColorSigma = true;
+        } else if (arg == "--frame" && i + 1 < argc) {
+            options.settings.frameIndex = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.settings.nbThreads = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--tile" && i + 1 < argc) {
+            options.settings.tileSize = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--scalar") {
+            options.settings.isa = KernelIsa::Scalar;
+        } else if (arg == "--output" && i + 1 < argc) {
+            options.outputFile = argv[++i];
+        } else if (arg.rfind("--", 0) == 0) {
+            throw std::invalid_argument("Unknown option " + arg);
+        } else {
+            options.colorFile = arg;
+        }
+    }
+
+    // Every filter has its own color tolerance, the option sets the one of the chosen filter
+    if (hasColorSigma) {
+        options.settings.colorSigma = colorSigma;
+        options.settings.colorPhi = colorSigma;
+        options.settings.luminancePhi = colorSigma;
+    }
+    return options;
+}
+
+int main(int argc, char** argv)
+{
+    try {
+        const Options options = parseOptions(argc, argv);
+        if (options.colorFile.empty() || options.outputFile.empty()) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+
+        FeatureImages inputs;
+        inputs.color = loadImage(options.colorFile);
+        if (!options.normalFile.empty()) {
+            inputs.normal = loadImage(options.normalFile);
+        }
+        if (!options.depthFile.empty()) {
+            inputs.depth = loadImage(options.depthFile);
+        }
+        if (!options.albedoFile.empty()) {
+            inputs.albedo = loadImage(options.albedoFile);
+        }
+        if (!options.positionFile.empty()) {
+            inputs.position = loadImage(options.positionFile);
+        }
+
+        // The weights are loaded before the timing starts
+        std::unique_ptr<NetworkDenoiser> network;
+        if (!options.weightsFile.empty()) {
+            network = std::make_unique<NetworkDenoiser>(options.weightsFile, options.settings.nbThreads, options.settings.tileSize, options.settings.isa);
+        }
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        const Image result = network ? network->denoise(inputs) : denoise(inputs, options.settings);
+        const auto end = std::chrono::high_resolution_clock::now();
+
+        saveImage(options.outputFile, result);
+
+        std::cout << options.colorFile << " -> " << options.outputFile << " (" << result.width << "x" << result.height << ", "
+                  << (network ? "unet" : getFilterName(options.settings.type)) << ", " << getKernelIsaName(options.settings.isa) << " kernels, "
+                  << options.settings.nbThreads << " threads) in "
+                  << std::chrono::duration<float, std::milli>(end - start).count() << " ms" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
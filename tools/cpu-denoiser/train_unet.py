@@ -0,0 +1,219 @@
+"""Trains the U-Net of Network.hpp and exports the weights file read by cpu-denoiser --weights.
+
+The training set is a sequence of noisy frames with their albedo, normal and high sample count reference, as PFM files
+named like the inputs of the benchmark (# runs are replaced by the frame number):
+
+    python train_unet.py --color color_####.pfm --albedo albedo_####.pfm --normal normal_####.pfm
+                         --reference ref_####.pfm --frames 64 --output unet.weights
+
+The application writes the color, albedo and normal of a frame with FRAME_EXPORT_KEY, the references are high sample
+count renders of the same views. Needs PyTorch and NumPy, and runs on the GPU when PyTorch finds one.
+"""
+
+import argparse
+import random
+import re
+import struct
+import sys
+
+import numpy as np
+import torch
+import torch.nn as nn
+import torch.nn.functional as F
+
+WEIGHTS_VERSION = 1
+
+# Convolutions in the order of the weights file, with their input and output channels
+LAYERS = [
+    ("enc0a", 9, 16),
+    ("enc0b", 16, 16),
+    ("enc1", 16, 32),
+    ("enc2", 32, 48),
+    ("bottleneck0", 48, 64),
+    ("bottleneck1", 64, 64),
+    ("dec2", 64 + 48, 48),
+    ("dec1", 48 + 32, 32),
+    ("dec0a", 32 + 16, 16),
+    ("dec0b", 16, 16),
+    ("output", 16, 3),
+]
+
+# Largest finite half float, the weights are clamped to it before the export
+HALF_MAX = 65504.0
+
+
+class UNet(nn.Module):
+    """Same graph as NetworkDenoiser::denoise: the pooling keeps the odd rows and columns, like the ceil mode, and the
+    nearest upsampling is cropped to the size of the skip connection it is concatenated with."""
+
+    def __init__(self):
+        super().__init__()
+        self.convs = nn.ModuleDict({name: nn.Conv2d(inputs, outputs, 3, padding=1) for name, inputs, outputs in LAYERS})
+
+    def conv(self, name, x):
+        x = self.convs[name](x)
+        return x if name == "output" else F.relu(x)
+
+    @staticmethod
+    def pool(x):
+        return F.max_pool2d(x, 2, ceil_mode=True)
+
+    @staticmethod
+    def upsample_concat(low, skip):
+        upsampled = F.interpolate(low, scale_factor=2, mode="nearest")[:, :, : skip.shape[2], : skip.shape[3]]
+        return torch.cat([upsampled, skip], dim=1)
+
+    def forward(self, x):
+        enc0 = self.conv("enc0b", self.conv("enc0a", x))
+        enc1 = self.conv("enc1", self.pool(enc0))
+        enc2 = self.conv("enc2", self.pool(enc1))
+        bottleneck = self.conv("bottleneck1", self.conv("bottleneck0", self.pool(enc2)))
+
+        dec2 = self.conv("dec2", self.upsample_concat(bottleneck, enc2))
+        dec1 = self.conv("dec1", self.upsample_concat(dec2, enc1))
+        dec0 = self.conv("dec0b", self.conv("dec0a", self.upsample_concat(dec1, enc0)))
+        return self.conv("output", dec0)
+
+
+def get_frame_file(pattern, frame):
+    """Replaces the first run of # by the frame number, padded with zeros to its length."""
+    match = re.search("#+", pattern)
+    if not match:
+        return pattern
+    return pattern[: match.start()] + str(frame).zfill(len(match.group(0))) + pattern[match.end() :]
+
+
+def load_pfm(filename):
+    """Returns the image as a (channels, height, width) float32 array, top row first."""
+    with open(filename, "rb") as file:
+        content = file.read()
+
+    # Header of three whitespace separated lines, then a single whitespace before the data
+    tokens = []
+    offset = 0
+    while len(tokens) < 4:
+        while content[offset : offset + 1].isspace():
+            offset += 1
+        end = offset
+        while not content[end : end + 1].isspace():
+            end += 1
+        tokens.append(content[offset:end].decode("ascii"))
+        offset = end
+    offset += 1
+
+    magic, width, height, scale = tokens[0], int(tokens[1]), int(tokens[2]), float(tokens[3])
+    if magic not in ("PF", "Pf"):
+        raise ValueError("Invalid PFM header in " + filename)
+    channels = 3 if magic == "PF" else 1
+
+    dtype = "<f4" if scale < 0 else ">f4"
+    data = np.frombuffer(content, dtype=dtype, count=width * height * channels, offset=offset)
+    image = data.reshape(height, width, channels)[::-1]
+    return np.ascontiguousarray(image.transpose(2, 0, 1), dtype=np.float32)
+
+
+def load_frame(options, frame):
+    """Network input (9 channels) and target (3 channels), prepared like NetworkDenoiser::denoise does."""
+    color = load_pfm(get_frame_file(options.color, frame))[:3]
+    albedo = load_pfm(get_frame_file(options.albedo, frame))[:3]
+    normal = load_pfm(get_frame_file(options.normal, frame))[:3]
+    reference = load_pfm(get_frame_file(options.reference, frame))[:3]
+    if not (color.shape == albedo.shape == normal.shape == reference.shape):
+        raise ValueError("The images of frame {} do not have the same size".format(frame))
+
+    network_input = np.concatenate([np.log1p(np.maximum(color, 0.0)), np.clip(albedo, 0.0, 1.0), np.clip(normal, -1.0, 1.0)])
+    target = np.log1p(np.maximum(reference, 0.0))
+    return torch.from_numpy(network_input), torch.from_numpy(target)
+
+
+def sample_batch(frames, batch_size, crop_size):
+    """Random crops of random frames."""
+    inputs, targets = [], []
+    for _ in range(batch_size):
+        network_input, target = random.choice(frames)
+        y = random.randint(0, network_input.shape[1] - crop_size)
+        x = random.randint(0, network_input.shape[2] - crop_size)
+        inputs.append(network_input[:, y : y + crop_size, x : x + crop_size])
+        targets.append(target[:, y : y + crop_size, x : x + crop_size])
+    return torch.stack(inputs), torch.stack(targets)
+
+
+def write_weights(filename, layers):
+    """Writes the weights file of Network.hpp, layers being (inputs, outputs, weights, biases) with the weights flattened
+    in the [output][input][ky][kx] order of Conv2d."""
+    with open(filename, "wb") as file:
+        file.write(b"UNET")
+        file.write(struct.pack("<II", WEIGHTS_VERSION, len(layers)))
+        for inputs, outputs, weights, biases in layers:
+            if len(weights) != outputs * inputs * 9 or len(biases) != outputs:
+                raise ValueError("A layer of {} -> {} channels has {} weights and {} biases".format(inputs, outputs, len(weights), len(biases)))
+            values = [min(max(value, -HALF_MAX), HALF_MAX) for value in list(weights) + list(biases)]
+            file.write(struct.pack("<II", inputs, outputs))
+            file.write(struct.pack("<{}e".format(len(values)), *values))
+
+
+def export_weights(model, filename):
+    layers = []
+    for name, inputs, outputs in LAYERS:
+        conv = model.convs[name]
+        layers.append((inputs, outputs, conv.weight.detach().cpu().flatten().tolist(), conv.bias.detach().cpu().tolist()))
+    write_weights(filename, layers)
+
+
+def parse_options(arguments):
+    parser = argparse.ArgumentParser(description="Trains the U-Net of the CPU denoiser and exports its weights")
+    parser.add_argument("--color", required=True, help="noisy color frames, # runs are the frame number")
+    parser.add_argument("--albedo", required=True, help="albedo frames")
+    parser.add_argument("--normal", required=True, help="normal frames")
+    parser.add_argument("--reference", required=True, help="high sample count reference frames")
+    parser.add_argument("--first", type=int, default=0, help="first frame number (default 0)")
+    parser.add_argument("--frames", type=int, default=1, help="number of frames (default 1)")
+    parser.add_argument("--iterations", type=int, default=20000, help="optimizer steps (default 20000)")
+    parser.add_argument("--batch", type=int, default=8, help="crops per step (default 8)")
+    parser.add_argument("--crop", type=int, default=128, help="size of the crops, a multiple of 8 (default 128)")
+    parser.add_argument("--learning-rate", type=float, default=1e-3, help="initial Adam learning rate (default 1e-3)")
+    parser.add_argument("--seed", type=int, default=0, help="seed of the initialization and the crops (default 0)")
+    parser.add_argument("--output", default="unet.weights", help="weights file (default unet.weights)")
+    options = parser.parse_args(arguments)
+
+    if options.crop <= 0 or options.crop % 8 != 0:
+        parser.error("--crop must be a positive multiple of 8")
+    if options.frames <= 0 or options.iterations <= 0 or options.batch <= 0:
+        parser.error("--frames, --iterations and --batch must be positive")
+    return options
+
+
+def main(arguments):
+    options = parse_options(arguments)
+    random.seed(options.seed)
+    torch.manual_seed(options.seed)
+    device = torch.device("cuda" if torch.cuda.is_available() else "cpu")
+
+    frames = [load_frame(options, options.first + f) for f in range(options.frames)]
+    for network_input, _ in frames:
+        if min(network_input.shape[1:]) < options.crop:
+            raise ValueError("The frames are smaller than the {0}x{0} crops".format(options.crop))
+
+    model = UNet().to(device)
+    optimizer = torch.optim.Adam(model.parameters(), lr=options.learning_rate)
+    scheduler = torch.optim.lr_scheduler.CosineAnnealingLR(optimizer, options.iterations)
+
+    # L1 in the logarithmic space the network works in, so the highlights do not dominate the loss
+    for iteration in range(options.iterations):
+        inputs, targets = sample_batch(frames, options.batch, options.crop)
+        loss = F.l1_loss(model(inputs.to(device)), targets.to(device))
+
+        optimizer.zero_grad()
+        loss.backward()
+        optimizer.step()
+        scheduler.step()
+
+        if iteration % 500 == 0 or iteration == options.iterations - 1:
+            print("Iteration {} : loss {:.5f}".format(iteration, loss.item()))
+
+    export_weights(model, options.output)
+    print("Weights written to " + options.output)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Image.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A denoiser evaluated by the benchmark, fed the frames of a sequence in order
+// Temporal denoisers keep their history between the calls, a new instance is created for every sequence
+class DenoiserPlugin {
+public:
+    virtual ~DenoiserPlugin() = default;
+
+    virtual Image denoise(const FeatureImages& frame) = 0;
+};
+
+struct DenoiserOptions {
+    uint32_t nbThreads;
+    std::string weightsFile; // Of the network, empty when none was given
+};
+
+struct DenoiserRegistration {
+    std::string name;
+    std::function<std::unique_ptr<DenoiserPlugin>(const DenoiserOptions& options)> create;
+    bool needsPosition { false }; // Left out of the default list when the sequence has no position images
+    bool needsWeights { false }; // Left out of the default list when no weights file was given
+};
+
+// Every denoiser the benchmark knows, new plug-ins are added to the list in DenoiserPlugins.cpp
+std::vector<DenoiserRegistration> getRegisteredDenoisers();
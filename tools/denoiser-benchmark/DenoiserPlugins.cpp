@@ -0,0 +1,73 @@
+#include "DenoiserPlugin.hpp"
+#include "Filters.hpp"
+#include "Network.hpp"
+
+// The noisy input as is, the point of comparison of the others
+class PassthroughPlugin : public DenoiserPlugin {
+public:
+    Image denoise(const FeatureImages& frame) override
+    {
+        Image color(frame.color.width, frame.color.height, 3);
+        for (size_t i = 0; i < color.getPixelCount(); i++) {
+            for (size_t c = 0; c < 3; c++) {
+                color.pixels[i * 3 + c] = frame.color.pixels[i * frame.color.nbChannels + c];
+            }
+        }
+        return color;
+    }
+};
+
+// Filters of the CPU denoiser library, with their default settings
+class FilterPlugin : public DenoiserPlugin {
+public:
+    FilterPlugin(FilterType type, uint32_t nbThreads)
+    {
+        _settings.type = type;
+        _settings.nbThreads = nbThreads;
+    }
+
+    Image denoise(const FeatureImages& frame) override
+    {
+        Image output = ::denoise(frame, _settings);
+        // BMFR shifts its blocks every frame, as the application does
+        _settings.frameIndex++;
+        return output;
+    }
+
+private:
+    FilterSettings _settings;
+};
+
+// U-Net of the CPU denoiser library, its threads are kept for the whole sequence
+class NetworkPlugin : public DenoiserPlugin {
+public:
+    NetworkPlugin(const DenoiserOptions& options)
+        : _network(options.weightsFile, options.nbThreads, FilterSettings().tileSize, getBestKernelIsa())
+    {
+    }
+
+    Image denoise(const FeatureImages& frame) override
+    {
+        return _network.denoise(frame);
+    }
+
+private:
+    NetworkDenoiser _network;
+};
+
+static DenoiserRegistration registerFilter(FilterType type)
+{
+    return { getFilterName(type), [type](const DenoiserOptions& options) { return std::make_unique<FilterPlugin>(type, options.nbThreads); }, type == FilterType::Bmfr };
+}
+
+std::vector<DenoiserRegistration> getRegisteredDenoisers()
+{
+    return {
+        { "none", [](const DenoiserOptions&) { return std::make_unique<PassthroughPlugin>(); } },
+        registerFilter(FilterType::Bilateral), // Baseline
+        registerFilter(FilterType::Atrous),
+        registerFilter(FilterType::Svgf),
+        registerFilter(FilterType::Bmfr),
+        { "unet", [](const DenoiserOptions& options) { return std::make_unique<NetworkPlugin>(options); }, false, true },
+    };
+}
@@ -0,0 +1,140 @@
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+static void checkSizes(const Image& image, const Image& reference)
+{
+    if (image.width != reference.width || image.height != reference.height || image.nbChannels < 3 || reference.nbChannels < 3) {
+        throw std::invalid_argument("The image and its reference must have the same size and 3 channels");
+    }
+}
+
+// Cap of the PSNR, an exact match would otherwise be infinite and make the mean over a sequence infinite too
+static constexpr double MAX_PSNR = 100.0;
+
+static float displayed(float value)
+{
+    return std::clamp(value, 0.f, 1.f);
+}
+
+static std::vector<float> getLuminance(const Image& image)
+{
+    std::vector<float> luminance(image.getPixelCount());
+    for (size_t i = 0; i < luminance.size(); i++) {
+        const float* pixel = image.pixels.data() + i * image.nbChannels;
+        luminance[i] = 0.2126f * displayed(pixel[0]) + 0.7152f * displayed(pixel[1]) + 0.0722f * displayed(pixel[2]);
+    }
+    return luminance;
+}
+
+// Separable Gaussian, the weights out of the image are dropped and the others renormalized
+static std::vector<float> blur(const std::vector<float>& plane, uint32_t width, uint32_t height, const std::vector<float>& kernel)
+{
+    const int64_t radius = static_cast<int64_t>(kernel.size() / 2);
+    std::vector<float> horizontal(plane.size());
+    std::vector<float> result(plane.size());
+
+    for (int64_t y = 0; y < height; y++) {
+        for (int64_t x = 0; x < width; x++) {
+            float sum = 0.f;
+            float weightSum = 0.f;
+            for (int64_t i = std::max<int64_t>(x - radius, 0); i <= std::min<int64_t>(x + radius, width - 1); i++) {
+                sum += kernel[i - x + radius] * plane[y * width + i];
+                weightSum += kernel[i - x + radius];
+            }
+            horizontal[y * width + x] = sum / weightSum;
+        }
+    }
+
+    for (int64_t y = 0; y < height; y++) {
+        for (int64_t x = 0; x < width; x++) {
+            float sum = 0.f;
+            float weightSum = 0.f;
+            for (int64_t i = std::max<int64_t>(y - radius, 0); i <= std::min<int64_t>(y + radius, height - 1); i++) {
+                sum += kernel[i - y + radius] * horizontal[i * width + x];
+                weightSum += kernel[i - y + radius];
+            }
+            result[y * width + x] = sum / weightSum;
+        }
+    }
+    return result;
+}
+
+float computePsnr(const Image& image, const Image& reference)
+{
+    checkSizes(image, reference);
+
+    double squaredError = 0.0;
+    for (size_t i = 0; i < image.getPixelCount(); i++) {
+        for (size_t c = 0; c < 3; c++) {
+            const double delta = displayed(image.pixels[i * image.nbChannels + c]) - displayed(reference.pixels[i * reference.nbChannels + c]);
+            squaredError += delta * delta;
+        }
+    }
+
+    const double meanSquaredError = squaredError / (image.getPixelCount() * 3);
+    if (meanSquaredError <= std::pow(10.0, -MAX_PSNR / 10.0)) {
+        return static_cast<float>(MAX_PSNR);
+    }
+    return static_cast<float>(-10.0 * std::log10(meanSquaredError));
+}
+
+float computeSsim(const Image& image, const Image& reference)
+{
+    checkSizes(image, reference);
+
+    constexpr float c1 = 0.01f * 0.01f;
+    constexpr float c2 = 0.03f * 0.03f;
+
+    std::vector<float> kernel(11);
+    for (size_t i = 0; i < kernel.size(); i++) {
+        const float x = static_cast<float>(i) - 5.f;
+        kernel[i] = std::exp(-x * x / (2.f * 1.5f * 1.5f));
+    }
+
+    const std::vector<float> x = getLuminance(image);
+    const std::vector<float> y = getLuminance(reference);
+    std::vector<float> xx(x.size()), yy(x.size()), xy(x.size());
+    for (size_t i = 0; i < x.size(); i++) {
+        xx[i] = x[i] * x[i];
+        yy[i] = y[i] * y[i];
+        xy[i] = x[i] * y[i];
+    }
+
+    const std::vector<float> meanX = blur(x, image.width, image.height, kernel);
+    const std::vector<float> meanY = blur(y, image.width, image.height, kernel);
+    const std::vector<float> meanXX = blur(xx, image.width, image.height, kernel);
+    const std::vector<float> meanYY = blur(yy, image.width, image.height, kernel);
+    const std::vector<float> meanXY = blur(xy, image.width, image.height, kernel);
+
+    double sum = 0.0;
+    for (size_t i = 0; i < x.size(); i++) {
+        const float varianceX = meanXX[i] - meanX[i] * meanX[i];
+        const float varianceY = meanYY[i] - meanY[i] * meanY[i];
+        const float covariance = meanXY[i] - meanX[i] * meanY[i];
+        sum += (2.f * meanX[i] * meanY[i] + c1) * (2.f * covariance + c2)
+            / ((meanX[i] * meanX[i] + meanY[i] * meanY[i] + c1) * (varianceX + varianceY + c2));
+    }
+    return static_cast<float>(sum / x.size());
+}
+
+float computeFlicker(const Image& image, const Image& previousImage, const Image& reference, const Image& previousReference)
+{
+    checkSizes(image, reference);
+    checkSizes(previousImage, previousReference);
+    checkSizes(image, previousImage);
+
+    const std::vector<float> current = getLuminance(image);
+    const std::vector<float> previous = getLuminance(previousImage);
+    const std::vector<float> currentReference = getLuminance(reference);
+    const std::vector<float> previousReferenceLuminance = getLuminance(previousReference);
+
+    double sum = 0.0;
+    for (size_t i = 0; i < current.size(); i++) {
+        sum += std::abs((current[i] - previous[i]) - (currentReference[i] - previousReferenceLuminance[i]));
+    }
+    return static_cast<float>(sum / current.size());
+}
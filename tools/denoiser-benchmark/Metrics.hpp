@@ -0,0 +1,16 @@
+#pragma once
+
+#include "Image.hpp"
+
+// Image quality against the reference, on the colors clamped to [0, 1] as they are displayed
+// The images must have the same size and at least 3 channels
+
+// Peak signal to noise ratio of the RGB channels, in dB, capped at 100 dB for (near) exact matches
+float computePsnr(const Image& image, const Image& reference);
+
+// Mean structural similarity of the luminance, with the 11x11 Gaussian window (sigma 1.5) of Wang et al.
+float computeSsim(const Image& image, const Image& reference);
+
+// Mean absolute difference between the luminance change of the image since the previous frame, and the one of the reference
+// A stable filter only changes as much as the converged scene does, flickering adds changes of its own
+float computeFlicker(const Image& image, const Image& previousImage, const Image& reference, const Image& previousReference);
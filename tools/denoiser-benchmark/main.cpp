@@ -0,0 +1,273 @@
+#include "DenoiserPlugin.hpp"
+#include "ImageIO.hpp"
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Options {
+    std::string colorPattern;
+    std::string referencePattern;
+    std::string normalPattern;
+    std::string depthPattern;
+    std::string albedoPattern;
+    std::string positionPattern;
+    std::string weightsFile;
+    uint32_t firstFrame { 0 };
+    uint32_t nbFrames { 1 };
+    std::vector<std::string> denoisers; // Every registered one when empty
+    uint32_t nbThreads { std::max(std::thread::hardware_concurrency(), 1u) };
+    std::string csvFile { "benchmark.csv" };
+    std::string dumpDirectory;
+};
+
+// Measures of a denoiser over the sequence
+struct Results {
+    std::string name;
+    std::unique_ptr<DenoiserPlugin> denoiser;
+    Image previousOutput;
+    double milliseconds { 0.0 };
+    double psnr { 0.0 };
+    double ssim { 0.0 };
+    double flicker { 0.0 };
+    uint32_t nbFlickerFrames { 0 };
+};
+
+static void printUsage()
+{
+    std::cout << "Usage : denoiser-benchmark --color P --reference P [--normal P] [--depth P] [--albedo P] [--position P]" << std::endl;
+    std::cout << "                           [--weights F] [--first N] [--frames N] [--denoiser NAME]... [--threads N] [--csv FILE] [--dump DIR]" << std::endl;
+    std::cout << "Runs the registered denoisers on a sequence of noisy frames and compares them to a high sample count reference." << std::endl;
+    std::cout << "The patterns are PFM or EXR files, where a run of # is replaced by the zero padded frame number." << std::endl;
+    std::cout << "  --first N        first frame number (default 0)" << std::endl;
+    std::cout << "  --frames N       number of frames (default 1), the flicker needs at least 2" << std::endl;
+    std::cout << "  --position P     world space positions of the first hits, without them BMFR only runs when asked for" << std::endl;
+    std::cout << "  --weights F      weights of the U-Net, which only runs with them" << std::endl;
+    std::cout << "  --denoiser NAME  denoiser to run, can be repeated (default all of them :";
+    for (const DenoiserRegistration& registration : getRegisteredDenoisers()) {
+        std::cout << " " << registration.name;
+    }
+    std::cout << ")" << std::endl;
+    std::cout << "  --threads N      number of threads of every denoiser (default " << std::thread::hardware_concurrency() << ")" << std::endl;
+    std::cout << "  --csv FILE       measures of every frame and their means (default benchmark.csv)" << std::endl;
+    std::cout << "  --dump DIR       writes the outputs of the denoisers and the reference side by side, for every frame" << std::endl;
+}
+
+static Options parseOptions(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--color" && i + 1 < argc) {
+            options.colorPattern = argv[++i];
+        } else if (arg == "--reference" && i + 1 < argc) {
+            options.referencePattern = argv[++i];
+        } else if (arg == "--normal" && i + 1 < argc) {
+            options.normalPattern = argv[++i];
+        } else if (arg == "--depth" && i + 1 < argc) {
+            options.depthPattern = argv[++i];
+        } else if (arg == "--albedo" && i + 1 < argc) {
+            options.albedoPattern = argv[++i];
+        } else if (arg == "--position" && i + 1 < argc) {
+            options.positionPattern = argv[++i];
+        } else if (arg == "--weights" && i + 1 < argc) {
+            options.weightsFile = argv[++i];
+        } else if (arg == "--first" && i + 1 < argc) {
+            options.firstFrame = std::max(std::stoi(argv[++i]), 0);
+        } else if (arg == "--frames" && i + 1 < argc) {
+            options.nbFrames = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--denoiser" && i + 1 < argc) {
+            options.denoisers.push_back(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.nbThreads = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--csv" && i + 1 < argc) {
+            options.csvFile = argv[++i];
+        } else if (arg == "--dump" && i + 1 < argc) {
+            options.dumpDirectory = argv[++i];
+        } else {
+            throw std::invalid_argument("Unknown option " + arg);
+        }
+    }
+    return options;
+}
+
+static std::string getFrameFile(const std::string& pattern, uint32_t frame)
+{
+    const size_t begin = pattern.find('#');
+    if (begin == std::string::npos) {
+        return pattern;
+    }
+    const size_t end = pattern.find_first_not_of('#', begin);
+    const size_t digits = (end == std::string::npos ? pattern.size() : end) - begin;
+
+    std::string number = std::to_string(frame);
+    if (number.size() < digits) {
+        number.insert(0, digits - number.size(), '0');
+    }
+    return pattern.substr(0, begin) + number + (end == std::string::npos ? "" : pattern.substr(end));
+}
+
+static std::vector<Results> createDenoisers(const Options& options)
+{
+    const std::vector<DenoiserRegistration> registrations = getRegisteredDenoisers();
+
+    std::vector<Results> results;
+    for (const DenoiserRegistration& registration : registrations) {
+        const bool runByDefault = (!registration.needsPosition || !options.positionPattern.empty()) && (!registration.needsWeights || !options.weightsFile.empty());
+        if (options.denoisers.empty() ? runByDefault : std::find(options.denoisers.begin(), options.denoisers.end(), registration.name) != options.denoisers.end()) {
+            results.emplace_back();
+            results.back().name = registration.name;
+            results.back().denoiser = registration.create({ options.nbThreads, options.weightsFile });
+        }
+    }
+
+    for (const std::string& name : options.denoisers) {
+        const auto found = std::find_if(registrations.begin(), registrations.end(), [&](const DenoiserRegistration& registration) { return registration.name == name; });
+        if (found == registrations.end()) {
+            throw std::invalid_argument("Unknown denoiser " + name);
+        }
+    }
+    return results;
+}
+
+// Outputs of the denoisers, then the reference, from left to right
+static void dumpSideBySide(const std::string& filename, const std::vector<Image>& images)
+{
+    const uint32_t width = images.front().width;
+    const uint32_t height = images.front().height;
+    Image dump(width * static_cast<uint32_t>(images.size()), height, 3);
+
+    for (size_t i = 0; i < images.size(); i++) {
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                for (uint32_t c = 0; c < 3; c++) {
+                    dump.at(static_cast<uint32_t>(i) * width + x, y, c) = images[i].at(x, y, c);
+                }
+            }
+        }
+    }
+    saveImage(filename, dump);
+}
+
+static void runBenchmark(const Options& options)
+{
+    std::vector<Results> results = createDenoisers(options);
+
+    std::ofstream csv(options.csvFile);
+    if (!csv) {
+        throw std::runtime_error("Failed to write " + options.csvFile);
+    }
+    csv << "denoiser,frame,ms,psnr,ssim,flicker" << std::endl;
+
+    if (!options.dumpDirectory.empty()) {
+        std::filesystem::create_directories(options.dumpDirectory);
+    }
+
+    Image previousReference;
+    for (uint32_t frame = options.firstFrame; frame < options.firstFrame + options.nbFrames; frame++) {
+        FeatureImages inputs;
+        inputs.color = loadImage(getFrameFile(options.colorPattern, frame));
+        if (!options.normalPattern.empty()) {
+            inputs.normal = loadImage(getFrameFile(options.normalPattern, frame));
+        }
+        if (!options.depthPattern.empty()) {
+            inputs.depth = loadImage(getFrameFile(options.depthPattern, frame));
+        }
+        if (!options.albedoPattern.empty()) {
+            inputs.albedo = loadImage(getFrameFile(options.albedoPattern, frame));
+        }
+        if (!options.positionPattern.empty()) {
+            inputs.position = loadImage(getFrameFile(options.positionPattern, frame));
+        }
+        Image reference = loadImage(getFrameFile(options.referencePattern, frame));
+
+        std::vector<Image> outputs;
+        for (Results& result : results) {
+            const auto start = std::chrono::high_resolution_clock::now();
+            Image output = result.denoiser->denoise(inputs);
+            const auto end = std::chrono::high_resolution_clock::now();
+
+            const float milliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+            const float psnr = computePsnr(output, reference);
+            const float ssim = computeSsim(output, reference);
+            result.milliseconds += milliseconds;
+            result.psnr += psnr;
+            result.ssim += ssim;
+
+            csv << result.name << "," << frame << "," << milliseconds << "," << psnr << "," << ssim << ",";
+            if (!result.previousOutput.empty()) {
+                const float flicker = computeFlicker(output, result.previousOutput, reference, previousReference);
+                result.flicker += flicker;
+                result.nbFlickerFrames++;
+                csv << flicker;
+            }
+            csv << std::endl;
+
+            if (!options.dumpDirectory.empty()) {
+                outputs.push_back(output);
+            }
+            result.previousOutput = std::move(output);
+        }
+
+        if (!options.dumpDirectory.empty()) {
+            outputs.push_back(reference);
+            dumpSideBySide(options.dumpDirectory + "/" + getFrameFile("frame_####.exr", frame), outputs);
+        }
+        previousReference = std::move(reference);
+        std::cout << "Frame " << frame << " done" << std::endl;
+    }
+
+    // Means over the sequence, the PSNR is averaged in dB
+    std::cout << std::endl
+              << std::left << std::setw(12) << "Denoiser" << std::right << std::setw(12) << "ms/frame" << std::setw(12) << "PSNR"
+              << std::setw(12) << "SSIM" << std::setw(12) << "Flicker" << std::endl;
+    for (const Results& result : results) {
+        const double nbFrames = options.nbFrames;
+        csv << result.name << ",mean," << result.milliseconds / nbFrames << "," << result.psnr / nbFrames << "," << result.ssim / nbFrames << ",";
+        std::cout << std::left << std::setw(12) << result.name << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(12) << result.milliseconds / nbFrames << std::setw(12) << result.psnr / nbFrames
+                  << std::setw(12) << result.ssim / nbFrames << std::setw(12);
+        if (result.nbFlickerFrames) {
+            csv << result.flicker / result.nbFlickerFrames;
+            std::cout << result.flicker / result.nbFlickerFrames;
+        } else {
+            std::cout << "-";
+        }
+        csv << std::endl;
+        std::cout << std::endl;
+    }
+
+    if (!options.dumpDirectory.empty()) {
+        std::cout << std::endl << "Dumped columns :";
+        for (const Results& result : results) {
+            std::cout << " " << result.name;
+        }
+        std::cout << " reference" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    try {
+        const Options options = parseOptions(argc, argv);
+        if (options.colorPattern.empty() || options.referencePattern.empty()) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+        runBenchmark(options);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,316 @@
+#include "BlockCompression.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+// Interpolation weights of the 4 bit BC7 indices, out of 64
+constexpr std::array<int, 16> BC7_WEIGHTS = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+using Color = std::array<float, 4>;
+
+// Little endian bit stream of one 128 bits block
+class BlockWriter {
+public:
+    BlockWriter(uint8_t* block)
+        : _block(block)
+    {
+        std::fill(_block, _block + BLOCK_SIZE, 0);
+    }
+
+    void write(uint32_t value, uint32_t nbBits)
+    {
+        for (uint32_t i = 0; i < nbBits; i++, _offset++) {
+            if (value & (1u << i)) {
+                _block[_offset / 8] |= static_cast<uint8_t>(1u << (_offset % 8));
+            }
+        }
+    }
+
+private:
+    uint8_t* _block;
+    uint32_t _offset { 0 };
+};
+
+struct Mode6Candidate {
+    std::array<int, 4> endpoints[2]; // 7 bits per channel
+    int pbits[2];
+    std::array<int, 16> indices;
+    float error;
+};
+
+static std::array<int, 4> getEndpointColor(const std::array<int, 4>& endpoint, int pbit)
+{
+    std::array<int, 4> color;
+    for (size_t c = 0; c < 4; c++) {
+        color[c] = (endpoint[c] << 1) | pbit;
+    }
+    return color;
+}
+
+static std::array<int, 4> quantizeEndpoint(const Color& color, int pbit)
+{
+    std::array<int, 4> endpoint;
+    for (size_t c = 0; c < 4; c++) {
+        endpoint[c] = std::clamp(static_cast<int>(std::lround((color[c] - pbit) / 2.f)), 0, 127);
+    }
+    return endpoint;
+}
+
+// Picks the closest palette entry of every texel, returns the squared error of the block
+static float assignIndices(const Color* texels, Mode6Candidate& candidate)
+{
+    const std::array<int, 4> e0 = getEndpointColor(candidate.endpoints[0], candidate.pbits[0]);
+    const std::array<int, 4> e1 = getEndpointColor(candidate.endpoints[1], candidate.pbits[1]);
+
+    std::array<Color, 16> palette;
+    for (size_t i = 0; i < palette.size(); i++) {
+        for (size_t c = 0; c < 4; c++) {
+            palette[i][c] = static_cast<float>(((64 - BC7_WEIGHTS[i]) * e0[c] + BC7_WEIGHTS[i] * e1[c] + 32) >> 6);
+        }
+    }
+
+    float error = 0.f;
+    for (size_t t = 0; t < 16; t++) {
+        float bestError = std::numeric_limits<float>::max();
+        for (size_t i = 0; i < palette.size(); i++) {
+            float texelError = 0.f;
+            for (size_t c = 0; c < 4; c++) {
+                const float d = palette[i][c] - texels[t][c];
+                texelError += d * d;
+            }
+            if (texelError < bestError) {
+                bestError = texelError;
+                candidate.indices[t] = static_cast<int>(i);
+            }
+        }
+        error += bestError;
+    }
+
+    candidate.error = error;
+    return error;
+}
+
+// Least squares endpoints for the current indices
+static bool fitEndpoints(const Color* texels, const Mode6Candidate& candidate, Color& e0, Color& e1)
+{
+    float aa = 0.f, ab = 0.f, bb = 0.f;
+    Color ax {}, bx {};
+    for (size_t t = 0; t < 16; t++) {
+        const float b = BC7_WEIGHTS[candidate.indices[t]] / 64.f;
+        const float a = 1.f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (size_t c = 0; c < 4; c++) {
+            ax[c] += a * texels[t][c];
+            bx[c] += b * texels[t][c];
+        }
+    }
+
+    const float det = aa * bb - ab * ab;
+    if (std::abs(det) < 1e-6f) {
+        return false;
+    }
+
+    for (size_t c = 0; c < 4; c++) {
+        e0[c] = std::clamp((bb * ax[c] - ab * bx[c]) / det, 0.f, 255.f);
+        e1[c] = std::clamp((aa * bx[c] - ab * ax[c]) / det, 0.f, 255.f);
+    }
+    return true;
+}
+
+void encodeBC7Block(const uint8_t* texels, uint8_t* block)
+{
+    std::array<Color, 16> colors;
+    Color mean {};
+    for (size_t t = 0; t < 16; t++) {
+        for (size_t c = 0; c < 4; c++) {
+            colors[t][c] = texels[4 * t + c];
+            mean[c] += colors[t][c] / 16.f;
+        }
+    }
+
+    // Principal axis of the block by power iteration on the covariance
+    float covariance[4][4] = {};
+    for (const Color& color : colors) {
+        for (size_t i = 0; i < 4; i++) {
+            for (size_t j = 0; j < 4; j++) {
+                covariance[i][j] += (color[i] - mean[i]) * (color[j] - mean[j]);
+            }
+        }
+    }
+
+    Color axis = { 1.f, 1.f, 1.f, 1.f };
+    for (int iteration = 0; iteration < 8; iteration++) {
+        Color next {};
+        for (size_t i = 0; i < 4; i++) {
+            for (size_t j = 0; j < 4; j++) {
+                next[i] += covariance[i][j] * axis[j];
+            }
+        }
+        const float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+        if (length < 1e-6f) {
+            break;
+        }
+        for (size_t i = 0; i < 4; i++) {
+            axis[i] = next[i] / length;
+        }
+    }
+
+    float minProjection = std::numeric_limits<float>::max();
+    float maxProjection = std::numeric_limits<float>::lowest();
+    for (const Color& color : colors) {
+        float projection = 0.f;
+        for (size_t c = 0; c < 4; c++) {
+            projection += (color[c] - mean[c]) * axis[c];
+        }
+        minProjection = std::min(minProjection, projection);
+        maxProjection = std::max(maxProjection, projection);
+    }
+
+    Color start, end;
+    for (size_t c = 0; c < 4; c++) {
+        start[c] = std::clamp(mean[c] + axis[c] * minProjection, 0.f, 255.f);
+        end[c] = std::clamp(mean[c] + axis[c] * maxProjection, 0.f, 255.f);
+    }
+
+    // Every combination of the two p-bits, each refined once with least squares
+    Mode6Candidate best {};
+    best.error = std::numeric_limits<float>::max();
+    for (int p = 0; p < 4; p++) {
+        Mode6Candidate candidate {};
+        candidate.pbits[0] = p & 1;
+        candidate.pbits[1] = p >> 1;
+        candidate.endpoints[0] = quantizeEndpoint(start, candidate.pbits[0]);
+        candidate.endpoints[1] = quantizeEndpoint(end, candidate.pbits[1]);
+        assignIndices(colors.data(), candidate);
+
+        Color e0, e1;
+        if (candidate.error > 0.f && fitEndpoints(colors.data(), candidate, e0, e1)) {
+            Mode6Candidate refined = candidate;
+            refined.endpoints[0] = quantizeEndpoint(e0, refined.pbits[0]);
+            refined.endpoints[1] = quantizeEndpoint(e1, refined.pbits[1]);
+            if (assignIndices(colors.data(), refined) < candidate.error) {
+                candidate = refined;
+            }
+        }
+
+        if (candidate.error < best.error) {
+            best = candidate;
+        }
+    }
+
+    // The anchor index is stored without its high bit, so it must be below 8
+    if (best.indices[0] & 8) {
+        std::swap(best.endpoints[0], best.endpoints[1]);
+        std::swap(best.pbits[0], best.pbits[1]);
+        for (int& index : best.indices) {
+            index = 15 - index;
+        }
+    }
+
+    BlockWriter writer(block);
+    writer.write(1u << 6, 7); // Mode 6
+    for (size_t c = 0; c < 4; c++) {
+        writer.write(best.endpoints[0][c], 7);
+        writer.write(best.endpoints[1][c], 7);
+    }
+    writer.write(best.pbits[0], 1);
+    writer.write(best.pbits[1], 1);
+    writer.write(best.indices[0], 3);
+    for (size_t t = 1; t < 16; t++) {
+        writer.write(best.indices[t], 4);
+    }
+}
+
+// One BC4 block, using the 8 values mode (first endpoint greater than the second)
+static void encodeBC4Block(const uint8_t* texels, size_t channel, uint8_t* block)
+{
+    int minValue = 255;
+    int maxValue = 0;
+    for (size_t t = 0; t < 16; t++) {
+        minValue = std::min<int>(minValue, texels[4 * t + channel]);
+        maxValue = std::max<int>(maxValue, texels[4 * t + channel]);
+    }
+
+    block[0] = static_cast<uint8_t>(maxValue);
+    block[1] = static_cast<uint8_t>(minValue);
+
+    std::array<int, 8> palette;
+    palette[0] = maxValue;
+    palette[1] = minValue;
+    for (int i = 2; i < 8; i++) {
+        palette[i] = ((8 - i) * maxValue + (i - 1) * minValue) / 7;
+    }
+
+    uint64_t indices = 0;
+    for (size_t t = 0; t < 16; t++) {
+        uint64_t bestIndex = 0;
+        int bestError = std::numeric_limits<int>::max();
+        for (size_t i = 0; i < palette.size() && maxValue != minValue; i++) {
+            const int error = std::abs(palette[i] - texels[4 * t + channel]);
+            if (error < bestError) {
+                bestError = error;
+                bestIndex = i;
+            }
+        }
+        indices |= bestIndex << (3 * t);
+    }
+
+    for (size_t i = 0; i < 6; i++) {
+        block[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+    }
+}
+
+void encodeBC5Block(const uint8_t* texels, uint8_t* block)
+{
+    encodeBC4Block(texels, 0, block);
+    encodeBC4Block(texels, 1, block + 8);
+}
+
+std::vector<uint8_t> compressImage(const uint8_t* pixels, uint32_t width, uint32_t height, BlockFormat format, uint32_t nbThreads)
+{
+    const uint32_t blocksX = (width + 3) / 4;
+    const uint32_t blocksY = (height + 3) / 4;
+    std::vector<uint8_t> blocks(static_cast<size_t>(blocksX) * blocksY * BLOCK_SIZE);
+
+    // Rows of blocks are handed out one at a time, the cost of a row depends on its content
+    std::atomic<uint32_t> nextRow { 0 };
+    auto worker = [&]() {
+        uint8_t texels[64];
+        for (uint32_t by = nextRow++; by < blocksY; by = nextRow++) {
+            for (uint32_t bx = 0; bx < blocksX; bx++) {
+                for (uint32_t y = 0; y < 4; y++) {
+                    for (uint32_t x = 0; x < 4; x++) {
+                        const size_t px = std::min(bx * 4 + x, width - 1);
+                        const size_t py = std::min(by * 4 + y, height - 1);
+                        std::copy_n(pixels + (py * width + px) * 4, 4, texels + (y * 4 + x) * 4);
+                    }
+                }
+
+                uint8_t* block = blocks.data() + (static_cast<size_t>(by) * blocksX + bx) * BLOCK_SIZE;
+                if (format == BlockFormat::BC7) {
+                    encodeBC7Block(texels, block);
+                } else {
+                    encodeBC5Block(texels, block);
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < std::min(nbThreads, blocksY); i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+
+    for (auto& thread : workers) {
+        thread.join();
+    }
+
+    return blocks;
+}
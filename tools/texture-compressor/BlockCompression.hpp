@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class BlockFormat {
+    BC7, // RGBA, encoded with mode 6 only
+    BC5, // Two channels (red and green), blue and alpha are dropped
+};
+
+constexpr size_t BLOCK_SIZE = 16; // Both formats store a 4x4 block in 16 bytes
+
+// texels is a 4x4 block of RGBA8 values, row major
+void encodeBC7Block(const uint8_t* texels, uint8_t* block);
+void encodeBC5Block(const uint8_t* texels, uint8_t* block);
+
+// Encodes a whole RGBA8 image, the borders of sizes not multiple of 4 are clamped
+std::vector<uint8_t> compressImage(const uint8_t* pixels, uint32_t width, uint32_t height, BlockFormat format, uint32_t nbThreads);
@@ -0,0 +1,124 @@
+#include "BlockCompression.hpp"
+#include "ImageUtils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gli/gli.hpp>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+// Same directory as TEXTURE_CACHE_PATH, so the application finds the compressed textures
+const std::string DEFAULT_OUTPUT_PATH = "../../assets/cache/textures";
+
+struct Options {
+    BlockFormat format { BlockFormat::BC7 };
+    uint32_t nbThreads { std::max(std::thread::hardware_concurrency(), 1u) };
+    std::string outputDirectory { DEFAULT_OUTPUT_PATH };
+    std::vector<std::string> files;
+};
+
+static void printUsage()
+{
+    std::cout << "Usage : texture-compressor [--bc5] [--threads N] [--output DIR] IMAGE..." << std::endl;
+    std::cout << "Encodes JPEG/PNG images and their mip chain to KTX files named after the hash of the source," << std::endl;
+    std::cout << "as expected by the texture cache of the application." << std::endl;
+    std::cout << "  --bc5        two channel BC5 instead of BC7, for data stored in red and green only" << std::endl;
+    std::cout << "  --threads N  number of encoding threads (default " << std::thread::hardware_concurrency() << ")" << std::endl;
+    std::cout << "  --output DIR texture cache directory (default " << DEFAULT_OUTPUT_PATH << ")" << std::endl;
+}
+
+static Options parseOptions(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--bc5") {
+            options.format = BlockFormat::BC5;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.nbThreads = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--output" && i + 1 < argc) {
+            options.outputDirectory = argv[++i];
+        } else if (arg.rfind("--", 0) == 0) {
+            throw std::invalid_argument("Unknown option " + arg);
+        } else {
+            options.files.push_back(arg);
+        }
+    }
+    return options;
+}
+
+static void compressFile(const std::string& filename, const Options& options)
+{
+    std::vector<unsigned char> content;
+    if (!readFile(filename, content)) {
+        throw std::runtime_error("Failed to read " + filename);
+    }
+
+    int width, height, nbChannels;
+    stbi_uc* pixels = stbi_load_from_memory(content.data(), static_cast<int>(content.size()), &width, &height, &nbChannels, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error("Failed to decode " + filename);
+    }
+
+    // BC5 data is not color, so it is filtered as is
+    const bool srgb = options.format == BlockFormat::BC7;
+    const MipChain chain = generateMipChain(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), srgb);
+    stbi_image_free(pixels);
+
+    const gli::format format = srgb ? gli::FORMAT_RGBA_BP_SRGB_BLOCK16 : gli::FORMAT_RG_ATI2N_UNORM_BLOCK16;
+    gli::texture2d texture(format, gli::extent2d(width, height), chain.levels.size());
+
+    for (size_t level = 0; level < chain.levels.size(); level++) {
+        const MipLevel& mip = chain.levels[level];
+        const std::vector<uint8_t> blocks = compressImage(chain.data.data() + mip.offset, mip.width, mip.height, options.format, options.nbThreads);
+        if (blocks.size() != texture.size(level)) {
+            throw std::runtime_error("Unexpected compressed size for " + filename);
+        }
+        std::copy(blocks.begin(), blocks.end(), static_cast<uint8_t*>(texture.data(0, 0, level)));
+    }
+
+    // The cache is keyed by the content of the source, like the decoded textures
+    const std::string path = options.outputDirectory + "/" + hashToString(hashBytes(content.data(), content.size())) + ".ktx";
+    const std::string tmpPath = path + ".tmp";
+    if (!gli::save_ktx(texture, tmpPath)) {
+        throw std::runtime_error("Failed to write " + path);
+    }
+    std::filesystem::rename(tmpPath, path);
+
+    std::cout << filename << " -> " << path << " (" << width << "x" << height << ", " << chain.levels.size() << " levels, "
+              << chain.data.size() / 1024 << " KiB -> " << texture.size() / 1024 << " KiB)" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    try {
+        const Options options = parseOptions(argc, argv);
+        if (options.files.empty()) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+
+        std::filesystem::create_directories(options.outputDirectory);
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (const std::string& file : options.files) {
+            compressFile(file, options);
+        }
+        const auto end = std::chrono::high_resolution_clock::now();
+        std::cout << options.files.size() << " textures compressed in " << std::chrono::duration<float>(end - start).count() << " s" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}